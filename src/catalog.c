@@ -0,0 +1,66 @@
+/**
+ * \file        catalog.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "catalog.h"
+
+/**
+ * @brief Fibonacci hashing of the product code (40503 = 2^16/phi).
+ * 
+ * @param code 
+ * @return uint16_t First slot to probe
+ */
+static inline uint16_t catalog_hash(uint16_t code)
+{
+    return (uint16_t)(code * 40503u) >> (16 - CATALOG_BITS);
+}
+
+void catalog_clear(catalog_t *cat)
+{
+    memset(cat->products, 0, sizeof(cat->products));
+    cat->count = 0;
+}
+
+product_t *catalog_find(catalog_t *cat, uint16_t code)
+{
+    if (!code) {
+        return NULL;
+    }
+    for (uint16_t i = catalog_hash(code);; i = (i + 1) & (CATALOG_SIZE - 1)) {
+        if (cat->products[i].code == code) {
+            return &cat->products[i];
+        }
+        if (!cat->products[i].code) { ///< The load factor guarantees an empty slot
+            return NULL;
+        }
+    }
+}
+
+product_t *catalog_get(catalog_t *cat, uint16_t code)
+{
+    if (!code) {
+        return NULL;
+    }
+    uint16_t i;
+    for (i = catalog_hash(code); cat->products[i].code; i = (i + 1) & (CATALOG_SIZE - 1)) {
+        if (cat->products[i].code == code) {
+            return &cat->products[i];
+        }
+    }
+    if (cat->count >= CATALOG_MAX) {
+        return NULL;
+    }
+    memset(&cat->products[i], 0, sizeof(product_t));
+    cat->products[i].code = code;
+    cat->count++;
+    return &cat->products[i];
+}
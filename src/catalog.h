@@ -0,0 +1,99 @@
+/**
+ * \file        catalog.h
+ * \brief       Product catalog keyed by the product code read from the tags.
+ * \details     Open-addressing hash table (linear probing) sized at build time. Products
+ *              are never removed one by one, only the whole catalog is cleared, so no
+ *              tombstones are needed.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __CATALOG_
+#define __CATALOG_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef CATALOG_BITS
+#define CATALOG_BITS    8 ///< log2 of the number of slots of the hash table
+#endif
+#define CATALOG_SIZE    (1u << CATALOG_BITS) ///< Number of slots of the hash table
+#define CATALOG_MAX     (CATALOG_SIZE*3/4) ///< Maximum number of products (load factor 0.75)
+
+/**
+ * \typedef product_t
+ * \brief Record of a product (16 bytes, it is also the snapshot entry stored in flash).
+ */
+typedef struct {
+    uint16_t code;      ///< Product code, 0 means empty slot
+    uint8_t dirty;      ///< Fields not persisted yet (bit 0: amount, 1: purchase_v, 2: sale_v)
+    uint8_t reserved;
+    uint32_t amount;    ///< Amount of items in the warehouse
+    uint32_t purchase_v; ///< Unit purchase value
+    uint32_t sale_v;    ///< Unit sale value
+} product_t;
+
+/**
+ * \typedef catalog_t
+ * \brief Data structure to manage the product catalog.
+ */
+typedef struct {
+    product_t products[CATALOG_SIZE]; ///< Slots of the hash table
+    uint16_t count;     ///< Number of products
+} catalog_t;
+
+/**
+ * @brief Remove every product of the catalog.
+ * 
+ * @param cat 
+ */
+void catalog_clear(catalog_t *cat);
+
+/**
+ * @brief Look up a product.
+ * 
+ * @param cat 
+ * @param code 
+ * @return product_t* NULL if the product is not in the catalog
+ */
+product_t *catalog_find(catalog_t *cat, uint16_t code);
+
+/**
+ * @brief Look up a product, adding it (with zero values) if it is not in the catalog.
+ * 
+ * @param cat 
+ * @param code 
+ * @return product_t* NULL if the code is 0 or the catalog is full
+ */
+product_t *catalog_get(catalog_t *cat, uint16_t code);
+
+/**
+ * @brief Access a field of a product by its index.
+ * 
+ * @param p 
+ * @param field 0: amount, 1: purchase_v, 2: sale_v
+ * @return uint32_t* 
+ */
+static inline uint32_t *catalog_field(product_t *p, uint8_t field)
+{
+    return &(&p->amount)[field];
+}
+
+/**
+ * @brief Find the first used slot at or after a slot.
+ * 
+ * @param cat 
+ * @param slot 
+ * @return uint16_t The slot, CATALOG_SIZE if there are no more products
+ */
+static inline uint16_t catalog_next(catalog_t *cat, uint16_t slot)
+{
+    while (slot < CATALOG_SIZE && !cat->products[slot].code) {
+        slot++;
+    }
+    return slot;
+}
+
+#endif // __CATALOG_
@@ -0,0 +1,146 @@
+/**
+ * \file        console.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "console.h"
+#include "flash_worker.h"
+
+void console_init(console_t *c, void (*chars_available)(void *param))
+{
+    c->len = 0;
+    c->overflow = false;
+    stdio_set_chars_available_callback(chars_available, NULL);
+}
+
+bool console_read_line(console_t *c)
+{
+    int ch;
+    while ((ch = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+        if (ch == '\r' || ch == '\n') {
+            if (!c->len && !c->overflow) { ///< Empty line
+                continue;
+            }
+            c->line[c->len] = '\0';
+            c->len = 0;
+            if (c->overflow) {
+                c->overflow = false;
+                printf("Line too long\n");
+                continue;
+            }
+            return true;
+        }
+        if (c->len < CONSOLE_LINE_SIZE - 1) {
+            c->line[c->len++] = (char)ch;
+        }else {
+            c->overflow = true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Print a movement found by a history query.
+ *
+ * @param ctx Not used
+ * @param rec
+ */
+static void console_print_rec(void *ctx, const history_rec_t *rec)
+{
+    printf("%10u %5u %+8d %8u %8u ", rec->time, rec->code, rec->delta, rec->purchase_v, rec->sale_v);
+    for (uint8_t i = 0; i < rec->uid_size; i++) {
+        printf("%02X", rec->uid[i]);
+    }
+    printf("\n");
+}
+
+void console_execute(console_t *c, inventory_t *inv, nfc_sched_t *readers, tag_writer_t *writer)
+{
+    char *argv[CONSOLE_ARGS];
+    uint8_t argc = 0;
+    for (char *tok = strtok(c->line, " \t"); tok && argc < CONSOLE_ARGS; tok = strtok(NULL, " \t")) {
+        argv[argc++] = tok;
+    }
+    if (!argc) {
+        return;
+    }
+
+    if (!strcmp(argv[0], "hist") && argc >= 2) {
+        uint16_t code = (uint16_t)strtoul(argv[1], NULL, 10);
+        uint32_t t1 = argc >= 3 ? strtoul(argv[2], NULL, 10) : 0;
+        uint32_t t2 = argc >= 4 ? strtoul(argv[3], NULL, 10) : 0xFFFFFFFFU;
+        printf("      Time  Code    Delta Purchase     Sale Operator\n");
+        history_result_t res = history_query(&inv->history, code, t1, t2, console_print_rec, NULL);
+        printf("%u movements, net %" PRId64 ", sales %" PRIu64 "\n", res.moves, res.net, res.sales);
+    }
+    else if (!strcmp(argv[0], "time")) {
+        if (argc >= 2 && !history_set_time(&inv->history, strtoul(argv[1], NULL, 10))) {
+            printf("The clock can not go back\n");
+        }
+        printf("Time: %u\n", history_now(&inv->history));
+    }
+    else if (!strcmp(argv[0], "dump")) {
+        inventory_print_data(inv);
+    }
+    else if (!strcmp(argv[0], "stats")) {
+        journal_print_stats(&inv->journal);
+        history_print_stats(&inv->history);
+        flash_worker_print_stats();
+        for (uint8_t i = 0; i < readers->n; i++) {
+            printf("NFC reader %u:\n", i);
+            nfc_print_stats(readers->reader[i]);
+        }
+        nfc_sched_print_stats(readers);
+        tag_writer_print_stats(writer);
+    }
+    else if (!strcmp(argv[0], "cache")) {
+        for (uint8_t i = 0; i < readers->n; i++) {
+            nfc_rfid_t *nfc = readers->reader[i];
+            if (argc >= 2) {
+                nfc->cache.repeat = !strcmp(argv[1], "skip") ? UID_REPEAT_SKIP : UID_REPEAT_COUNT;
+            }
+            if (argc >= 3) {
+                nfc->cache.ttl_us = strtoul(argv[2], NULL, 10) * 1000000U;
+            }
+            printf("Reader %u: ", i);
+            uid_cache_print_stats(&nfc->cache);
+        }
+    }
+    else if (!strcmp(argv[0], "write")) {
+        if (argc >= 5) {
+            tag_t tag = {
+                .id = TAG_KIND_BOX,
+                .code = (uint16_t)strtoul(argv[1], NULL, 10),
+                .amount = strtoul(argv[2], NULL, 10),
+                .purchase_v = strtoul(argv[3], NULL, 10),
+                .sale_v = strtoul(argv[4], NULL, 10)
+            };
+            uint8_t copies = argc >= 6 ? (uint8_t)strtoul(argv[5], NULL, 10) : 1;
+            uint8_t queued = tag.code ? tag_writer_push(writer, &tag, copies) : 0;
+            printf("%u of %u tags queued%s\n", queued, copies, queued ? "" : " (invalid payload or queue full)");
+            for (uint8_t i = 0; i < readers->n; i++) {
+                nfc_poll_activity(readers->reader[i]); ///< Poll fast for the cards
+            }
+        }
+        else if (argc >= 2 && !strcmp(argv[1], "clear")) {
+            tag_writer_clear(writer);
+        }
+        tag_writer_print_stats(writer);
+    }
+    else {
+        printf("Commands: hist <code> [t1] [t2], time [now], dump, stats, cache [count|skip] [window s], "
+               "write <code> <amount> <purchase> <sale> [copies], write [clear]\n");
+    }
+}
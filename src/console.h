@@ -0,0 +1,70 @@
+/**
+ * \file        console.h
+ * \brief       Command line over the USB (stdio) console.
+ * \details     The characters are read without blocking when the stdio driver reports that
+ *              there are characters available. Commands:
+ *                  hist <code> [t1] [t2]   Movements of a product (0: every product) between t1 and t2
+ *                  time [now]              Show or set the clock of the history (s)
+ *                  dump                    Print the catalog and the totals
+ *                  stats                   Print the statistics of the journal, the history, the flash worker and the NFC readers
+ *                  cache [count|skip] [s]  Policy and window of the cards presented again, on every reader
+ *                  write <code> <amount> <purchase> <sale> [copies]
+ *                                          Queue box tags to write to the next cards presented
+ *                  write [clear]           Show the writer (or empty its queue)
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __CONSOLE_
+#define __CONSOLE_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "inventory.h"
+#include "nfc_sched.h"
+#include "tag_writer.h"
+
+#define CONSOLE_LINE_SIZE 48 ///< Maximum length of a command line
+#define CONSOLE_ARGS 6       ///< Maximum words of a command line
+
+/**
+ * \typedef console_t
+ * \brief Data structure to manage the console.
+ */
+typedef struct {
+    char line[CONSOLE_LINE_SIZE]; ///< Command line being received
+    uint8_t len;        ///< Characters of the command line
+    bool overflow;      ///< The command line is too long, it is discarded
+} console_t;
+
+/**
+ * @brief This function initializes the console_t structure and registers the callback
+ * called by the stdio driver when there are characters available.
+ *
+ * @param c
+ * @param chars_available Callback (called from an interrupt handler)
+ */
+void console_init(console_t *c, void (*chars_available)(void *param));
+
+/**
+ * @brief Read the available characters without blocking.
+ *
+ * @param c
+ * @return true if a complete command line was received
+ */
+bool console_read_line(console_t *c);
+
+/**
+ * @brief Execute the command line received.
+ *
+ * @param c
+ * @param inv
+ * @param readers
+ * @param writer
+ */
+void console_execute(console_t *c, inventory_t *inv, nfc_sched_t *readers, tag_writer_t *writer);
+
+#endif // __CONSOLE_
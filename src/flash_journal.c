@@ -0,0 +1,393 @@
+/**
+ * \file        flash_journal.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/time.h"
+#include "hardware/flash.h"
+
+#include "flash_journal.h"
+#include "flash_worker.h"
+
+_Static_assert(JOURNAL_SECTORS >= 2, "The previous snapshot must survive the compaction");
+
+/**
+ * @brief Memory-mapped address of a record slot.
+ *
+ * @param sector
+ * @param slot
+ * @return const journal_rec_t*
+ */
+static inline const journal_rec_t *journal_rec_at(uint8_t sector, uint16_t slot)
+{
+    return (const journal_rec_t *)(XIP_BASE + JOURNAL_OFFSET + sector*FLASH_SECTOR_SIZE + slot*JOURNAL_REC_SIZE);
+}
+
+static inline bool journal_rec_is_free(const journal_rec_t *rec)
+{
+    const uint32_t *w = (const uint32_t *)rec;
+    return (w[0] & w[1] & w[2] & w[3]) == 0xFFFFFFFFU;
+}
+
+static inline bool journal_rec_is_valid(const journal_rec_t *rec)
+{
+    return rec->crc == journal_crc32((const uint8_t *)rec, JOURNAL_REC_SIZE - sizeof(uint32_t));
+}
+
+static void journal_commit_timing(journal_t *j, uint64_t start)
+{
+    j->stats.last_us = (uint32_t)(time_us_64() - start);
+    if (j->stats.last_us > j->stats.max_us) {
+        j->stats.max_us = j->stats.last_us;
+    }
+}
+
+static void journal_erase_sector(journal_t *j, uint8_t sector)
+{
+    uint64_t start = time_us_64();
+    flash_worker_erase(JOURNAL_OFFSET + sector*FLASH_SECTOR_SIZE);
+    journal_commit_timing(j, start);
+    j->stats.erases++;
+}
+
+/**
+ * @brief Program the page buffer into the page that contains the slot.
+ * Slots that are 0xFF in the buffer are left untouched in the flash memory.
+ *
+ * @param j
+ * @param slot
+ */
+static void journal_program_page(journal_t *j, uint16_t slot)
+{
+    uint64_t start = time_us_64();
+    flash_worker_program(JOURNAL_OFFSET + j->sector*FLASH_SECTOR_SIZE + (slot/JOURNAL_RECS_PER_PAGE)*FLASH_PAGE_SIZE, j->page);
+    journal_commit_timing(j, start);
+    j->stats.programs++;
+}
+
+static void journal_build_rec(journal_rec_t *rec, uint8_t type, uint16_t id, uint8_t field, uint32_t value, uint32_t seq)
+{
+    rec->type = type;
+    rec->field = field;
+    rec->id = id;
+    rec->value = value;
+    rec->seq = seq;
+    rec->crc = journal_crc32((const uint8_t *)rec, JOURNAL_REC_SIZE - sizeof(uint32_t));
+}
+
+/**
+ * @brief Read the header of a sector.
+ *
+ * @param sector
+ * @param erase_count Erase counter stored in the header (0 if the header is not valid)
+ * @return uint32_t The epoch of the sector, 0 if the header is not valid
+ */
+static uint32_t journal_sector_epoch(uint8_t sector, uint32_t *erase_count)
+{
+    const journal_rec_t *hdr = journal_rec_at(sector, 0);
+    if (hdr->type != JR_HEADER || hdr->id != JOURNAL_MAGIC || hdr->field != JOURNAL_VERSION || !journal_rec_is_valid(hdr)) {
+        *erase_count = 0;
+        return 0;
+    }
+    *erase_count = hdr->value;
+    return hdr->seq;
+}
+
+/**
+ * @brief Check if the snapshot of a sector is complete: a JR_SNAPSHOT record, its entries and
+ * a commit record holding the CRC32 of the entries.
+ *
+ * @param sector
+ * @param entries Number of snapshot entries
+ * @return true if the sector is committed
+ */
+static bool journal_sector_committed(uint8_t sector, uint16_t *entries)
+{
+    const journal_rec_t *snap = journal_rec_at(sector, 1);
+    if (snap->type != JR_SNAPSHOT || !journal_rec_is_valid(snap) || snap->id > JOURNAL_RECS_PER_SECTOR - 3) {
+        return false;
+    }
+    const journal_rec_t *commit = journal_rec_at(sector, 2 + snap->id);
+    if (commit->type != JR_COMMIT || !journal_rec_is_valid(commit)) {
+        return false;
+    }
+    *entries = snap->id;
+    return commit->value == journal_crc32((const uint8_t *)journal_rec_at(sector, 2), snap->id*JOURNAL_REC_SIZE);
+}
+
+/**
+ * @brief Count the records of a batch that are in flash: valid and with consecutive sequence numbers.
+ *
+ * @param sector
+ * @param slot Slot of the JR_BATCH record
+ * @param batch
+ * @return uint16_t Number of records found, batch->id if the batch is complete
+ */
+static uint16_t journal_batch_records(uint8_t sector, uint16_t slot, const journal_rec_t *batch)
+{
+    uint16_t n;
+    for (n = 0; n < batch->id && (uint16_t)(slot + 1 + n) < JOURNAL_RECS_PER_SECTOR; n++) {
+        const journal_rec_t *rec = journal_rec_at(sector, slot + 1 + n);
+        if (journal_rec_is_free(rec) || !journal_rec_is_valid(rec) || rec->seq != batch->seq + 1 + n) {
+            break;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Find the sector with the newest epoch.
+ * Snapshots are written around the ring with increasing epochs, so the epochs form a rotated
+ * sorted array: sectors [0..newest] have an epoch >= epoch(0) and the following ones (older,
+ * blank or torn) are below it. A binary search finds the newest in O(log N) header reads.
+ *
+ * @param j
+ * @return uint8_t
+ */
+static uint8_t journal_find_newest(journal_t *j)
+{
+    uint32_t erase_count;
+    uint32_t first = journal_sector_epoch(0, &erase_count);
+    uint8_t lo = 0, hi = JOURNAL_SECTORS - 1;
+
+    j->stats.mount_reads = 1;
+    while (lo < hi) {
+        uint8_t mid = (lo + hi + 1) / 2;
+        j->stats.mount_reads++;
+        if (first && journal_sector_epoch(mid, &erase_count) >= first) {
+            lo = mid;
+        } else if (!first && journal_sector_epoch(mid, &erase_count)) {
+            lo = mid; ///< Sector 0 is blank or torn: the newest is the last valid one
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+bool journal_init(journal_t *j, void (*apply)(void *ctx, const journal_rec_t *rec), void (*load)(void *ctx, const void *entry),
+                  void (*snapshot)(void *ctx), void *ctx)
+{
+    j->apply = apply;
+    j->load = load;
+    j->snapshot = snapshot;
+    j->ctx = ctx;
+    j->sector = 0;
+    j->slot = 0;
+    j->epoch = 0;
+    j->seq = 0;
+    j->staged = 0;
+    j->overflow = false;
+    memset(&j->stats, 0, sizeof(j->stats));
+    flash_worker_wait(); ///< The journal is read through XIP
+
+    // Find the newest snapshot. If its compaction was cut, the previous sector is still committed.
+    uint8_t newest = journal_find_newest(j);
+    bool found = false;
+    uint16_t entries = 0;
+    for (uint8_t back = 0; back < 2 && !found; back++) {
+        uint8_t s = (newest + JOURNAL_SECTORS - back) % JOURNAL_SECTORS;
+        uint32_t erase_count;
+        uint32_t epoch = journal_sector_epoch(s, &erase_count);
+        if (epoch && journal_sector_committed(s, &entries)) {
+            found = true;
+            j->sector = s;
+            j->epoch = epoch;
+            j->erase_count = erase_count;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+    // Load the snapshot, then replay the records appended after it. Torn records (bad CRC) and torn batches are skipped.
+    for (uint16_t i = 0; i < entries; i++) {
+        j->load(j->ctx, journal_rec_at(j->sector, 2 + i));
+    }
+    j->seq = journal_rec_at(j->sector, 2 + entries)->seq + 1;
+    bool torn = false;
+    uint32_t torn_end = 0; ///< Last sequence number of the newest torn batch
+    uint16_t slot;
+    for (slot = 3 + entries; slot < JOURNAL_RECS_PER_SECTOR; slot++) {
+        const journal_rec_t *rec = journal_rec_at(j->sector, slot);
+        if (journal_rec_is_free(rec)) {
+            break;
+        }
+        if (!journal_rec_is_valid(rec)) {
+            continue;
+        }
+        if (rec->seq >= j->seq) {
+            j->seq = rec->seq + 1;
+        }
+        if (torn && rec->seq <= torn_end) { ///< Record of a torn batch, wherever it is
+            continue;
+        }
+        if (rec->type == JR_BATCH) {
+            uint16_t found = journal_batch_records(j->sector, slot, rec);
+            if (found < rec->id) { ///< Torn batch: drop every record of its range and never reuse their sequence numbers
+                torn = true;
+                torn_end = rec->seq + rec->id;
+                if (torn_end >= j->seq) {
+                    j->seq = torn_end + 1;
+                }
+                continue;
+            }
+        }
+        j->apply(j->ctx, rec);
+    }
+    j->slot = slot;
+    printf("Journal mounted: sector %u, epoch %u, %u records, %u erases\n", j->sector, j->epoch, j->slot, j->erase_count);
+    return true;
+}
+
+void journal_format(journal_t *j)
+{
+    j->sector = JOURNAL_SECTORS - 1; ///< The compaction starts at the first sector
+    j->epoch = 0;
+    journal_compact(j);
+}
+
+/**
+ * @brief Get the next slot of the page buffer.
+ *
+ * @param j
+ * @return uint8_t* 
+ */
+static uint8_t *journal_page_slot(journal_t *j)
+{
+    assert(j->slot < JOURNAL_RECS_PER_SECTOR);
+    if (!j->staged) { ///< Slots left at 0xFF are not modified when the page is programmed
+        memset(j->page, 0xFF, FLASH_PAGE_SIZE);
+    }
+    return &j->page[(j->slot % JOURNAL_RECS_PER_PAGE)*JOURNAL_REC_SIZE];
+}
+
+/**
+ * @brief Advance to the next slot and program the page once it is complete.
+ *
+ * @param j
+ */
+static void journal_page_next(journal_t *j)
+{
+    j->slot++;
+    j->staged++;
+    if (!(j->slot % JOURNAL_RECS_PER_PAGE)) { ///< The page is complete
+        journal_program_page(j, j->slot - 1);
+        j->staged = 0;
+    }
+}
+
+/**
+ * @brief Put a record into the page buffer.
+ *
+ * @param j
+ * @param type
+ * @param id
+ * @param field
+ * @param value
+ * @param seq
+ */
+static void journal_page_put(journal_t *j, uint8_t type, uint16_t id, uint8_t field, uint32_t value, uint32_t seq)
+{
+    journal_build_rec((journal_rec_t *)journal_page_slot(j), type, id, field, value, seq);
+    journal_page_next(j);
+}
+
+/**
+ * @brief Program the records staged in the page buffer, if any.
+ *
+ * @param j
+ */
+static void journal_page_flush(journal_t *j)
+{
+    if (j->staged) {
+        journal_program_page(j, j->slot - 1);
+        j->staged = 0;
+    }
+}
+
+void journal_snapshot_begin(journal_t *j, uint16_t entries)
+{
+    assert(entries <= JOURNAL_RECS_PER_SECTOR - 3);
+    journal_page_put(j, JR_SNAPSHOT, entries, 0, 0, j->seq++);
+    j->blob_crc = 0xFFFFFFFFU;
+}
+
+void journal_snapshot_entry(journal_t *j, const void *entry)
+{
+    uint8_t *slot = journal_page_slot(j);
+    memcpy(slot, entry, JOURNAL_REC_SIZE);
+    j->blob_crc = journal_crc32_step(j->blob_crc, slot, JOURNAL_REC_SIZE);
+    journal_page_next(j);
+}
+
+void journal_compact(journal_t *j)
+{
+    j->sector = (j->sector + 1) % JOURNAL_SECTORS;
+    j->slot = 0;
+    j->staged = 0;
+    j->overflow = false;
+    j->epoch++;
+    flash_worker_wait(); ///< The header is read through XIP
+    journal_sector_epoch(j->sector, &j->erase_count); ///< Keep the erase counter of the sector
+    j->erase_count++;
+    journal_erase_sector(j, j->sector);
+
+    journal_page_put(j, JR_HEADER, JOURNAL_MAGIC, JOURNAL_VERSION, j->erase_count, j->epoch); ///< The header carries the epoch
+    j->snapshot(j->ctx);
+    journal_page_flush(j); ///< The snapshot must be in flash before its commit record is programmed
+    journal_page_put(j, JR_COMMIT, 0, 0, ~j->blob_crc, j->seq++);
+    journal_page_flush(j);
+    j->stats.compactions++;
+}
+
+void journal_put(journal_t *j, uint8_t type, uint16_t id, uint8_t field, uint32_t value)
+{
+    // The caller has already updated the RAM copy, so the snapshot of the compaction will contain this change
+    if (j->slot >= JOURNAL_RECS_PER_SECTOR) {
+        j->overflow = true;
+        return;
+    }
+    journal_page_put(j, type, id, field, value, j->seq++);
+    j->stats.appends++;
+}
+
+void journal_sync(journal_t *j)
+{
+    if (j->overflow) {
+        journal_compact(j);
+        return;
+    }
+    journal_page_flush(j);
+}
+
+uint32_t journal_crc32_step(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    // Nibble-wise table of the reflected polynomial 0xEDB88320
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    for (uint32_t i = 0; i < len; i++) {
+        crc = (crc >> 4) ^ table[(crc ^ data[i]) & 0x0F];
+        crc = (crc >> 4) ^ table[(crc ^ (data[i] >> 4)) & 0x0F];
+    }
+    return crc;
+}
+
+void journal_print_stats(journal_t *j)
+{
+    printf("Journal: sector %u/%u slot %u epoch %u seq %u sector erases %u\n",
+           j->sector, JOURNAL_SECTORS, j->slot, j->epoch, j->seq, j->erase_count);
+    printf("appends %u programs %u erases %u compactions %u last %u us max %u us mount reads %u\n",
+           j->stats.appends, j->stats.programs, j->stats.erases, j->stats.compactions,
+           j->stats.last_us, j->stats.max_us, j->stats.mount_reads);
+}
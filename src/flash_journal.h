@@ -0,0 +1,216 @@
+/**
+ * \file        flash_journal.h
+ * \brief       Append-only transaction journal stored in the flash memory.
+ * \details     Every change of the inventory is appended as a fixed-size, CRC-protected
+ *              record into pre-erased flash pages. A sector is only erased when the journal
+ *              is compacted, i.e. when the active sector is full and a new snapshot is
+ *              written into the next sector of a ring near the top of the flash. A snapshot
+ *              is a JR_SNAPSHOT record, a blob of raw 16-byte entries and a JR_COMMIT record
+ *              holding the CRC32 of the blob; appended records follow it. Each
+ *              snapshot carries a monotonic sequence number (epoch) and the erase counter of
+ *              its sector. At boot the newest sector is found with a binary search over the
+ *              epochs and the database is rebuilt by replaying its records.
+ *
+ *              Crash consistency: the commit record is programmed on its own, after the
+ *              header and the entries are in flash, and a compaction never erases the sector
+ *              of the previous snapshot. The newest and the previous sector therefore act as
+ *              A/B banks: if power is lost before the commit record of the newest one is
+ *              complete, its CRC check fails and the previous snapshot is loaded instead.
+ *              Records that must be applied together are preceded by a JR_BATCH record; at
+ *              boot a batch is only replayed if all of its records are in flash.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __FLASH_JOURNAL_
+#define __FLASH_JOURNAL_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/flash.h"
+
+#ifndef JOURNAL_SECTORS
+#define JOURNAL_SECTORS         8 ///< Number of sectors of the ring used by the journal (at least 2)
+#endif
+#define JOURNAL_OFFSET          (PICO_FLASH_SIZE_BYTES - JOURNAL_SECTORS*FLASH_SECTOR_SIZE) ///< Flash-based address of the journal area
+#define JOURNAL_REC_SIZE        16 ///< Size in bytes of a journal record
+#define JOURNAL_RECS_PER_PAGE   (FLASH_PAGE_SIZE/JOURNAL_REC_SIZE)
+#define JOURNAL_RECS_PER_SECTOR (FLASH_SECTOR_SIZE/JOURNAL_REC_SIZE)
+#define JOURNAL_MAGIC           0x4A52 ///< "JR"
+#define JOURNAL_VERSION         1 ///< Layout version of the journal, stored in the header
+
+/**
+ * @brief Types of the journal records. 0xFF is an erased (free) slot.
+ *
+ */
+typedef enum {
+    JR_HEADER   = 0x01, ///< First record of a sector: id = magic, field = version, value = erase counter, seq = epoch
+    JR_COMMIT   = 0x02, ///< Closes the snapshot of a sector: value = CRC32 of the entries
+    JR_SNAPSHOT = 0x03, ///< Opens the snapshot of a sector: id = number of raw entries that follow
+    JR_SET      = 0x10, ///< Field of the product with code id = value
+    JR_ADD      = 0x11, ///< Amount of the product with code id += (int32_t)value
+    JR_RESET    = 0x12, ///< Remove every product
+    JR_BATCH    = 0x13, ///< The id records that follow are replayed all-or-nothing
+    JR_SALES    = 0x14, ///< Cumulative sales += (id << 32) | value
+    JR_CONFIG   = 0x15, ///< Setting id of the devices = value
+    JR_FREE     = 0xFF  ///< Erased slot
+} journal_rec_type_t;
+
+/**
+ * \typedef journal_rec_t
+ * \brief Record stored in the flash memory (16 bytes).
+ */
+typedef struct {
+    uint8_t type;   ///< One of journal_rec_type_t
+    uint8_t field;  ///< Column of the database for JR_SET (0: amount, 1: purchase_v, 2: sale_v)
+    uint16_t id;    ///< Product code
+    uint32_t value; ///< Value or signed delta
+    uint32_t seq;   ///< Sequence number of the record
+    uint32_t crc;   ///< CRC32 of the previous 12 bytes
+} journal_rec_t;
+
+/**
+ * \typedef journal_t
+ * \brief Data structure to manage the journal.
+ */
+typedef struct {
+    uint8_t sector;     ///< Active sector inside the ring
+    uint16_t slot;      ///< Next free record slot in the active sector
+    uint32_t epoch;     ///< Epoch of the active sector, incremented on each compaction
+    uint32_t erase_count; ///< Erase counter of the active sector
+    uint32_t seq;       ///< Sequence number of the next record
+    uint8_t staged;     ///< Records in the page buffer that are not programmed yet
+    bool overflow;      ///< The active sector is full, the next sync compacts the journal
+    uint32_t blob_crc;  ///< Running CRC32 of the snapshot entries being written
+
+    void (*apply)(void *ctx, const journal_rec_t *rec); ///< Called for each record during the replay
+    void (*load)(void *ctx, const void *entry); ///< Called for each snapshot entry during the replay
+    void (*snapshot)(void *ctx); ///< Called during the compaction to emit the snapshot entries
+    void *ctx;          ///< Context passed to the callbacks
+
+    uint8_t page[FLASH_PAGE_SIZE]; ///< Page buffer used to program the flash
+
+    struct {
+        uint32_t appends;       ///< Records appended
+        uint32_t programs;      ///< Flash pages programmed
+        uint32_t erases;        ///< Flash sectors erased
+        uint32_t compactions;   ///< Compactions performed
+        uint32_t last_us;       ///< Time spent by core 0 to queue the last flash operation (us)
+        uint32_t max_us;        ///< Worst time spent by core 0 to queue a flash operation (us)
+        uint8_t mount_reads;    ///< Sector headers read to find the newest snapshot at boot
+    } stats;
+} journal_t;
+
+/**
+ * @brief This function initializes the journal_t structure and mounts the journal.
+ * If a committed sector is found, its snapshot entries are passed to the load callback
+ * and its records are replayed through the apply callback.
+ *
+ * @param j
+ * @param apply
+ * @param load
+ * @param snapshot
+ * @param ctx
+ * @return true if an existing journal was mounted, false if the journal area is blank
+ */
+bool journal_init(journal_t *j, void (*apply)(void *ctx, const journal_rec_t *rec), void (*load)(void *ctx, const void *entry),
+                  void (*snapshot)(void *ctx), void *ctx);
+
+/**
+ * @brief Erase the journal and write a first snapshot (through the snapshot callback).
+ *
+ * @param j
+ */
+void journal_format(journal_t *j);
+
+/**
+ * @brief Stage one record in the page buffer. Records of the same page are programmed
+ * together, on journal_sync() or when the page is complete.
+ *
+ * @param j
+ * @param type
+ * @param id
+ * @param field
+ * @param value
+ */
+void journal_put(journal_t *j, uint8_t type, uint16_t id, uint8_t field, uint32_t value);
+
+/**
+ * @brief Program the staged records. Compacts the journal when the active sector is full.
+ *
+ * @param j
+ */
+void journal_sync(journal_t *j);
+
+/**
+ * @brief Append one record to the journal and program it.
+ *
+ * @param j
+ * @param type
+ * @param id
+ * @param field
+ * @param value
+ */
+static inline void journal_append(journal_t *j, uint8_t type, uint16_t id, uint8_t field, uint32_t value)
+{
+    journal_put(j, type, id, field, value);
+    journal_sync(j);
+}
+
+/**
+ * @brief Write a new snapshot in the next sector of the ring and make it the active one.
+ *
+ * @param j
+ */
+void journal_compact(journal_t *j);
+
+/**
+ * @brief Open the snapshot being written. Only call it from the snapshot callback,
+ * followed by exactly entries calls to journal_snapshot_entry().
+ *
+ * @param j
+ * @param entries Number of entries of the snapshot (at most JOURNAL_RECS_PER_SECTOR - 3)
+ */
+void journal_snapshot_begin(journal_t *j, uint16_t entries);
+
+/**
+ * @brief Add a raw entry of JOURNAL_REC_SIZE bytes to the snapshot being written.
+ *
+ * @param j
+ * @param entry
+ */
+void journal_snapshot_entry(journal_t *j, const void *entry);
+
+/**
+ * @brief Update a CRC32 (IEEE 802.3, reflected) with a buffer. Start with 0xFFFFFFFF
+ * and invert the result.
+ *
+ * @param crc
+ * @param data
+ * @param len
+ * @return uint32_t
+ */
+uint32_t journal_crc32_step(uint32_t crc, const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Compute the CRC32 (IEEE 802.3, reflected) of a buffer.
+ *
+ * @param data
+ * @param len
+ * @return uint32_t
+ */
+static inline uint32_t journal_crc32(const uint8_t *data, uint32_t len)
+{
+    return ~journal_crc32_step(0xFFFFFFFFU, data, len);
+}
+
+/**
+ * @brief Print the statistics of the journal.
+ *
+ * @param j
+ */
+void journal_print_stats(journal_t *j);
+
+#endif // __FLASH_JOURNAL_
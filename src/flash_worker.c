@@ -0,0 +1,179 @@
+/**
+ * \file        flash_worker.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/time.h"
+#include "hardware/flash.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "flash_worker.h"
+
+/**
+ * @brief Operation of the queue.
+ *
+ */
+typedef struct {
+    uint32_t offset;    ///< Flash-based address
+    bool erase;         ///< true: erase the sector, false: program the page
+    uint8_t data[FLASH_PAGE_SIZE];
+} flash_worker_op_t;
+
+static flash_worker_op_t gQueue[FLASH_WORKER_QUEUE];
+static volatile uint32_t gSubmitted;   ///< Operations queued by core 0
+static volatile uint32_t gDone;        ///< Operations completed by core 1
+static flash_worker_stats_t gStats;
+
+/**
+ * @brief Main loop of core 1: execute the operations in the order they were queued.
+ * Core 1 has no other work, so it can keep its interrupts disabled during the operation.
+ *
+ */
+static void flash_worker_main(void)
+{
+    while (true) {
+        uint32_t idx = multicore_fifo_pop_blocking();
+        flash_worker_op_t *op = &gQueue[idx % FLASH_WORKER_QUEUE];
+        uint32_t start = time_us_32();
+        uint32_t irq = save_and_disable_interrupts();
+        if (op->erase) {
+            flash_range_erase(op->offset, FLASH_SECTOR_SIZE);
+        }else {
+            flash_range_program(op->offset, op->data, FLASH_PAGE_SIZE);
+        }
+        restore_interrupts(irq);
+        uint32_t elapsed = time_us_32() - start;
+        if (elapsed > gStats.op_max_us) {
+            gStats.op_max_us = elapsed;
+        }
+        multicore_fifo_push_blocking(idx); ///< Completion, handled by the SIO interrupt of core 0
+    }
+}
+
+/**
+ * @brief SIO interrupt of core 0: count the completed operations.
+ *
+ */
+static void flash_worker_irq_handler(void)
+{
+    while (multicore_fifo_rvalid()) {
+        (void)multicore_fifo_pop_blocking();
+        gDone++;
+    }
+    multicore_fifo_clear_irq();
+}
+
+void flash_worker_init(void)
+{
+    gSubmitted = 0;
+    gDone = 0;
+    memset(&gStats, 0, sizeof(gStats));
+    multicore_launch_core1(flash_worker_main);
+    multicore_fifo_clear_irq();
+    irq_set_exclusive_handler(SIO_IRQ_PROC0, flash_worker_irq_handler);
+    irq_set_enabled(SIO_IRQ_PROC0, true);
+}
+
+/**
+ * @brief Wait until the queue has at most pending operations.
+ *
+ * @param pending
+ */
+static void flash_worker_drain(uint32_t pending)
+{
+    if (gSubmitted - gDone <= pending) {
+        return;
+    }
+    uint32_t start = time_us_32();
+    while (gSubmitted - gDone > pending) {
+        tight_loop_contents();
+    }
+    uint32_t elapsed = time_us_32() - start;
+    gStats.waits++;
+    if (elapsed > gStats.wait_max_us) {
+        gStats.wait_max_us = elapsed;
+    }
+}
+
+/**
+ * @brief Get a free slot of the queue.
+ *
+ * @return flash_worker_op_t*
+ */
+static flash_worker_op_t *flash_worker_slot(void)
+{
+    flash_worker_drain(FLASH_WORKER_QUEUE - 1);
+    return &gQueue[gSubmitted % FLASH_WORKER_QUEUE];
+}
+
+/**
+ * @brief Send the slot that was filled to core 1.
+ *
+ */
+static void flash_worker_submit(void)
+{
+    uint32_t idx = gSubmitted++;
+    if (gSubmitted - gDone > gStats.max_depth) {
+        gStats.max_depth = gSubmitted - gDone;
+    }
+    multicore_fifo_push_blocking(idx); ///< Never blocks: there are at most FLASH_WORKER_QUEUE indexes in the FIFO
+}
+
+void flash_worker_erase(uint32_t offset)
+{
+    flash_worker_op_t *op = flash_worker_slot();
+    op->offset = offset;
+    op->erase = true;
+    flash_worker_submit();
+    gStats.erases++;
+}
+
+void flash_worker_program(uint32_t offset, const uint8_t *data)
+{
+    flash_worker_op_t *op = flash_worker_slot();
+    op->offset = offset;
+    op->erase = false;
+    memcpy(op->data, data, FLASH_PAGE_SIZE);
+    flash_worker_submit();
+    gStats.programs++;
+}
+
+void flash_worker_wait(void)
+{
+    flash_worker_drain(0);
+}
+
+bool flash_worker_busy(void)
+{
+    return gSubmitted != gDone;
+}
+
+void flash_worker_irq_latency(uint32_t us)
+{
+    if (flash_worker_busy()) {
+        if (us > gStats.irq_max_busy_us) {
+            gStats.irq_max_busy_us = us;
+        }
+    }else if (us > gStats.irq_max_idle_us) {
+        gStats.irq_max_idle_us = us;
+    }
+}
+
+void flash_worker_print_stats(void)
+{
+    printf("Flash worker: erases %u programs %u max depth %u max op %u us\n",
+           gStats.erases, gStats.programs, gStats.max_depth, gStats.op_max_us);
+    printf("core 0 waits %u max wait %u us, IRQ latency max %u us idle / %u us during flash ops\n",
+           gStats.waits, gStats.wait_max_us, gStats.irq_max_idle_us, gStats.irq_max_busy_us);
+}
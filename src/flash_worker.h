@@ -0,0 +1,88 @@
+/**
+ * \file        flash_worker.h
+ * \brief       Persistence worker: the flash erase and program operations run on core 1.
+ * \details     Core 0 copies each operation into a slot of a queue in RAM and sends the index of
+ *              the slot through the multicore FIFO. Core 1 executes the operations in order and
+ *              sends the index back, which raises the SIO interrupt of core 0 to count it as done.
+ *              The binary is built as copy_to_ram, so core 0 and its interrupt handlers keep running
+ *              from RAM while the flash is out of XIP mode. The only XIP accesses are the explicit
+ *              reads of the journal and the history, which call flash_worker_wait() first.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __FLASH_WORKER_
+#define __FLASH_WORKER_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/flash.h"
+
+#define FLASH_WORKER_QUEUE 8 ///< Slots of the queue, at most the depth of the multicore FIFO
+
+/**
+ * \typedef flash_worker_stats_t
+ * \brief Statistics of the worker.
+ */
+typedef struct {
+    uint32_t erases;        ///< Sectors erased
+    uint32_t programs;      ///< Pages programmed
+    uint32_t max_depth;     ///< Largest number of operations waiting in the queue
+    uint32_t op_max_us;     ///< Worst duration of an operation on core 1
+    uint32_t waits;         ///< Times core 0 waited for the worker (full queue or XIP read)
+    uint32_t wait_max_us;   ///< Worst wait of core 0
+    uint32_t irq_max_idle_us; ///< Worst latency of the check tag alarm while the flash was idle
+    uint32_t irq_max_busy_us; ///< Worst latency of the check tag alarm while an operation was running
+} flash_worker_stats_t;
+
+/**
+ * @brief Launch the worker on core 1 and enable the completion interrupt on core 0.
+ * Call it before any other function of the module.
+ *
+ */
+void flash_worker_init(void);
+
+/**
+ * @brief Queue the erase of a sector. Waits only if the queue is full.
+ *
+ * @param offset Flash-based address of the sector
+ */
+void flash_worker_erase(uint32_t offset);
+
+/**
+ * @brief Queue the programming of a page. The data is copied, so the buffer can be reused.
+ *
+ * @param offset Flash-based address of the page
+ * @param data FLASH_PAGE_SIZE bytes
+ */
+void flash_worker_program(uint32_t offset, const uint8_t *data);
+
+/**
+ * @brief Wait until every queued operation is done. Call it before reading the flash through XIP.
+ *
+ */
+void flash_worker_wait(void);
+
+/**
+ * @brief Check if the worker has operations in progress.
+ *
+ * @return true if the flash is being erased or programmed
+ */
+bool flash_worker_busy(void);
+
+/**
+ * @brief Record the latency of an interrupt handler, split by the state of the worker.
+ *
+ * @param us
+ */
+void flash_worker_irq_latency(uint32_t us);
+
+/**
+ * @brief Print the statistics of the worker.
+ *
+ */
+void flash_worker_print_stats(void);
+
+#endif // __FLASH_WORKER_
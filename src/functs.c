@@ -11,6 +11,7 @@
  */
 #include <stdint.h>
 #include <stdbool.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include "pico/cyw43_arch.h"
 #include "pico/stdlib.h"
@@ -25,16 +26,27 @@
 #include "keypad_irq.h"
 #include "gpio_led.h"
 #include "nfc_rfid.h"
+#include "nfc_sched.h"
 #include "inventory.h"
+#include "console.h"
+#include "tag_writer.h"
+#include "flash_worker.h"
 #include "liquid_crystal_i2c.h"
 
-// SPI pins
-#define PIN_SCK 10
-#define PIN_MOSI 11
-#define PIN_MISO 12
-#define PIN_CS 13
-#define PIN_IRQ 0
-#define PIN_RST 16
+// Readers: one MFRC522 per dock door. spi0 can not be routed on this board (its MOSI options,
+// GPIO 3, 7 and 19, are the keypad and the LED), so the doors share spi1 with their own CS, IRQ and RST.
+#define DOORS 2
+
+static const struct {
+    spi_inst_t *spi;
+    uint8_t sck, mosi, miso, cs, irq, rst;
+} door_pins[DOORS] = {
+    {spi1, 10, 11, 12, 13, 0, 16}, ///< Door 0
+    {spi1, 10, 11, 12, 17, 1, 22}, ///< Door 1
+};
+
+// Power-fail input (active low), from the supply supervisor
+#define PIN_PWR_FAIL 21
 
 // I2C pins
 #define PIN_SDA 14
@@ -43,20 +55,374 @@
 lcd_t gLcd;
 led_rgb_t gLed;
 key_pad_t gKeyPad;
-nfc_rfid_t gNFC;
+nfc_sched_t gSched;
 inventory_t gInventory;
+console_t gConsole;
+tag_writer_t gWriter;
+
+/**
+ * @brief Session of a dock door: its reader and the boxes read there. The doors process boxes
+ * at the same time, the keypad and the LCD serve the focused one.
+ * @typedef door_t
+ */
+typedef struct {
+    nfc_rfid_t nfc;     ///< Reader of the door (first member: the callbacks get the door from it)
+    tag_t tag;          ///< Box shown, waiting for the transaction type
+    // Batch session of the user: C adds the box and waits for the next scan, A/B confirm, D cancels.
+    // The boxes read together in one pass are added to the batch too.
+    tag_t batch[INVENTORY_BATCH_MAX];
+    uint8_t batch_n;
+    volatile bool done;         ///< Tag read by the pipeline, to be logged by program()
+    volatile bool rejected;     ///< Tag rejected by the pipeline, to be logged by program()
+    volatile bool collision;    ///< Several cards in the field, read by program()
+} door_t;
+
+static door_t gDoors[DOORS];
+static volatile uint8_t focus = 0; ///< Door of the keypad and the LCD
 
 flags_t gFlags; ///< Global variable that stores the flags of the interruptions pending
 
+static uint32_t check_target = 0; ///< Time the check tag alarm was set to
+
+/**
+ * @brief Set the check tag alarm, which starts the read pipeline.
+ * 
+ * @param us Time from now
+ */
+static void check_tag_arm(uint32_t us)
+{
+    check_target = time_us_32() + us;
+    timer_hw->alarm[gSched.timer_irq] = check_target;
+}
+
+/**
+ * @brief Door of a reader.
+ * 
+ * @param nfc 
+ * @return door_t* 
+ */
+static inline door_t *door_of(nfc_rfid_t *nfc)
+{
+    return (door_t *)nfc;
+}
+
+/**
+ * @brief Move the keypad and the LCD to a door, showing its box if a user is waiting.
+ * 
+ * @param i 
+ */
+static void door_focus(uint8_t i)
+{
+    door_t *d = &gDoors[i];
+    focus = i;
+    if (d->nfc.tag.is_present && d->nfc.userType == USER) {
+        gInventory.tag = d->tag; ///< Copy the tag data to the inventory tag
+        gInventory.state = IN__OUT_TRANSACTION; ///< Show the transaction
+    }
+}
+
+/**
+ * @brief Show the box read at a door, if the keypad is not serving another door (main or interrupt context).
+ * 
+ * @param d 
+ */
+static void door_show(door_t *d)
+{
+    uint32_t save = save_and_disable_interrupts(); ///< The pipelines of the other doors report meanwhile
+    uint8_t i = (uint8_t)(d - gDoors);
+    if (i == focus || !gDoors[focus].nfc.tag.is_present) {
+        door_focus(i);
+    }
+    restore_interrupts(save);
+}
+
+/**
+ * @brief Keep the keypad and the LCD on a door with a card waiting: the focused one, else the next one.
+ * 
+ * @param skip Look for another door than the focused one (key F)
+ * @return true if a door with a card waiting is focused
+ */
+static bool door_refocus(bool skip)
+{
+    bool found = false;
+    uint32_t save = save_and_disable_interrupts();
+    for (uint8_t k = skip; k < DOORS && !found; k++) {
+        uint8_t i = (focus + k) % DOORS;
+        if (gDoors[i].nfc.tag.is_present) {
+            door_focus(i);
+            found = true;
+        }
+    }
+    restore_interrupts(save);
+    return found;
+}
+
+/**
+ * @brief End the session of a door, its reader polls again.
+ * 
+ * @param d 
+ */
+static inline void door_end(door_t *d)
+{
+    d->nfc.tag.is_present = false;
+    d->nfc.check = true; ///< Restart the check tag timer
+}
+
+/**
+ * @brief The scheduler can start a read on the reader: no session at its door and no card to write.
+ * 
+ * @param nfc 
+ * @return true 
+ * @return false 
+ */
+static bool door_ready(nfc_rfid_t *nfc)
+{
+    return !tag_writer_pending(&gWriter) && !nfc->tag.is_present && nfc->check;
+}
+
 void initGlobalVariables(void)
 {
+    flash_worker_init(); ///< The journal and the history write the flash through core 1
     lcd_init(&gLcd, 0x20, i2c1, 16, 2, 100, PIN_SDA, PIN_SCL);
     gFlags.W = 0x00U;
     led_init(&gLed, 18);
     kp_init(&gKeyPad, 2, 6, 100000, true);
     // nfc_init_as_i2c(&gNFC, i2c1, 14, 15, 12, 11);
-    nfc_init_as_spi(&gNFC, spi1, PIN_SCK, PIN_MOSI, PIN_MISO, PIN_CS, PIN_IRQ, PIN_RST);
+    nfc_sched_init(&gSched);
+    for (uint8_t i = 0; i < DOORS; i++) {
+        nfc_init_as_spi(&gDoors[i].nfc, door_pins[i].spi, door_pins[i].sck, door_pins[i].mosi, door_pins[i].miso,
+                        door_pins[i].cs, door_pins[i].irq, door_pins[i].rst);
+        nfc_sched_add(&gSched, &gDoors[i].nfc);
+    }
     inventory_init(&gInventory, false);
+    // The SPI clock chosen in a previous boot is only verified, the readers of the bus share it
+    uint32_t rate = nfc_sched_probe(&gSched, gInventory.config[INV_CONFIG_SPI_BAUD]);
+    inventory_set_config(&gInventory, INV_CONFIG_SPI_BAUD, rate);
+    console_init(&gConsole, console_callback);
+    tag_writer_init(&gWriter);
+
+    // Power-fail input: flush the write-back cache before the supply drops
+    gpio_init(PIN_PWR_FAIL);
+    gpio_set_dir(PIN_PWR_FAIL, GPIO_IN);
+    gpio_pull_up(PIN_PWR_FAIL);
+    gpio_set_irq_enabled_with_callback(PIN_PWR_FAIL, GPIO_IRQ_EDGE_FALL, true, gpioCallback);
+}
+
+/**
+ * @brief Add the box shown so far and the entries of a manifest, but the last one, to the batch of the door.
+ * The last entry is shown like a single box, so the whole manifest is applied by one batch. A slot
+ * is kept for the box shown, which joins the batch when it is confirmed.
+ * 
+ * @param nfc 
+ * @param previous The box shown so far joins the batch
+ * @return false if the batch has no room for the boxes and the one shown (nothing is added)
+ */
+static bool batch_manifest(nfc_rfid_t *nfc, bool previous)
+{
+    door_t *d = door_of(nfc);
+    uint8_t entries = nfc->manifest.n ? nfc->manifest.n - 1 : 0;
+    if (d->batch_n + previous + entries + 1 > INVENTORY_BATCH_MAX) {
+        return false;
+    }
+    if (previous) {
+        d->batch[d->batch_n++] = d->tag;
+    }
+    for (uint8_t k = 0; k + 1 < nfc->manifest.n; k++) {
+        d->batch[d->batch_n++] = nfc->manifest.entries[k];
+    }
+    return true;
+}
+
+/**
+ * @brief Print a decoded tag, or the reason of its rejection (main context: nfc_get_data_tag() is silent).
+ * 
+ * @param nfc 
+ * @param valid nfc_get_data_tag() accepted the tag
+ */
+static void print_tag(nfc_rfid_t *nfc, bool valid)
+{
+    if (!valid) {
+        printf("Tag rejected: %s\n", tag_status_name[nfc->codec.last]);
+        return;
+    }
+    printf("ID: %02x\n", nfc->tag.id);
+    if (nfc->userType != USER) {
+        return;
+    }
+    if (nfc->manifest.n) {
+        printf("Manifest: %u entries\n", nfc->manifest.n);
+    }
+    printf("Code: %u\n", nfc->tag.code);
+    printf("Amount: %u\n", nfc->tag.amount);
+    printf("Purchase value: %u\n", nfc->tag.purchase_v);
+    printf("Sale value: %u\n", nfc->tag.sale_v);
+}
+
+/**
+ * @brief Read a card selected by nfc_inventory(): authenticate, read the data block and decode it.
+ * When several boxes are read in the same pass, the previous ones are added to the batch and the
+ * last one is shown, waiting for the transaction type.
+ * 
+ * @param nfc 
+ * @param ctx Number of boxes read in this pass
+ * @return true to look for more cards, false to stop (admin or inventory user card)
+ */
+static bool read_card(nfc_rfid_t *nfc, void *ctx)
+{
+    uint8_t *boxes = (uint8_t *)ctx;
+
+    // Print the serial number of the card
+    printf("\nCard UID: ");
+    for (int i = 0; i < nfc->uid.size; i++) {
+        printf("%02X", nfc->uid.uidByte[i]);
+    }
+    printf("  SAK: %02X  Type: %u\n", nfc->uid.sak, nfc->piccType);
+    uid_entry_t hit;
+    if (nfc_cache_lookup(nfc, &hit)) { ///< Seen recently: no authentication, no read
+        if (nfc->cache.repeat == UID_REPEAT_SKIP) {
+            led_setup(&gLed, 0x03); ///< Blue color: repeat ignored
+            return true;
+        }
+        nfc_cache_apply(nfc, &hit);
+    }else {
+        uint32_t spi_transactions = nfc->spi_stats.transactions;
+        uint32_t spi_bytes = nfc->spi_stats.bytes;
+        uint32_t polls = nfc->cmd.polls;
+        uint32_t wait_us = nfc->cmd.wait_us;
+        nfc->sizeRead = sizeof(nfc->bufferRead);
+        if (nfc_tag_type(nfc) == NFC_TAG_TYPE2) { ///< No authentication, pages 4-7 at once
+            nfc->manifest.auths = 0;
+            if (nfc_fast_read(nfc, NFC_T2_PAGE, NFC_T2_PAGE + 3, nfc->bufferRead, &nfc->sizeRead) != 0) {
+                led_setup(&gLed, 0x04); ///< Red color
+                return true;
+            }
+        }else {
+            // Check if the card is a Mifare Classic card
+            nfc->manifest.auths = 1;
+            if(nfc_authenticate(nfc, PICC_CMD_MF_AUTH_KEY_A, nfc->blockAddr, &nfc->keyByte[0], &(nfc->uid))!=0){
+                led_setup(&gLed, 0x04); ///< Red color
+                return true;
+            }
+            if(nfc_read_card(nfc, nfc->blockAddr, nfc->bufferRead, &nfc->sizeRead)!=0){
+                led_setup(&gLed, 0x04); ///< Red color
+                return true;
+            }
+        }
+        // A manifest lists its entries in the next sectors
+        if (nfc_manifest_count(nfc->bufferRead) && nfc_read_manifest(nfc) != STATUS_OK) {
+            led_setup(&gLed, 0x04); ///< Red color
+            return true;
+        }
+        printf("Block readed (SPI: %u transactions, %u bytes, %u status polls, %u us waiting the chip%s, %u auths)\n\r",
+               nfc->spi_stats.transactions - spi_transactions, nfc->spi_stats.bytes - spi_bytes,
+               nfc->cmd.polls - polls, nfc->cmd.wait_us - wait_us, nfc->cmd.enabled ? " asleep" : " polling",
+               nfc->manifest.auths);
+        for (int i = 0; i < 16; i++) {
+            printf("%02x ", nfc->bufferRead[i]);
+        }
+        printf("\n");
+        // Check if the card is a the card had the correct data
+        tag_t previous = nfc->tag;
+        nfc->tag.is_present = true;
+        bool valid = nfc_get_data_tag(nfc); ///< From the nfc fifo, get the data tag and chet the ID of the tag
+        print_tag(nfc, valid);
+        if (!valid) {
+            nfc->tag = previous;
+            led_setup(&gLed, 0x04); ///< Red colors
+            return true;
+        }
+    }
+    // The box shown so far joins the batch
+    if (nfc->userType == USER && !batch_manifest(nfc, *boxes != 0)) {
+        nfc->tag.is_present = *boxes != 0; ///< The boxes of this pass keep the session
+        led_setup(&gLed, 0x04); ///< Red color: the batch has no room for the boxes
+        return true;
+    }
+    led_setup(&gLed, 0x02); ///<  Green color
+    nfc->check = false; ///< Stop the check of the tag
+    if (nfc->userType != USER) { ///< Admin or inventory user: process it alone
+        door_show(door_of(nfc));
+        return false;
+    }
+    (*boxes)++;
+    door_of(nfc)->tag = nfc->tag;
+    door_show(door_of(nfc)); ///< Show the transaction
+    return true;
+}
+
+/**
+ * @brief Write the next queued payload to a card selected by nfc_inventory().
+ * 
+ * @param nfc 
+ * @param ctx tag_writer_t structure
+ * @return true to look for more cards while there are payloads
+ */
+static bool write_card(nfc_rfid_t *nfc, void *ctx)
+{
+    tag_writer_t *w = (tag_writer_t *)ctx;
+    uint8_t status = tag_writer_write(w, nfc);
+    if (status == STATUS_OK) {
+        printf("Tag written, %u left\n", w->count);
+        led_setup(&gLed, 0x02); ///< Green color
+        nfc_poll_activity(nfc); ///< The next card comes soon
+    }else if (status != STATUS_INVALID) { ///< The last card written is ignored
+        led_setup(&gLed, 0x04); ///< Red color
+    }
+    return tag_writer_pending(w);
+}
+
+/**
+ * @brief Report of the read pipeline (interrupt context): decode the tag and show the transaction
+ * of a box. Several cards in the field are left to nfc_inventory() in program().
+ * 
+ * @param nfc 
+ * @param status 
+ */
+static void pipe_done(nfc_rfid_t *nfc, uint8_t status)
+{
+    if (status == STATUS_TIMEOUT) { ///< Empty field
+        return;
+    }
+    if (status == STATUS_COLLISION) {
+        nfc->pipe.host = true; ///< No pipeline until the inventory loop ends
+        door_of(nfc)->collision = true;
+        gFlags.B.nfc_tag = 1;
+        return;
+    }
+    if (status != STATUS_OK) {
+        led_setup(&gLed, 0x04); ///< Red color
+        return;
+    }
+    if (nfc->pipe.cached) { ///< Seen recently: the block was not read
+        if (nfc->cache.repeat == UID_REPEAT_SKIP) {
+            led_setup(&gLed, 0x03); ///< Blue color: repeat ignored
+            return;
+        }
+        nfc_cache_apply(nfc, &nfc->pipe.hit);
+    }else {
+        tag_t previous = nfc->tag;
+        nfc->tag.is_present = true;
+        if (!nfc_get_data_tag(nfc)) {
+            nfc->tag = previous;
+            led_setup(&gLed, 0x04); ///< Red color
+            door_of(nfc)->rejected = true;
+            gFlags.B.nfc_done = 1; ///< Logged by program()
+            return;
+        }
+    }
+    if (nfc->userType == USER && !batch_manifest(nfc, false)) {
+        nfc->tag.is_present = false; ///< No session: the reader keeps polling
+        led_setup(&gLed, 0x04); ///< Red color: the batch has no room for the manifest
+        return;
+    }
+    led_setup(&gLed, 0x02); ///<  Green color
+    nfc->check = false; ///< Stop the check of the tag
+    if (nfc->userType == USER) {
+        door_of(nfc)->tag = nfc->tag;
+    }
+    door_show(door_of(nfc)); ///< Show the transaction, or wait for the keypad
+    door_of(nfc)->done = true;
+    gFlags.B.nfc_done = 1; ///< Logged by program()
 }
 
 void program(void)
@@ -66,19 +432,24 @@ void program(void)
         gFlags.B.key = 0;
 
         uint8_t key = gKeyPad.KEY.dkey;
-        printf("Key: %d\n", key);
+        door_t *d = &gDoors[focus]; ///< Door served by the keypad
+        printf("Key: %d (door %u)\n", key, focus);
+        nfc_poll_activity(&d->nfc); ///< Someone is at the dock: poll fast
         static uint32_t in_value = 0;
         static uint8_t in_cont = 0;
 
         // State machine of the admin
         // The admin password is 1234 (4 digits) at the beginning
         static enum {adminNONE, PASS} in_state_admin = adminNONE;
+        static enum {queryNONE, QUERY} query_state = queryNONE; ///< History query: A, code, F
+        static uint32_t query_code = 0;
 
         // State machine of the inventory management
         static enum {inNONE, AMOUNT, PURCHASE, SALE} in_state_inv = inNONE;
-        static enum {idNONE, ID1, ID2, ID3, ID4, ID5} id_state_inv = idNONE;
+        static enum {codeNONE, CODE, codeDONE} code_state_inv = codeNONE;
+        static uint32_t in_code = 0; ///< Product code being entered
 
-        switch (gNFC.userType)
+        switch (d->nfc.userType)
         {
         case ADMIN: ///< Admin is entering
             if (checkNumber(key) && in_state_admin == adminNONE){
@@ -87,13 +458,13 @@ void program(void)
                 if (in_cont == 4){
                     if (in_value == 1234){
                         in_state_admin = PASS;
+                        history_set_operator(&gInventory.history, d->nfc.uid.uidByte, d->nfc.uid.size); ///< The admin card is the operator
                         printf("Correct password\n");
                         // Led control
                         led_setup(&gLed, 0x05); ///< Purple color
                     }else {
                         printf("Incorrect password\n");
-                        gNFC.tag.is_present = false;
-                        gNFC.check = true; ///< Restart the check tag timer
+                        door_end(d);
                         in_state_admin = adminNONE;
                         in_value = 0;
                         in_cont = 0;
@@ -102,6 +473,22 @@ void program(void)
                     }
                 }
             }
+            ///< History query of a product: A, code of the product, F
+            else if (key == 0x0A && in_state_admin == PASS) {
+                query_state = QUERY;
+                query_code = 0;
+            }
+            else if (checkNumber(key) && query_state == QUERY && query_code*10 + key <= 0xFFFF) {
+                query_code = query_code*10 + key;
+            }
+            else if (key == 0x0F && query_state == QUERY) {
+                gInventory.query.code = query_code;
+                gInventory.query.result = history_query(&gInventory.history, query_code, 0, 0xFFFFFFFFU, NULL, NULL);
+                gInventory.state = HISTORY; ///< Show the result on the LCD
+                query_state = queryNONE;
+                // Led control
+                led_setup(&gLed, 0x02); ///< Green color
+            }
             ///< Reset the inventory database
             else if (key == 0x0E && in_state_admin == PASS) {
                 inventory_reset(&gInventory);
@@ -111,9 +498,11 @@ void program(void)
             ///< Finish the process
             else if (key == 0x0D){
                 printf("Finished Admin process\n");
-                gNFC.tag.is_present = false;
-                gNFC.check = true; ///< Restart the check tag timer
+                inventory_flush(&gInventory); ///< Persist the pending changes
+                door_end(d);
                 in_state_admin = adminNONE;
+                query_state = queryNONE;
+                gInventory.state = DATA_BASE;
                 in_value = 0;
                 in_cont = 0;
                 // Led control
@@ -145,50 +534,55 @@ void program(void)
                     break;
                 }
             }
-            ///< Select the ID of the product
-            else if (checkNumber(key) && in_state_inv != inNONE && id_state_inv == idNONE){
-                if (key >= 0x01 && key <=0x05) {
-                    gNFC.tag.id = key;
-                    id_state_inv = key;
-                }else {
-                    printf("Invalid ID\n");
+            ///< Enter the code of the product, confirmed with F
+            else if (checkNumber(key) && in_state_inv != inNONE && code_state_inv != codeDONE){
+                in_code = in_code*10 + key;
+                code_state_inv = CODE;
+                if (in_code > 0xFFFF) {
+                    printf("Invalid code\n");
                     in_state_inv = inNONE; ///< Reset the state machine
+                    code_state_inv = codeNONE;
+                    in_code = 0;
                     // Led control
                     led_setup(&gLed, 0x04); ///< Red color
                 }
             }
+            else if (key == 0x0F && in_state_inv != inNONE && code_state_inv == CODE && in_code){
+                code_state_inv = codeDONE;
+            }
             ///< Enter the value of the data
-            else if (checkNumber(key) && in_state_inv != inNONE && id_state_inv != idNONE){
+            else if (checkNumber(key) && in_state_inv != inNONE && code_state_inv == codeDONE){
                 in_value = in_value*10 + key;
             }
-            ///< Update the database
-            else if (key == 0x0D && in_state_inv != inNONE && id_state_inv != idNONE){
-                printf("Updating database   value: %u    id: %u   type: %u\n", in_value, id_state_inv, in_state_inv);
+            ///< Update the catalog
+            else if (key == 0x0D && in_state_inv != inNONE && code_state_inv == codeDONE){
+                printf("Updating catalog   value: %u    code: %u   type: %u\n", in_value, in_code, in_state_inv);
+                bool updated = false;
                 switch (in_state_inv)
                 {
                 case AMOUNT:
-                    gInventory.database[id_state_inv - 1][0] = in_value;
+                    updated = inventory_set_field(&gInventory, in_code, 0, in_value);
                     break;
                 case PURCHASE:
-                    gInventory.database[id_state_inv - 1][1] = in_value;
+                    updated = inventory_set_field(&gInventory, in_code, 1, in_value);
                     break;
                 case SALE:
-                    gInventory.database[id_state_inv - 1][2] = in_value;
+                    updated = inventory_set_field(&gInventory, in_code, 2, in_value);
                     break;
                 default:
                     break;
                 }
-                inventory_store(&gInventory);
                 in_state_inv = inNONE; // Reset the state machine
-                id_state_inv = idNONE;
+                code_state_inv = codeNONE;
+                in_code = 0;
                 in_value = 0;
                 // Led control
-                led_setup(&gLed, 0x02); ///<  Green color
+                led_setup(&gLed, updated ? 0x02 : 0x04); ///<  Green color, red if the catalog is full
             }
             // Finish the process
-            else if (key == 0x0D && in_state_inv == inNONE && id_state_inv == idNONE) {
-                gNFC.tag.is_present = false;
-                gNFC.check = true; ///< Restart the check tag timer
+            else if (key == 0x0D && in_state_inv == inNONE && code_state_inv == codeNONE) {
+                inventory_flush(&gInventory); ///< Persist the pending changes
+                door_end(d);
                 printf("Finished Inv User\n");
                 // Led control
                 led_setup(&gLed, 0x06); ///< Yellow color
@@ -196,7 +590,8 @@ void program(void)
             else {
                 printf("Invalid key - INV\n");
                 in_state_inv = inNONE; ///< Reset the state machine
-                id_state_inv = idNONE;
+                code_state_inv = codeNONE;
+                in_code = 0;
                 in_value = 0;
                 // Led control
                 led_setup(&gLed, 0x04); ///< Red color
@@ -204,31 +599,68 @@ void program(void)
             break;
 
         case USER: ///< User is entering
-            ///< Input transaction
-            if (key == 0x0A) {
-                inventory_in_transaction(&gInventory);
-                    
-                gNFC.tag.is_present = false;
-                gNFC.check = true; ///< Restart the check tag timer
-                printf("Finished User\n");
+            ///< Add the box to the batch session and wait for the next scan
+            if (key == 0x0C) {
+                if (d->batch_n + 1 < INVENTORY_BATCH_MAX) { ///< The last slot is kept for the box confirmed with A/B
+                    d->batch[d->batch_n++] = d->tag;
+                    printf("Batch: %u boxes\n", d->batch_n);
+                    // Led control
+                    led_setup(&gLed, 0x03); ///< Blue color
+                    door_end(d);
+                }else { ///< Batch full: the box stays shown, confirm the batch with it
+                    printf("Batch full: %u boxes, confirm with A/B\n", d->batch_n);
+                    // Led control
+                    led_setup(&gLed, 0x04); ///< Red color
+                }
+            }
+            ///< Input or output transaction, of the batch session if there is one
+            else if ((key == 0x0A || key == 0x0B) && d->batch_n >= INVENTORY_BATCH_MAX) {
+                printf("Batch full: the box shown can not join it\n"); ///< The session stays open
                 // Led control
-                led_setup(&gLed, 0x06); ///< Yellow color
-                gInventory.state = DATA_BASE; ///< Now that user go out, Show the data base on LCD
+                led_setup(&gLed, 0x04); ///< Red color
             }
-            ///< Output transaction
-            else if (key == 0x0B) {
-                if (inventory_out_transaction(&gInventory)) { ///< Transaction success
+            else if (key == 0x0A || key == 0x0B) {
+                bool done;
+                gInventory.tag = d->tag; ///< The box of the door being served
+                if (d->batch_n) {
+                    d->batch[d->batch_n++] = d->tag; ///< The box being shown is the last one
+                    done = inventory_apply_batch(&gInventory, d->batch, d->batch_n, key == 0x0B);
+                    printf("Batch of %u boxes %s\n", d->batch_n, done ? "applied" : "rejected");
+                    d->batch_n = 0;
+                }else if (key == 0x0A) {
+                    done = inventory_in_transaction(&gInventory);
+                }else {
+                    done = inventory_out_transaction(&gInventory);
+                }
+                if (done) { ///< Transaction success
                     // Led control
                     led_setup(&gLed, 0x06); ///< Yellow color
-                }else { ///< Transaction failed
+                }else { ///< Catalog full or not enough stock
                     // Led control
                     led_setup(&gLed, 0x04); ///< Red color
                 }
-                gNFC.tag.is_present = false;
-                gNFC.check = true; ///< Restart the check tag timer
+                door_end(d);
                 printf("Finished User\n");
                 gInventory.state = DATA_BASE; ///< Now that user go out, Show the data base on LCD
             }
+            ///< Cancel the batch session
+            else if (key == 0x0D) {
+                printf("Batch of %u boxes cancelled\n", d->batch_n);
+                d->batch_n = 0;
+                door_end(d);
+                gInventory.state = DATA_BASE;
+                // Led control
+                led_setup(&gLed, 0x06); ///< Yellow color
+            }
+            ///< Serve the box waiting at another door
+            else if (key == 0x0F) {
+                if (door_refocus(true)) {
+                    printf("Keypad on door %u\n", focus);
+                }else {
+                    // Led control
+                    led_setup(&gLed, 0x04); ///< Red color: no box at the other doors
+                }
+            }
             else {
                 printf("Invalid key - USER\n");
                 // Led control
@@ -239,44 +671,63 @@ void program(void)
         default:
             break;
         }
+        if (!d->nfc.tag.is_present && door_refocus(false)) { ///< Session ended: the next door waiting
+            printf("Keypad on door %u\n", focus);
+        }
+    }
+    ///< NFC pipeline flags
+    if (gFlags.B.nfc_done) {
+        gFlags.B.nfc_done = 0; ///< Clear the flag
+        for (uint8_t k = 0; k < DOORS; k++) {
+            door_t *d = &gDoors[k];
+            if (d->rejected) {
+                d->rejected = false;
+                printf("\nDoor %u: ", k);
+                print_tag(&d->nfc, false);
+            }
+            if (!d->done) {
+                continue;
+            }
+            d->done = false;
+            printf("\nDoor %u card UID: ", k);
+            for (int i = 0; i < d->nfc.uid.size; i++) {
+                printf("%02X", d->nfc.uid.uidByte[i]);
+            }
+            printf("  SAK: %02X  Type: %u  read in %u us%s, %u auths, decoded in %u us\n", d->nfc.uid.sak, d->nfc.piccType,
+                   d->nfc.pipe.last_us, d->nfc.pipe.cached ? " (cached)" : "", d->nfc.manifest.auths, d->nfc.manifest.decode_us);
+            print_tag(&d->nfc, true);
+            if (d->nfc.manifest.n) {
+                printf("Batch: %u boxes\n", d->batch_n);
+            }
+        }
     }
-    ///< NFC interrupt flags
+    ///< NFC interrupt flags: several cards in the field
     if (gFlags.B.nfc_tag) {
         gFlags.B.nfc_tag = 0; ///< Clear the flag
-        nfc_read_card_serial(&gNFC); ///< Read the serial number of the card
-        // Print the serial number of the card
-        printf("\nCard UID: ");
-        for (int i = 0; i < gNFC.uid.size; i++) {
-            printf("%02X", gNFC.uid.uidByte[i]);
+        for (uint8_t k = 0; k < DOORS; k++) {
+            door_t *d = &gDoors[k];
+            if (!d->collision) {
+                continue;
+            }
+            d->collision = false;
+            nfc_sched_claim(&gSched, &d->nfc); ///< No pipeline on the bus, the halt of a previous read ends
+            uint8_t boxes = 0; ///< Boxes read in this pass
+            uint8_t cards = nfc_inventory(&d->nfc, read_card, &boxes); ///< Read every card in the field
+            printf("Door %u: %u cards, %u boxes\n", k, cards, boxes);
+            nfc_sched_release(&gSched, &d->nfc);
         }
-        printf("\n");
-        // Check if the card is a Mifare Classic card
-        if(nfc_authenticate(&gNFC, PICC_CMD_MF_AUTH_KEY_A, gNFC.blockAddr, &gNFC.keyByte[0], &(gNFC.uid))==0){
-            if(nfc_read_card(&gNFC, gNFC.blockAddr, gNFC.bufferRead, &gNFC.sizeRead)==0){
-                gNFC.tag.is_present = true;
-                printf("Block readed\n\r");
-                for (int i = 0; i < 16; i++) {
-                    printf("%02x ", gNFC.bufferRead[i]);
-                }
-                printf("\n");
-                nfc_stop_crypto1(&gNFC);
-                // Check if the card is a the card had the correct data
-                if(nfc_get_data_tag(&gNFC)) {///< From the nfc fifo, get the data tag and chet the ID of the tag
-                    led_setup(&gLed, 0x02); ///<  Green color
-                    gNFC.check = false; ///< Stop the check of the tag
-                    // Congiguring the gInventory to show correctlly the data
-                    if (gNFC.tag.id >= 0x01 && gNFC.tag.id <= 0x05){
-                        gInventory.tag = gNFC.tag; ///< Copy the tag data to the inventory tag
-                        gInventory.state = IN__OUT_TRANSACTION; ///< Show the transaction
-                    }
-                }else {
-                    led_setup(&gLed, 0x04); ///< Red colors
-                }
-            }else{
-                led_setup(&gLed, 0x04); ///< Red color
+    }
+
+    ///< NFC writer mode flags: write the queued payloads to the cards presented
+    if (gFlags.B.nfc_write) {
+        gFlags.B.nfc_write = 0; ///< Clear the flag
+        for (uint8_t k = 0; k < DOORS && tag_writer_pending(&gWriter); k++) {
+            nfc_rfid_t *nfc = &gDoors[k].nfc;
+            nfc_sched_claim(&gSched, nfc); ///< No pipeline on the bus while the cards are written
+            if (nfc_is_new_tag(nfc)) {
+                nfc_inventory(nfc, write_card, &gWriter); ///< Every card in the field
             }
-        }else {
-            led_setup(&gLed, 0x04); ///< Red color
+            nfc_sched_release(&gSched, nfc);
         }
     }
 
@@ -288,6 +739,18 @@ void program(void)
         pwm_set_enabled(gKeyPad.pwm_slice, true); ///< Set the debouncer alarm
         gFlags.B.kpad_switch = 0;
     }
+    ///< Inventory flush interrupt flags
+    if (gFlags.B.inv_flush){
+        gFlags.B.inv_flush = 0; ///< Clear the flag
+        inventory_flush(&gInventory); ///< Persist the write-back cache
+    }
+    ///< Console interrupt flags
+    if (gFlags.B.console){
+        gFlags.B.console = 0; ///< Clear the flag
+        while (console_read_line(&gConsole)) {
+            console_execute(&gConsole, &gInventory, &gSched, &gWriter);
+        }
+    }
     ///< Inventory show interrupt flags
     if (gFlags.B.inv_show){
         gFlags.B.inv_show = 0; ///< Clear the flag
@@ -308,7 +771,7 @@ void gpioCallback(uint num, uint32_t mask)
     switch (mask)
     {
     case GPIO_IRQ_EDGE_RISE:
-        if (gNFC.tag.is_present && !gKeyPad.KEY.dbnc){
+        if (gDoors[focus].nfc.tag.is_present && !gKeyPad.KEY.dbnc){
             kp_set_irq_enabled(&gKeyPad, true, false); ///< Disable the columns interrupt
             gKeyPad.KEY.dbnc = 1; ///< Activate the debouncer
             gFlags.B.kpad_switch = 1; ///< Activate the flag to switch the interrupt to columns
@@ -317,6 +780,19 @@ void gpioCallback(uint num, uint32_t mask)
             printf("There is no a tag entering - RISE\n");
         }
         break;
+
+    case GPIO_IRQ_EDGE_FALL:
+        if (num == PIN_PWR_FAIL){
+            gFlags.B.inv_flush = 1; ///< Power is failing, flush the write-back cache
+        }
+        else {
+            nfc_rfid_t *nfc = nfc_sched_by_irq(&gSched, num);
+            if (nfc) {
+                nfc_irq(nfc); ///< The MFRC522 completed a command
+                nfc_pipe_step(nfc); ///< Next stage of the read, if any
+            }
+        }
+        break;
     
     default:
         printf("Happend what should not happens on GPIO CALLBACK\n");
@@ -326,6 +802,11 @@ void gpioCallback(uint num, uint32_t mask)
     gpio_acknowledge_irq(num, mask); ///< gpio IRQ acknowledge
 }
 
+void console_callback(void *param)
+{
+    gFlags.B.console = 1; ///< The characters are read in program()
+}
+
 void led_timer_handler(void)
 {
     // Set the alarm
@@ -341,17 +822,33 @@ void led_timer_handler(void)
 
 void check_tag_timer_handler(void)
 {
+    static uint32_t tick = 0; ///< Time of the last housekeeping (1 s)
+    if (check_target) {
+        flash_worker_irq_latency(time_us_32() - check_target); ///< Latency of this handler, with and without flash operations
+    }
+
     // Set the alarm
-    hw_clear_bits(&timer_hw->intr, 1u << gNFC.timer_irq);
+    hw_clear_bits(&timer_hw->intr, 1u << gSched.timer_irq);
     // Setting the IRQ handler
-    irq_set_exclusive_handler(gNFC.timer_irq, check_tag_timer_handler);
-    irq_set_enabled(gNFC.timer_irq, true);
-    hw_set_bits(&timer_hw->inte, 1u << gNFC.timer_irq); ///< Enable alarm1 for keypad debouncer
-    timer_hw->alarm[gNFC.timer_irq] = (uint32_t)(time_us_64() + gNFC.timeCheck); ///< Set alarm1 to trigger in 1s
+    irq_set_exclusive_handler(gSched.timer_irq, check_tag_timer_handler);
+    irq_set_enabled(gSched.timer_irq, true);
+    hw_set_bits(&timer_hw->inte, 1u << gSched.timer_irq); ///< Enable alarm1 for keypad debouncer
+
+    if (tag_writer_pending(&gWriter)){
+        gFlags.B.nfc_write = 1; ///< Writer mode: the cards are written by program()
+    }
+    // Check for a tag entering at each door: the pipelines run from the completion interrupts of the chips
+    check_tag_arm(nfc_sched_run(&gSched, door_ready, pipe_done)); ///< Next due poll, intervals adapted by the last ones
+
+    uint32_t now = time_us_32();
+    if (now - tick < 1000000) {
+        return;
+    }
+    tick = now;
 
-    // Check for a tag entering
-    if (!gNFC.tag.is_present && nfc_is_new_tag(&gNFC) && gNFC.check){
-        gFlags.B.nfc_tag = 1; ///< Activate the flag of the NFC interruption to read the card
+    // Flush the write-back cache after the idle timeout
+    if (inventory_flush_due(&gInventory)){
+        gFlags.B.inv_flush = 1;
     }
 
     // Show the inventory every 3 seconds
@@ -364,8 +861,9 @@ void check_tag_timer_handler(void)
 
 void show_inventory(void)
 {
-    uint8_t str_0[16]; ///< Line 0 of the LCD
-    uint8_t str_1[16]; ///< Line 1 of the LCD
+    uint8_t str_0[17]; ///< Line 0 of the LCD
+    uint8_t str_1[17]; ///< Line 1 of the LCD
+    product_t *p = NULL;
     
     lcd_send_str_cursor(&gLcd, "                ", 0, 0);
     lcd_send_str_cursor(&gLcd, "                ", 1, 0);
@@ -373,38 +871,38 @@ void show_inventory(void)
     switch (gInventory.state)
     {
     case DATA_BASE:
-        switch (gInventory.count.id)
-        {
-        case 5: ///< Show the today transactions
+        if (gInventory.count.slot < CATALOG_SIZE && gInventory.catalog.products[gInventory.count.slot].code) {
+            p = &gInventory.catalog.products[gInventory.count.slot];
+        }
+        if (!p) { ///< Show the value of the goods and the sales (running aggregates, no rescan)
             if (!gInventory.count.frame) {
-                sprintf((char *)str_1, "AMNT: %u", gInventory.today.amount);
-                lcd_send_str_cursor(&gLcd, "TodayTransactions", 0, 0);
+                snprintf((char *)str_0, sizeof(str_0), "GOODS: %" PRIu64, gInventory.totals.purchase_value);
+                snprintf((char *)str_1, sizeof(str_1), "SALES: %" PRIu64, gInventory.totals.sales);
+                lcd_send_str_cursor(&gLcd, str_0, 0, 0);
                 lcd_send_str_cursor(&gLcd, str_1, 1, 0);
             }else {
-                sprintf((char *)str_0, "PRCH: %u", gInventory.today.purchases);
-                sprintf((char *)str_1, "SAL: %u", gInventory.today.sales);
+                snprintf((char *)str_0, sizeof(str_0), "RETAIL: %" PRIu64, gInventory.totals.sale_value);
+                snprintf((char *)str_1, sizeof(str_1), "TODAY: %u", gInventory.today.amount);
                 lcd_send_str_cursor(&gLcd, str_0, 0, 0);
                 lcd_send_str_cursor(&gLcd, str_1, 1, 0);
             }
-            break;
-        default: ///< Show the data base
+        }else { ///< Show the catalog
             if (!gInventory.count.frame) {
-                sprintf((char *)str_0, "Inventory  ID: %u", gInventory.count.id + 1);
-                sprintf((char *)str_1, "AMNT: %u", gInventory.database[gInventory.count.id][0]);
+                sprintf((char *)str_0, "Product: %u", p->code);
+                sprintf((char *)str_1, "AMNT: %u", p->amount);
                 lcd_send_str_cursor(&gLcd, str_0, 0, 0);
                 lcd_send_str_cursor(&gLcd, str_1, 1, 0);
             }else {
-                sprintf((char *)str_0, "PRCH: %u", gInventory.database[gInventory.count.id][1]);
-                sprintf((char *)str_1, "SAL: %u", gInventory.database[gInventory.count.id][2]);
+                sprintf((char *)str_0, "PRCH: %u", p->purchase_v);
+                sprintf((char *)str_1, "SAL: %u", p->sale_v);
                 lcd_send_str_cursor(&gLcd, str_0, 0, 0);
                 lcd_send_str_cursor(&gLcd, str_1, 1, 0);
             }
-            break;
         }
         break;
     case IN__OUT_TRANSACTION:
         if (!gInventory.count.frame) { ///< First frame
-            sprintf((char *)str_0, "TagData  ID: %u", gInventory.tag.id);
+            sprintf((char *)str_0, "TagData: %u", gInventory.tag.code);
             sprintf((char *)str_1, "AMNT: %u", gInventory.tag.amount);
             lcd_send_str_cursor(&gLcd, str_0, 0, 0);
             lcd_send_str_cursor(&gLcd, str_1, 1, 0);
@@ -415,12 +913,27 @@ void show_inventory(void)
             lcd_send_str_cursor(&gLcd, str_1, 1, 0);
         }
         break;
+    case HISTORY:
+        if (!gInventory.count.frame) { ///< First frame
+            snprintf((char *)str_0, sizeof(str_0), "Hist: %u", gInventory.query.code);
+            snprintf((char *)str_1, sizeof(str_1), "MOVES: %u", gInventory.query.result.moves);
+        }else {
+            snprintf((char *)str_0, sizeof(str_0), "NET: %" PRId64, gInventory.query.result.net);
+            snprintf((char *)str_1, sizeof(str_1), "SALES: %" PRIu64, gInventory.query.result.sales);
+        }
+        lcd_send_str_cursor(&gLcd, str_0, 0, 0);
+        lcd_send_str_cursor(&gLcd, str_1, 1, 0);
+        break;
     default:
         break;
     }
     gInventory.count.frame += 1;
-    if (!gInventory.count.frame){
-        gInventory.count.id = (gInventory.count.id + 1) % 6;
+    if (!gInventory.count.frame){ ///< Next product, the totals after the last one
+        if (gInventory.count.slot >= CATALOG_SIZE) {
+            gInventory.count.slot = catalog_next(&gInventory.catalog, 0);
+        }else {
+            gInventory.count.slot = catalog_next(&gInventory.catalog, gInventory.count.slot + 1);
+        }
     }
 }
 
@@ -24,7 +24,10 @@ typedef union{
         uint8_t nfc_tag     :1; //tag interruption pending
         uint8_t kpad_switch :1; //keypad switch interruption pending
         uint8_t inv_show    :1; //inventory show interruption pending
-        uint8_t             :4;
+        uint8_t inv_flush   :1; //inventory write-back flush pending (idle timeout or power fail)
+        uint8_t console     :1; //console characters available
+        uint8_t nfc_done    :1; //tag read by the NFC pipeline, to be logged
+        uint8_t nfc_write   :1; //writer mode poll: write the next card presented
     }B;
 }flags_t;
 
@@ -66,6 +69,13 @@ void show_inventory(void);
  */
 void gpioCallback(uint num, uint32_t mask);
 
+/**
+ * @brief Callback of the stdio driver when there are characters available in the console.
+ * 
+ * @param param 
+ */
+void console_callback(void *param);
+
 /**
  * @brief Handler for the led timer interruptions.
  * 
@@ -101,7 +111,7 @@ void pwm_handler(void);
 // -------------------------------------------------------------
 
 static inline bool checkNumber(uint8_t number){
-    return (number >= 0 && number <= 9);
+    return number <= 9;
 }
 
 static inline bool checkLetter(uint8_t letter){
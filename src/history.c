@@ -0,0 +1,546 @@
+/**
+ * \file        history.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/time.h"
+#include "hardware/flash.h"
+
+#include "history.h"
+#include "flash_worker.h"
+
+_Static_assert(sizeof(history_index_t) == FLASH_PAGE_SIZE, "The index of a sector fills its first page");
+
+/**
+ * @brief Memory-mapped address of the index page of a sector.
+ *
+ * @param sector
+ * @return const history_index_t*
+ */
+static inline const history_index_t *history_index_at(uint8_t sector)
+{
+    return (const history_index_t *)(XIP_BASE + HISTORY_OFFSET + sector*FLASH_SECTOR_SIZE);
+}
+
+/**
+ * @brief Memory-mapped address of a data page.
+ *
+ * @param sector
+ * @param page Data page inside the sector
+ * @return const uint8_t*
+ */
+static inline const uint8_t *history_page_at(uint8_t sector, uint8_t page)
+{
+    return (const uint8_t *)(XIP_BASE + HISTORY_OFFSET + sector*FLASH_SECTOR_SIZE + (1 + page)*FLASH_PAGE_SIZE);
+}
+
+static inline bool history_index_is_valid(const history_index_t *idx)
+{
+    return idx->magic == HISTORY_MAGIC && idx->version == HISTORY_VERSION &&
+           idx->crc == journal_crc32((const uint8_t *)idx, 12);
+}
+
+/**
+ * @brief Bit of the product bitmap of a page.
+ *
+ * @param code
+ * @return uint8_t
+ */
+static inline uint8_t history_bit(uint16_t code)
+{
+    return code % HISTORY_BITMAP_BITS;
+}
+
+/**
+ * @brief Flags of an encoded record. A flags byte with other bits set (0xFF: erased) ends the block.
+ *
+ */
+enum {
+    HF_PURCHASE = 0x01, ///< The purchase value follows
+    HF_SALE     = 0x02, ///< The sale value follows
+    HF_UID      = 0x04, ///< The operator UID follows
+    HF_MASK     = 0x07
+};
+
+static uint8_t history_put_varint(uint8_t *out, uint32_t v)
+{
+    uint8_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+/**
+ * @brief Read a varint.
+ *
+ * @param in
+ * @param end End of the block
+ * @param v
+ * @return uint8_t Bytes read, 0 if the varint is not valid
+ */
+static uint8_t history_get_varint(const uint8_t *in, const uint8_t *end, uint32_t *v)
+{
+    *v = 0;
+    for (uint8_t n = 0; n < 5 && in + n < end; n++) {
+        *v |= (uint32_t)(in[n] & 0x7F) << (7*n);
+        if (!(in[n] & 0x80)) {
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+static void history_block_start(history_block_t *b, uint32_t time)
+{
+    b->time = time;
+    b->uid_size = 0;
+    b->codes = 0;
+}
+
+static int8_t history_block_find(const history_block_t *b, uint16_t code)
+{
+    for (uint8_t i = 0; i < b->codes; i++) {
+        if (b->prices[i].code == code) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Update the state of a block with a record. The encoder and the decoder follow the same steps.
+ *
+ * @param b
+ * @param rec
+ */
+static void history_block_update(history_block_t *b, const history_rec_t *rec)
+{
+    int8_t i = history_block_find(b, rec->code);
+    if (i < 0 && b->codes < HISTORY_BLOCK_CODES) {
+        i = b->codes++;
+        b->prices[i].code = rec->code;
+    }
+    if (i >= 0) {
+        b->prices[i].purchase_v = rec->purchase_v;
+        b->prices[i].sale_v = rec->sale_v;
+    }
+    b->time = rec->time;
+    b->uid_size = rec->uid_size;
+    memcpy(b->uid, rec->uid, rec->uid_size);
+}
+
+/**
+ * @brief Encode a record relative to the state of its block (the state is not modified).
+ *
+ * @param b
+ * @param rec
+ * @param out At least HISTORY_REC_MAX bytes
+ * @return uint8_t Bytes of the encoded record
+ */
+static uint8_t history_encode(const history_block_t *b, const history_rec_t *rec, uint8_t *out)
+{
+    int8_t i = history_block_find(b, rec->code);
+    uint8_t flags = 0;
+    if (i < 0 || b->prices[i].purchase_v != rec->purchase_v) {
+        flags |= HF_PURCHASE;
+    }
+    if (i < 0 || b->prices[i].sale_v != rec->sale_v) {
+        flags |= HF_SALE;
+    }
+    if (rec->uid_size != b->uid_size || memcmp(rec->uid, b->uid, rec->uid_size)) {
+        flags |= HF_UID;
+    }
+
+    uint8_t n = 0;
+    out[n++] = flags;
+    n += history_put_varint(&out[n], rec->time - b->time);
+    n += history_put_varint(&out[n], rec->code);
+    n += history_put_varint(&out[n], ((uint32_t)rec->delta << 1) ^ (uint32_t)(rec->delta >> 31)); ///< Zig-zag
+    if (flags & HF_PURCHASE) {
+        n += history_put_varint(&out[n], rec->purchase_v);
+    }
+    if (flags & HF_SALE) {
+        n += history_put_varint(&out[n], rec->sale_v);
+    }
+    if (flags & HF_UID) {
+        out[n++] = rec->uid_size;
+        memcpy(&out[n], rec->uid, rec->uid_size);
+        n += rec->uid_size;
+    }
+    out[n] = (uint8_t)journal_crc32(out, n);
+    return n + 1;
+}
+
+/**
+ * @brief Decode the next record of a block and update the state of the block.
+ *
+ * @param b
+ * @param in
+ * @param end End of the block
+ * @param rec
+ * @return uint8_t Bytes of the record, 0 at the end of the block or if the record is not valid
+ */
+static uint8_t history_decode(history_block_t *b, const uint8_t *in, const uint8_t *end, history_rec_t *rec)
+{
+    const uint8_t *p = in;
+    uint32_t v;
+    uint8_t len;
+
+    if (p >= end || (*p & ~HF_MASK)) {
+        return 0;
+    }
+    uint8_t flags = *p++;
+    if (!(len = history_get_varint(p, end, &v))) {
+        return 0;
+    }
+    p += len;
+    rec->time = b->time + v;
+    if (!(len = history_get_varint(p, end, &v)) || v > 0xFFFF) {
+        return 0;
+    }
+    p += len;
+    rec->code = (uint16_t)v;
+    if (!(len = history_get_varint(p, end, &v))) {
+        return 0;
+    }
+    p += len;
+    rec->delta = (int32_t)((v >> 1) ^ -(v & 1));
+
+    int8_t i = history_block_find(b, rec->code);
+    if (i < 0 && (flags & (HF_PURCHASE | HF_SALE)) != (HF_PURCHASE | HF_SALE)) { ///< Nothing to reference
+        return 0;
+    }
+    if (flags & HF_PURCHASE) {
+        if (!(len = history_get_varint(p, end, &v))) {
+            return 0;
+        }
+        p += len;
+        rec->purchase_v = v;
+    }else {
+        rec->purchase_v = b->prices[i].purchase_v;
+    }
+    if (flags & HF_SALE) {
+        if (!(len = history_get_varint(p, end, &v))) {
+            return 0;
+        }
+        p += len;
+        rec->sale_v = v;
+    }else {
+        rec->sale_v = b->prices[i].sale_v;
+    }
+    if (flags & HF_UID) {
+        if (p >= end || *p > sizeof(rec->uid) || p + 1 + *p > end) {
+            return 0;
+        }
+        rec->uid_size = *p++;
+        memcpy(rec->uid, p, rec->uid_size);
+        p += rec->uid_size;
+    }else {
+        rec->uid_size = b->uid_size;
+        memcpy(rec->uid, b->uid, b->uid_size);
+    }
+    rec->reserved = 0;
+    if (p >= end || *p != (uint8_t)journal_crc32(in, p - in)) {
+        return 0;
+    }
+    history_block_update(b, rec);
+    return (uint8_t)(p + 1 - in);
+}
+
+/**
+ * @brief Erase the next sector of the ring and make it the active one. The index page
+ * (with the header) is programmed with the first records.
+ *
+ * @param h
+ */
+static void history_rotate(history_t *h)
+{
+    h->sector = (h->sector + 1) % HISTORY_SECTORS;
+    flash_worker_wait(); ///< The header is read through XIP
+    const history_index_t *old = history_index_at(h->sector);
+    uint32_t erase_count = history_index_is_valid(old) ? old->erase_count + 1 : 1; ///< Keep the erase counter of the sector
+
+    flash_worker_erase(HISTORY_OFFSET + h->sector*FLASH_SECTOR_SIZE);
+    h->stats.erases++;
+
+    memset(&h->index, 0xFF, sizeof(h->index));
+    h->index.magic = HISTORY_MAGIC;
+    h->index.version = HISTORY_VERSION;
+    h->index.reserved = 0;
+    h->index.seq = ++h->seq;
+    h->index.erase_count = erase_count;
+    h->index.crc = journal_crc32((const uint8_t *)&h->index, 12);
+    h->page = 0;
+    h->offset = 0; ///< The block of the page is started by the first record
+    h->staged = false;
+}
+
+/**
+ * @brief Check if a data page was never programmed.
+ *
+ * @param sector
+ * @param page
+ * @return true if every byte is erased
+ */
+static bool history_page_is_blank(uint8_t sector, uint8_t page)
+{
+    const uint32_t *w = (const uint32_t *)history_page_at(sector, page);
+    for (uint16_t i = 0; i < FLASH_PAGE_SIZE / sizeof(uint32_t); i++) {
+        if (w[i] != 0xFFFFFFFFU) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Load the active page and restore the encoder after its last record. The index entry of
+ * the page is rebuilt from its records: it is missing or torn when the power was lost after the
+ * page was programmed, and it is programmed again with the next history_sync().
+ *
+ * @param h
+ * @param time Timestamp of the last record before the page
+ * @return uint8_t Records decoded
+ */
+static uint8_t history_resume(history_t *h, uint32_t time)
+{
+    uint32_t base;
+    uint8_t records = 0, len;
+    history_rec_t rec;
+
+    memcpy(h->buffer, history_page_at(h->sector, h->page), FLASH_PAGE_SIZE);
+    memcpy(&base, h->buffer, sizeof(uint32_t));
+    if (base == 0xFFFFFFFFU && h->index.page[h->page].first_time != 0xFFFFFFFFU) {
+        // Indexed but never programmed (the index went first in the previous releases): the
+        // block restarts empty from the timestamp of the entry
+        base = h->index.page[h->page].first_time;
+        memcpy(h->buffer, &base, sizeof(uint32_t));
+    }
+    history_block_start(&h->block, base);
+    for (h->offset = sizeof(uint32_t); (len = history_decode(&h->block, &h->buffer[h->offset], &h->buffer[FLASH_PAGE_SIZE], &rec)); h->offset += len) {
+        h->index.page[h->page].absent[history_bit(rec.code) / 32] &= ~(1u << (history_bit(rec.code) % 32));
+        records++;
+    }
+    for (uint16_t i = h->offset; i < FLASH_PAGE_SIZE; i++) {
+        if (h->buffer[i] != 0xFF) { ///< Torn record, the page is closed
+            h->offset = FLASH_PAGE_SIZE;
+            break;
+        }
+    }
+    if (!records && h->index.page[h->page].first_time == 0xFFFFFFFFU) {
+        // Torn before its first record was complete, the timestamp of the block may be torn too:
+        // the page is closed and indexed after the previous records
+        h->offset = FLASH_PAGE_SIZE;
+        history_block_start(&h->block, time);
+        base = time;
+    }
+    h->index.page[h->page].first_time = base; ///< A torn entry only has bits of the timestamp still set
+    return records;
+}
+
+void history_init(history_t *h)
+{
+    memset(&h->stats, 0, sizeof(h->stats));
+    h->operator_size = 0;
+    h->staged = false;
+    h->seq = 0;
+    flash_worker_wait(); ///< The history is read through XIP
+
+    // The newest sector has the largest sequence number
+    bool found = false;
+    for (uint8_t s = 0; s < HISTORY_SECTORS; s++) {
+        const history_index_t *idx = history_index_at(s);
+        if (history_index_is_valid(idx) && (!found || idx->seq > h->seq)) {
+            found = true;
+            h->sector = s;
+            h->seq = idx->seq;
+        }
+    }
+    h->time_base = 0;
+    if (!found) {
+        h->sector = HISTORY_SECTORS - 1; ///< The first records go to the first sector
+        history_rotate(h);
+        printf("History formatted\n");
+        return;
+    }
+
+    // Resume after the last record of the newest sector. A page is programmed before its index
+    // entry, so the page after the last indexed one can hold records too.
+    memcpy(&h->index, history_index_at(h->sector), sizeof(h->index));
+    uint8_t pages;
+    for (pages = 0; pages < HISTORY_PAGES && h->index.page[pages].first_time != 0xFFFFFFFFU; pages++);
+    h->page = 0;
+    h->offset = 0;
+    if (pages) {
+        h->page = pages - 1;
+        history_resume(h, 0);
+    }
+    if (pages < HISTORY_PAGES && !history_page_is_blank(h->sector, pages)) {
+        h->page = pages;
+        history_resume(h, h->offset ? h->block.time : 0);
+    }
+    if (h->offset) { ///< Timestamps never go back after a reboot, nor before the last indexed page
+        uint32_t last = h->block.time > h->index.page[h->page].first_time ? h->block.time : h->index.page[h->page].first_time;
+        h->time_base = last + 1;
+    }
+    h->staged = memcmp(&h->index, history_index_at(h->sector), sizeof(h->index)) != 0; ///< Entry to program again
+    printf("History mounted: sector %u, page %u, offset %u, time %u\n", h->sector, h->page, h->offset, h->time_base);
+}
+
+uint32_t history_now(history_t *h)
+{
+    return h->time_base + (uint32_t)(time_us_64() / 1000000);
+}
+
+bool history_set_time(history_t *h, uint32_t now)
+{
+    uint32_t uptime = (uint32_t)(time_us_64() / 1000000);
+    if (now < history_now(h)) {
+        return false;
+    }
+    h->time_base = now - uptime;
+    return true;
+}
+
+void history_set_operator(history_t *h, const uint8_t *uid, uint8_t size)
+{
+    h->operator_size = size < sizeof(h->operator_uid) ? size : sizeof(h->operator_uid);
+    memcpy(h->operator_uid, uid, h->operator_size);
+}
+
+void history_append(history_t *h, uint16_t code, int32_t delta, uint32_t purchase_v, uint32_t sale_v)
+{
+    history_rec_t rec = {
+        .time = history_now(h),
+        .code = code,
+        .uid_size = h->operator_size,
+        .reserved = 0,
+        .delta = delta,
+        .purchase_v = purchase_v,
+        .sale_v = sale_v
+    };
+    memcpy(rec.uid, h->operator_uid, h->operator_size);
+    uint8_t enc[HISTORY_REC_MAX];
+    uint8_t n = 0;
+
+    if (h->offset) {
+        n = history_encode(&h->block, &rec, enc);
+    }
+    if (!h->offset || h->offset + n > FLASH_PAGE_SIZE) { ///< Start a new block
+        if (h->offset) { ///< The active page is complete
+            history_sync(h);
+            h->page++;
+        }
+        if (h->page >= HISTORY_PAGES) { ///< The active sector is complete, erase the oldest one
+            history_rotate(h);
+        }
+        memset(h->buffer, 0xFF, FLASH_PAGE_SIZE);
+        memcpy(h->buffer, &rec.time, sizeof(uint32_t));
+        h->offset = sizeof(uint32_t);
+        history_block_start(&h->block, rec.time);
+        h->index.page[h->page].first_time = rec.time;
+        n = history_encode(&h->block, &rec, enc);
+    }
+    memcpy(&h->buffer[h->offset], enc, n);
+    h->offset += n;
+    history_block_update(&h->block, &rec);
+
+    // Index of the page: the bits of the bitmap are only cleared
+    h->index.page[h->page].absent[history_bit(code) / 32] &= ~(1u << (history_bit(code) % 32));
+
+    h->staged = true;
+    h->stats.records++;
+    h->stats.bytes += n;
+}
+
+void history_sync(history_t *h)
+{
+    if (!h->staged) {
+        return;
+    }
+    // The records go first: if the power is lost before the index is programmed, the entry of
+    // the page is missing or torn, and history_init() rebuilds it from the records. An entry
+    // never points to a page that was not programmed. The bytes already programmed are
+    // programmed again with the same value.
+    flash_worker_program(HISTORY_OFFSET + h->sector*FLASH_SECTOR_SIZE + (1 + h->page)*FLASH_PAGE_SIZE, h->buffer);
+    flash_worker_program(HISTORY_OFFSET + h->sector*FLASH_SECTOR_SIZE, (const uint8_t *)&h->index);
+    h->stats.programs += 2;
+    h->staged = false;
+}
+
+history_result_t history_query(history_t *h, uint16_t code, uint32_t t1, uint32_t t2,
+                               void (*cb)(void *ctx, const history_rec_t *rec), void *ctx)
+{
+    history_result_t res = {0, 0, 0};
+    history_sync(h); ///< The staged records are read from the flash too
+    flash_worker_wait();
+
+    // From the oldest sector to the newest one, the timestamps are ordered
+    for (uint8_t n = 1; n <= HISTORY_SECTORS; n++) {
+        uint8_t s = (h->sector + n) % HISTORY_SECTORS;
+        const history_index_t *idx = history_index_at(s);
+        if (!history_index_is_valid(idx)) {
+            continue;
+        }
+        for (uint8_t p = 0; p < HISTORY_PAGES; p++) {
+            uint32_t first = idx->page[p].first_time;
+            uint32_t next = (p + 1u < HISTORY_PAGES) ? idx->page[p + 1].first_time : 0xFFFFFFFFU;
+            if (first == 0xFFFFFFFFU) { ///< No more pages in this sector
+                break;
+            }
+            if (first > t2) { ///< This page and the following ones are newer than the range
+                return res;
+            }
+            bool before = (next != 0xFFFFFFFFU && next < t1); ///< Every record of the page is older than the range
+            bool absent = code != HISTORY_ALL && (idx->page[p].absent[history_bit(code) / 32] & (1u << (history_bit(code) % 32)));
+            if (before || absent) {
+                h->stats.pages_skipped++;
+                continue;
+            }
+            h->stats.pages_read++;
+            const uint8_t *block = history_page_at(s, p);
+            history_block_t state;
+            history_rec_t rec;
+            uint32_t base;
+            uint8_t len;
+            memcpy(&base, block, sizeof(uint32_t)); ///< Each block carries its own timestamp
+            history_block_start(&state, base);
+            for (uint16_t off = sizeof(uint32_t); (len = history_decode(&state, &block[off], &block[FLASH_PAGE_SIZE], &rec)); off += len) {
+                if (rec.time < t1 || rec.time > t2 || (code != HISTORY_ALL && rec.code != code)) {
+                    continue;
+                }
+                res.moves++;
+                res.net += rec.delta;
+                if (rec.delta < 0) {
+                    res.sales += (uint64_t)rec.sale_v * (uint32_t)(-rec.delta);
+                }
+                if (cb) {
+                    cb(ctx, &rec);
+                }
+            }
+        }
+    }
+    return res;
+}
+
+void history_print_stats(history_t *h)
+{
+    printf("History: sector %u/%u page %u offset %u seq %u time %u\n",
+           h->sector, HISTORY_SECTORS, h->page, h->offset, h->seq, history_now(h));
+    printf("records %u bytes %u (%u.%02u per record) programs %u erases %u pages skipped %u pages read %u\n",
+           h->stats.records, h->stats.bytes,
+           h->stats.records ? h->stats.bytes / h->stats.records : 0,
+           h->stats.records ? (h->stats.bytes * 100 / h->stats.records) % 100 : 0,
+           h->stats.programs, h->stats.erases, h->stats.pages_skipped, h->stats.pages_read);
+}
@@ -0,0 +1,211 @@
+/**
+ * \file        history.h
+ * \brief       Time-indexed history of the inbound and outbound transactions, stored in the flash memory.
+ * \details     The history is a ring of sectors below the journal. The first page of each sector
+ *              is its index: a header and one entry per data page with the timestamp of the first
+ *              record of the page and a bitmap of the products stored in it. Both are written the
+ *              NOR way: an erased entry is all ones, the timestamp is programmed once and the bits
+ *              of the bitmap are only cleared, so the index page is reprogrammed in place. A data
+ *              page is programmed before its index entry, and the mount rebuilds the entry of the
+ *              last page from its records after a power cut. Queries read the index through the
+ *              XIP window and only decode the pages that may contain the product and overlap the
+ *              time range. When the ring is full the oldest sector is erased.
+ *
+ *              Each data page is a block that is decoded on its own: the timestamp of the block
+ *              followed by variable-length records
+ *                  flags | varint dt | varint code | zig-zag varint delta | [varint purchase_v]
+ *                  [varint sale_v] | [uid size, uid] | crc8
+ *              dt is relative to the previous record of the block. The prices are only stored when
+ *              they differ from the previous movement of the same product in the block, and the
+ *              operator UID when it differs from the previous record. The crc8 is the low byte of
+ *              the CRC32 of the record. A flags byte 0xFF (erased) ends the block.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __HISTORY_
+#define __HISTORY_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/flash.h"
+
+#include "flash_journal.h"
+
+#ifndef HISTORY_SECTORS
+#define HISTORY_SECTORS         16 ///< Number of sectors of the ring used by the history
+#endif
+#define HISTORY_OFFSET          (JOURNAL_OFFSET - HISTORY_SECTORS*FLASH_SECTOR_SIZE) ///< Flash-based address of the history area
+#define HISTORY_REC_MAX         34 ///< Maximum size in bytes of an encoded record
+#define HISTORY_BLOCK_CODES     32 ///< Products of a block whose prices can be referenced
+#define HISTORY_PAGES           (FLASH_SECTOR_SIZE/FLASH_PAGE_SIZE - 1) ///< Data pages of a sector (the first one is the index)
+#define HISTORY_MAGIC           0x4853 ///< "HS"
+#define HISTORY_VERSION         2
+#define HISTORY_BITMAP_BITS     96 ///< Bits of the product bitmap of a page
+#define HISTORY_ALL             0 ///< Product code that matches every product in a query
+
+/**
+ * \typedef history_rec_t
+ * \brief Movement of a product, as decoded from the flash.
+ */
+typedef struct {
+    uint32_t time;      ///< Timestamp (s)
+    uint16_t code;      ///< Product code
+    uint8_t uid_size;   ///< Bytes of the operator UID
+    uint8_t reserved;
+    int32_t delta;      ///< Items moved: positive inbound, negative outbound
+    uint32_t purchase_v; ///< Unit purchase value of the box
+    uint32_t sale_v;    ///< Unit sale value of the box
+    uint8_t uid[8];     ///< UID of the operator card (first 8 bytes)
+} history_rec_t;
+
+/**
+ * \typedef history_block_t
+ * \brief State of the encoder (or the decoder) of a block.
+ */
+typedef struct {
+    uint32_t time;      ///< Timestamp of the previous record
+    uint8_t uid[8];     ///< Operator UID of the previous record
+    uint8_t uid_size;
+    uint8_t codes;      ///< Entries of prices
+    struct {
+        uint16_t code;
+        uint32_t purchase_v;
+        uint32_t sale_v;
+    } prices[HISTORY_BLOCK_CODES]; ///< Prices of the previous movement of each product in the block
+} history_block_t;
+
+/**
+ * \typedef history_index_t
+ * \brief Index page of a sector (256 bytes).
+ */
+typedef struct {
+    uint16_t magic;     ///< HISTORY_MAGIC
+    uint8_t version;    ///< HISTORY_VERSION
+    uint8_t reserved;
+    uint32_t seq;       ///< Sequence number of the sector, incremented on each erase
+    uint32_t erase_count; ///< Erase counter of the sector
+    uint32_t crc;       ///< CRC32 of the previous 12 bytes
+    struct {
+        uint32_t first_time; ///< Timestamp of the first record of the page, all ones if the page is empty
+        uint32_t absent[HISTORY_BITMAP_BITS/32]; ///< A bit is cleared when a product that hashes to it is stored
+    } page[HISTORY_PAGES];
+} history_index_t;
+
+/**
+ * \typedef history_t
+ * \brief Data structure to manage the history.
+ */
+typedef struct {
+    uint8_t sector;     ///< Active sector inside the ring
+    uint8_t page;       ///< Active data page inside the sector
+    uint16_t offset;    ///< Next free byte of the active page, FLASH_PAGE_SIZE if it is closed
+    bool staged;        ///< The page buffer has records that are not programmed yet
+    uint32_t seq;       ///< Sequence number of the active sector
+    uint32_t time_base; ///< Timestamp at boot, time = time_base + seconds since boot
+
+    uint8_t operator_uid[8]; ///< UID of the operator card, stored in each record
+    uint8_t operator_size;
+
+    history_index_t index; ///< Copy of the index page of the active sector
+    uint8_t buffer[FLASH_PAGE_SIZE]; ///< Copy of the active data page
+    history_block_t block; ///< Encoder state of the active data page
+
+    struct {
+        uint32_t records;       ///< Records appended
+        uint32_t bytes;         ///< Bytes of the records appended
+        uint32_t programs;      ///< Flash pages programmed
+        uint32_t erases;        ///< Flash sectors erased
+        uint32_t pages_skipped; ///< Pages skipped by the index in the queries
+        uint32_t pages_read;    ///< Pages decoded in the queries
+    } stats;
+} history_t;
+
+/**
+ * \typedef history_result_t
+ * \brief Summary of a query.
+ */
+typedef struct {
+    uint32_t moves;     ///< Number of movements found
+    int64_t net;        ///< Net amount moved
+    uint64_t sales;     ///< Value of the outbound movements at sale price
+} history_result_t;
+
+/**
+ * @brief This function initializes the history_t structure and mounts the history area.
+ * A blank or foreign area is formatted.
+ *
+ * @param h
+ */
+void history_init(history_t *h);
+
+/**
+ * @brief Current timestamp of the history (s).
+ *
+ * @param h
+ * @return uint32_t
+ */
+uint32_t history_now(history_t *h);
+
+/**
+ * @brief Set the clock of the history. Only forward changes are accepted, so that the
+ * timestamps stay ordered in the flash.
+ *
+ * @param h
+ * @param now Current timestamp (s)
+ * @return true if the clock was set
+ */
+bool history_set_time(history_t *h, uint32_t now);
+
+/**
+ * @brief Set the UID of the operator card, stored with the next records.
+ *
+ * @param h
+ * @param uid
+ * @param size
+ */
+void history_set_operator(history_t *h, const uint8_t *uid, uint8_t size);
+
+/**
+ * @brief Encode a movement into the page buffer. It is programmed on history_sync() or when the page is complete.
+ *
+ * @param h
+ * @param code
+ * @param delta
+ * @param purchase_v
+ * @param sale_v
+ */
+void history_append(history_t *h, uint16_t code, int32_t delta, uint32_t purchase_v, uint32_t sale_v);
+
+/**
+ * @brief Program the staged records and the index of their page.
+ *
+ * @param h
+ */
+void history_sync(history_t *h);
+
+/**
+ * @brief Find the movements of a product between two timestamps (both included).
+ * Pages are skipped through the index without being decoded.
+ *
+ * @param h
+ * @param code Product code, HISTORY_ALL for every product
+ * @param t1
+ * @param t2
+ * @param cb Called for each movement found, it can be NULL
+ * @param ctx Context passed to the callback
+ * @return history_result_t
+ */
+history_result_t history_query(history_t *h, uint16_t code, uint32_t t1, uint32_t t2,
+                               void (*cb)(void *ctx, const history_rec_t *rec), void *ctx);
+
+/**
+ * @brief Print the statistics of the history.
+ *
+ * @param h
+ */
+void history_print_stats(history_t *h);
+
+#endif // __HISTORY_
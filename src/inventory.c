@@ -9,117 +9,456 @@
  */
 
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include "hardware/sync.h"
-#include "pico/flash.h"
+#include <string.h>
 #include "pico/time.h"
 #include "hardware/irq.h"
 
 #include "inventory.h"
 
+/**
+ * \typedef inventory_totals_entry_t
+ * \brief Snapshot entry that persists the cumulative sales. Its code is 0, which no product uses.
+ */
+typedef struct {
+    uint16_t code;      ///< Always 0
+    uint16_t reserved;
+    uint32_t sales_lo;  ///< Cumulative sales, bits 0..31
+    uint32_t sales_hi;  ///< Cumulative sales, bits 32..63
+    uint32_t spi_baud;  ///< INV_CONFIG_SPI_BAUD, 0 in the snapshots written before the settings existed
+} inventory_totals_entry_t;
+
+_Static_assert(sizeof(product_t) == JOURNAL_REC_SIZE, "A product is stored as one snapshot entry");
+_Static_assert(sizeof(inventory_totals_entry_t) == JOURNAL_REC_SIZE, "The totals are stored as one snapshot entry");
+_Static_assert(INV_CONFIG_KEYS == 1, "The settings are stored in the totals entry");
+_Static_assert(CATALOG_MAX + 1 <= JOURNAL_RECS_PER_SECTOR - 3, "The snapshot of the catalog must fit in one sector");
+
 void inventory_init(inventory_t *inv, bool access)
 {
     inv->access = access;
     inv->timer_irq = TIMER_IRQ_3;
     inv->time = 3000000; // 3 seconds
     inv->state = DATA_BASE;
-    inv->count.id = 0;
+    inv->count.slot = CATALOG_SIZE;
     inv->count.frame = 0;
     inv->today.amount = 0;
     inv->today.purchases = 0;
     inv->today.sales = 0;
+    inv->totals.sales_pending = 0;
+    inv->wb.pending = 0;
+    inv->wb.max_pending = 16; ///< One flash page of records
+    inv->wb.idle_us = 5000000; // 5 seconds
+    inv->wb.worst_pending = 0;
+    inv->wb.worst_window_us = 0;
 
-    // Initialize the database
+    // Initialize the catalog and the history
     inventory_load(inv);
+    history_init(&inv->history);
     printf("Inventory initialized\n");
-    inventory_print_data(inv->database[0]);
+    inventory_print_data(inv);
     
 }
 
-void inventory_store(inventory_t *inv)
+/**
+ * @brief Remove the contribution of a product from the stock values, before it is modified.
+ * The aggregates wrap around like the products, so removing and adding back is exact.
+ * 
+ * @param inv 
+ * @param p 
+ */
+static inline void inventory_value_sub(inventory_t *inv, const product_t *p)
 {
-    // An array of 256 bytes, multiple of FLASH_PAGE_SIZE. Database is 60 bytes.
-    uint32_t buf[FLASH_PAGE_SIZE/sizeof(uint32_t)];
+    inv->totals.purchase_value -= (uint64_t)p->amount * p->purchase_v;
+    inv->totals.sale_value -= (uint64_t)p->amount * p->sale_v;
+}
 
-    // Copy the database into the buffer
-    for (int i = 0; i < 5; i++){
-        for (int j = 0; j < 3; j++){
-            buf[i*3 + j] = inv->database[i][j];
+/**
+ * @brief Add the contribution of a product to the stock values, after it is modified.
+ * 
+ * @param inv 
+ * @param p 
+ */
+static inline void inventory_value_add(inventory_t *inv, const product_t *p)
+{
+    inv->totals.purchase_value += (uint64_t)p->amount * p->purchase_v;
+    inv->totals.sale_value += (uint64_t)p->amount * p->sale_v;
+}
+
+/**
+ * @brief Clear the running aggregates.
+ * 
+ * @param inv 
+ */
+static void inventory_totals_clear(inventory_t *inv)
+{
+    inv->totals.purchase_value = 0;
+    inv->totals.sale_value = 0;
+    inv->totals.sales = 0;
+    inv->totals.sales_pending = 0;
+}
+
+/**
+ * @brief Apply a journal record to the catalog (replay callback).
+ * 
+ * @param ctx inventory_t structure
+ * @param rec 
+ */
+static void inventory_apply_rec(void *ctx, const journal_rec_t *rec)
+{
+    inventory_t *inv = (inventory_t *)ctx;
+    product_t *p;
+
+    switch (rec->type)
+    {
+    case JR_SET:
+        p = catalog_get(&inv->catalog, rec->id);
+        if (p && rec->field < 3) {
+            inventory_value_sub(inv, p);
+            *catalog_field(p, rec->field) = rec->value;
+            inventory_value_add(inv, p);
+        }
+        break;
+    case JR_ADD:
+        p = catalog_get(&inv->catalog, rec->id);
+        if (p) {
+            inventory_value_sub(inv, p);
+            p->amount += (int32_t)rec->value;
+            inventory_value_add(inv, p);
         }
+        break;
+    case JR_RESET:
+        catalog_clear(&inv->catalog);
+        inventory_totals_clear(inv);
+        break;
+    case JR_SALES:
+        inv->totals.sales += ((uint64_t)rec->id << 32) | rec->value;
+        break;
+    case JR_CONFIG:
+        if (rec->id < INV_CONFIG_KEYS) {
+            inv->config[rec->id] = rec->value;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Load a product from a snapshot entry (replay callback).
+ * 
+ * @param ctx inventory_t structure
+ * @param entry product_t stored in the flash
+ */
+static void inventory_load_entry(void *ctx, const void *entry)
+{
+    inventory_t *inv = (inventory_t *)ctx;
+    const product_t *src = (const product_t *)entry;
+    product_t *p = catalog_get(&inv->catalog, src->code);
+
+    if (!src->code) { ///< Totals entry
+        const inventory_totals_entry_t *t = (const inventory_totals_entry_t *)entry;
+        inv->totals.sales = ((uint64_t)t->sales_hi << 32) | t->sales_lo;
+        inv->config[INV_CONFIG_SPI_BAUD] = t->spi_baud;
+    }
+    else if (p) {
+        p->amount = src->amount;
+        p->purchase_v = src->purchase_v;
+        p->sale_v = src->sale_v;
+        inventory_value_add(inv, p);
     }
-    // Program buf[] into the first page of this sector
-    // Each page is 256 bytes, and each sector is 4K bytes
-    // Erase the last sector of the flash
-    flash_safe_execute(invetory_wrapper, NULL, 500);
+}
 
-    uint32_t ints = save_and_disable_interrupts();
-    flash_range_program(FLASH_TARGET_OFFSET, (uint8_t *)buf, FLASH_PAGE_SIZE);
-    restore_interrupts (ints);
+/**
+ * @brief Emit the whole catalog as snapshot entries (compaction callback).
+ * 
+ * @param ctx inventory_t structure
+ */
+static void inventory_snapshot(void *ctx)
+{
+    inventory_t *inv = (inventory_t *)ctx;
+
+    inventory_totals_entry_t t = {
+        .code = 0,
+        .sales_lo = (uint32_t)inv->totals.sales,
+        .sales_hi = (uint32_t)(inv->totals.sales >> 32),
+        .spi_baud = inv->config[INV_CONFIG_SPI_BAUD]
+    };
+    inv->totals.sales_pending = 0; ///< The snapshot persists the sales
+    journal_snapshot_begin(&inv->journal, inv->catalog.count + 1);
+    journal_snapshot_entry(&inv->journal, &t);
+    for (uint16_t i = catalog_next(&inv->catalog, 0); i < CATALOG_SIZE; i = catalog_next(&inv->catalog, i + 1)) {
+        product_t *p = &inv->catalog.products[i];
+        p->dirty = 0; ///< The snapshot persists every field
+        journal_snapshot_entry(&inv->journal, p);
+    }
+}
+
+void inventory_store(inventory_t *inv)
+{
+    inv->wb.pending = 0;
+    journal_compact(&inv->journal);
 
     // Prints
     printf("\nStored data in flash\n");
-    inventory_print_data(buf);
+    inventory_print_data(inv);
+}
+
+/**
+ * @brief Recognise the legacy snapshot of the last sector: products 1-5 (amount, purchase, sale) in
+ * its first page, written before the journal existed. The rest of the journal area must be blank and
+ * the values not negative, so the records of a corrupted journal are never imported as products.
+ * 
+ * @param legacy Memory-mapped first page of the last sector
+ * @return true 
+ * @return false 
+ */
+static bool inventory_legacy_found(const uint32_t *legacy)
+{
+    const uint32_t *area = (const uint32_t *)(XIP_BASE + JOURNAL_OFFSET);
+    for (uint32_t i = 0; i < (FLASH_TARGET_OFFSET - JOURNAL_OFFSET) / sizeof(uint32_t); i++) {
+        if (area[i] != 0xFFFFFFFFU) { ///< The other sectors of the ring were written by the journal
+            return false;
+        }
+    }
+    for (uint32_t i = FLASH_PAGE_SIZE / sizeof(uint32_t); i < FLASH_SECTOR_SIZE / sizeof(uint32_t); i++) {
+        if (legacy[i] != 0xFFFFFFFFU) { ///< Only the first page was programmed
+            return false;
+        }
+    }
+    for (int i = 0; i < 5*3; i++) {
+        if (legacy[i] >> 31) { ///< Negative value, or not programmed
+            return false;
+        }
+    }
+    return true;
 }
 
 void inventory_load(inventory_t *inv)
 {
-    // Compute the memory-mapped address, remembering to include the offset for RAM
-    uint32_t addr = XIP_BASE +  FLASH_TARGET_OFFSET;
-    uint32_t *ptr = (uint32_t *)addr; ///< Place an int pointer at our memory-mapped address
+    catalog_clear(&inv->catalog);
+    inventory_totals_clear(inv);
+    memset(inv->config, 0, sizeof(inv->config));
+    if (journal_init(&inv->journal, inventory_apply_rec, inventory_load_entry, inventory_snapshot, inv)) {
+        return;
+    }
 
-    // Load the inventory from the flash memory
-    for (int i = 0; i < 5; i++){
+    // No journal: seed it with the legacy snapshot of the last sector (products 1-5), if it is recognised,
+    // else format it with an empty catalog
+    uint32_t *ptr = (uint32_t *)(XIP_BASE + FLASH_TARGET_OFFSET); ///< Place an int pointer at our memory-mapped address
+    bool legacy = inventory_legacy_found(ptr);
+    for (int i = 0; i < 5 && legacy; i++){
+        product_t *p = catalog_get(&inv->catalog, i + 1);
         for (int j = 0; j < 3; j++){
-            inv->database[i][j] = ptr[i*3 + j];
+            *catalog_field(p, j) = ptr[i*3 + j];
         }
+        inventory_value_add(inv, p);
     }
+    journal_format(&inv->journal);
 }
 
-void invetory_wrapper()
+/**
+ * @brief Mark a field of a product as dirty, without flushing the cache.
+ * 
+ * @param inv 
+ * @param p 
+ * @param field 
+ */
+static void inventory_touch(inventory_t *inv, product_t *p, uint8_t field)
 {
-    flash_range_erase((PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE), FLASH_SECTOR_SIZE);
+    uint64_t now = time_us_64();
+    if (!inv->wb.pending) {
+        inv->wb.first_us = now;
+    }
+    inv->wb.last_us = now;
+    p->dirty |= 1u << field;
+    inv->wb.pending++;
 }
 
-void inventory_print_data(uint32_t *data)
+/**
+ * @brief Mark a field of a product as dirty. Flushes the cache when it holds max_pending changes.
+ * 
+ * @param inv 
+ * @param p 
+ * @param field 
+ */
+static void inventory_mark_dirty(inventory_t *inv, product_t *p, uint8_t field)
 {
-    printf("ID\t \t Amount\t Purchase\t Sale \n");
-    for (int i = 0; i < 5; i++){
-        printf("%d\t \t", i + 1);
-        for (int j = 0; j < 3; j++){
-            if (j == 2) {
-                printf("           %u\t", data[i*3 + j]);
-            }else {
-                printf("  %u\t", data[i*3 + j]);
+    inventory_touch(inv, p, field);
+    if (inv->wb.pending >= inv->wb.max_pending) {
+        inventory_flush(inv);
+    }
+}
+
+void inventory_flush(inventory_t *inv)
+{
+    history_sync(&inv->history); ///< The movements are persisted with the catalog
+    if (!inv->wb.pending) {
+        return;
+    }
+    uint32_t window = (uint32_t)(time_us_64() - inv->wb.first_us);
+    if (window > inv->wb.worst_window_us) {
+        inv->wb.worst_window_us = window;
+    }
+    if (inv->wb.pending > inv->wb.worst_pending) {
+        inv->wb.worst_pending = inv->wb.pending;
+    }
+
+    // Several changes of the same field are coalesced into a single record, and the records
+    // of a flush are replayed all-or-nothing
+    uint16_t records = 0;
+    for (uint16_t i = catalog_next(&inv->catalog, 0); i < CATALOG_SIZE; i = catalog_next(&inv->catalog, i + 1)) {
+        records += __builtin_popcount(inv->catalog.products[i].dirty);
+    }
+    records += (inv->totals.sales_pending != 0);
+    if (records > 1) {
+        journal_put(&inv->journal, JR_BATCH, records, 0, 0);
+    }
+    for (uint16_t i = catalog_next(&inv->catalog, 0); i < CATALOG_SIZE; i = catalog_next(&inv->catalog, i + 1)) {
+        product_t *p = &inv->catalog.products[i];
+        for (uint8_t j = 0; j < 3; j++){
+            if (p->dirty & (1u << j)) {
+                journal_put(&inv->journal, JR_SET, p->code, j, *catalog_field(p, j));
             }
         }
-        printf("\n");
+        p->dirty = 0;
+    }
+    if (inv->totals.sales_pending) {
+        journal_put(&inv->journal, JR_SALES, (uint16_t)(inv->totals.sales_pending >> 32), 0, (uint32_t)inv->totals.sales_pending);
+        inv->totals.sales_pending = 0;
     }
-    printf("\n");
+    journal_sync(&inv->journal);
+    printf("Flushed %u changes, window %u us\n", inv->wb.pending, window);
+    inv->wb.pending = 0;
+}
 
+bool inventory_set_field(inventory_t *inv, uint16_t code, uint8_t field, uint32_t value)
+{
+    product_t *p = catalog_get(&inv->catalog, code);
+    if (!p || field > 2) {
+        return false;
+    }
+    inventory_value_sub(inv, p);
+    *catalog_field(p, field) = value;
+    inventory_value_add(inv, p);
+    inventory_mark_dirty(inv, p, field);
+    return true;
+}
+
+void inventory_set_config(inventory_t *inv, uint8_t key, uint32_t value)
+{
+    if (key >= INV_CONFIG_KEYS || inv->config[key] == value) {
+        return;
+    }
+    inv->config[key] = value;
+    journal_append(&inv->journal, JR_CONFIG, key, 0, value);
 }
 
-void inventory_in_transaction(inventory_t *inv)
+void inventory_print_data(inventory_t *inv)
 {
-    inv->database[inv->tag.id - 1][0] += inv->tag.amount;
-    inventory_store(inv);
+    printf("Code\t \t Amount\t Purchase\t Sale \n");
+    for (uint16_t i = catalog_next(&inv->catalog, 0); i < CATALOG_SIZE; i = catalog_next(&inv->catalog, i + 1)) {
+        product_t *p = &inv->catalog.products[i];
+        printf("%u\t \t  %u\t  %u\t           %u\t\n", p->code, p->amount, p->purchase_v, p->sale_v);
+    }
+    printf("%u products\n", inv->catalog.count);
+    printf("Stock value: %" PRIu64 " (purchase) %" PRIu64 " (sale)   Sales: %" PRIu64 "\n\n",
+           inv->totals.purchase_value, inv->totals.sale_value, inv->totals.sales);
 
-    inv->today.amount += inv->tag.amount;
-    inv->today.purchases += (inv->tag.purchase_v * inv->tag.amount);
+}
+
+/**
+ * @brief Move a box of a tag into (or out of) the warehouse, update the aggregates in O(1)
+ * and record the movement in the history.
+ * 
+ * @param inv 
+ * @param p Product of the tag
+ * @param tag 
+ * @param out false: inbound, true: outbound
+ */
+static void inventory_move(inventory_t *inv, product_t *p, const tag_t *tag, bool out)
+{
+    inventory_value_sub(inv, p);
+    if (out) {
+        uint64_t sale = (uint64_t)tag->sale_v * tag->amount;
+        p->amount -= tag->amount;
+        inv->today.amount -= tag->amount;
+        inv->today.sales += sale;
+        inv->totals.sales += sale;
+        inv->totals.sales_pending += sale;
+    }else {
+        p->amount += tag->amount;
+        inv->today.amount += tag->amount;
+        inv->today.purchases += (uint64_t)tag->purchase_v * tag->amount;
+    }
+    inventory_value_add(inv, p);
+    history_append(&inv->history, p->code, out ? -(int32_t)tag->amount : (int32_t)tag->amount, tag->purchase_v, tag->sale_v);
+}
+
+bool inventory_in_transaction(inventory_t *inv)
+{
+    product_t *p = catalog_get(&inv->catalog, inv->tag.code);
+    if (!p) {
+        return false;
+    }
+    inventory_move(inv, p, &inv->tag, false);
+    inventory_mark_dirty(inv, p, 0);
+    return true;
 }
 
 bool inventory_out_transaction(inventory_t *inv)
 {
-    if (inv->database[inv->tag.id][0] < inv->tag.amount) {
+    product_t *p = catalog_find(&inv->catalog, inv->tag.code);
+    if (!p || p->amount < inv->tag.amount) {
         return false;
     }
     else {
-        inv->database[inv->tag.id - 1][0] -= inv->tag.amount;
-        inventory_store(inv);
-
-        inv->today.amount -= inv->tag.amount;
-        inv->today.sales += (inv->tag.sale_v * inv->tag.amount);
+        inventory_move(inv, p, &inv->tag, true);
+        inventory_mark_dirty(inv, p, 0);
         return true;
     }
 }
 
+bool inventory_apply_batch(inventory_t *inv, const tag_t *tags, uint8_t n, bool out)
+{
+    uint16_t added = 0; ///< Products that the batch adds to the catalog
+
+    // Validate the whole batch before touching the catalog. Tags of the same product are summed.
+    for (uint8_t i = 0; i < n; i++) {
+        uint64_t total = 0;
+        bool first = true;
+        for (uint8_t k = 0; k < n; k++) {
+            if (tags[k].code == tags[i].code) {
+                total += tags[k].amount;
+                first &= (k >= i);
+            }
+        }
+        if (!tags[i].code) {
+            return false;
+        }
+        if (!first) { ///< Product already checked
+            continue;
+        }
+        product_t *p = catalog_find(&inv->catalog, tags[i].code);
+        if (out && (!p || p->amount < total)) { ///< Not enough stock
+            return false;
+        }
+        if (!out && (p ? p->amount : 0) + total > UINT32_MAX) {
+            return false;
+        }
+        added += (!out && !p);
+    }
+    if (inv->catalog.count + added > CATALOG_MAX) { ///< Not enough room in the catalog
+        return false;
+    }
+
+    // Apply it and persist it with a single journal commit
+    for (uint8_t i = 0; i < n; i++) {
+        product_t *p = catalog_get(&inv->catalog, tags[i].code);
+        inventory_move(inv, p, &tags[i], out);
+        inventory_touch(inv, p, 0);
+    }
+    inventory_flush(inv);
+    return true;
+}
@@ -14,9 +14,24 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "pico/time.h"
+
 #include "nfc_enums.h"
+#include "flash_journal.h"
+#include "catalog.h"
+#include "history.h"
 
-#define FLASH_TARGET_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE) ///< Flash-based address of the last sector
+#define INVENTORY_BATCH_MAX 32 ///< Maximum number of tags of a batch transaction
+#define FLASH_TARGET_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE) ///< Flash-based address of the last sector (legacy snapshot)
+
+/**
+ * \typedef inventory_config_t
+ * \brief Settings of the devices persisted in the journal (JR_CONFIG records).
+ */
+typedef enum {
+    INV_CONFIG_SPI_BAUD,    ///< SPI clock of the NFC reader chosen by its self-test, 0 if not probed
+    INV_CONFIG_KEYS
+} inventory_config_t;
 
 /**
  * @brief Definition of the inventory structure
@@ -24,25 +39,52 @@
  */
 typedef struct
 {
-    uint32_t database[5][3]; ///< [id][amount, purchase_v, sale_v]
+    catalog_t catalog; ///< Products of the warehouse, keyed by product code
     bool access; ///< Flag that indicates that the inventory is able to be accessed  
     uint8_t timer_irq; ///< Alarm timer IRQ number (TIMER_IRQ_3)
     uint32_t time; ///< Time to show the inventory (3 seconds)
     tag_t tag; ///< Tag structure
+    journal_t journal; ///< Flash journal where the changes of the catalog are persisted
+    history_t history; ///< Flash history of the inbound and outbound transactions
+
+    struct {
+        uint16_t pending;       ///< Changes not persisted yet
+        uint16_t max_pending;   ///< Flush when this number of changes is reached
+        uint32_t idle_us;       ///< Flush when there are no changes during this time
+        uint64_t first_us;      ///< Time of the oldest change not persisted
+        uint64_t last_us;       ///< Time of the newest change not persisted
+        uint16_t worst_pending; ///< Largest number of changes that were waiting for a flush
+        uint32_t worst_window_us; ///< Largest age of a change when it was flushed
+    } wb; ///< Write-back cache of the catalog (the dirty fields are marked in each product)
 
     struct {
         uint32_t amount;
-        uint32_t purchases;
-        uint32_t sales;
+        uint64_t purchases;
+        uint64_t sales;
     }today;
 
+    struct {
+        uint64_t purchase_value; ///< Value of the stock at purchase price
+        uint64_t sale_value;    ///< Value of the stock at sale price
+        uint64_t sales;         ///< Cumulative sales since the inventory was opened (persisted)
+        uint64_t sales_pending; ///< Sales not persisted yet
+    } totals; ///< Running aggregates, updated on each change of the catalog
+
+    uint32_t config[INV_CONFIG_KEYS]; ///< Settings of the devices, kept across the compactions
+
+    struct {
+        uint16_t code;              ///< Product of the last history query
+        history_result_t result;
+    } query; ///< Last history query, shown on the LCD
+
     enum {
         DATA_BASE,
-        IN__OUT_TRANSACTION
+        IN__OUT_TRANSACTION,
+        HISTORY
     } state;
     struct {
-        uint8_t id          :3; ///< 0-4, to show the data base, 5 to show the today transactions
-        uint8_t frame       :1; ///< 0: first frame, 1: second frame
+        uint16_t slot;              ///< Catalog slot to show, CATALOG_SIZE to show the totals
+        uint8_t frame       :1;     ///< 0: first frame, 1: second frame
         uint8_t it          :2;
     } count;
 }inventory_t;
@@ -56,58 +98,99 @@ typedef struct
 void inventory_init(inventory_t *inv, bool access);
 
 /**
- * @brief This function stores the inventory_t structure in the flash memory
+ * @brief This function stores a full snapshot of the catalog in the flash memory
+ * (compaction of the journal).
  * 
  * @param inv 
  */
 void inventory_store(inventory_t *inv);
 
 /**
- * @brief This function loads the inventory_t structure from the flash memory
+ * @brief This function loads the inventory_t structure from the flash memory,
+ * replaying the journal. A blank journal is seeded with the legacy snapshot.
  * 
  * @param inv 
  */
 void inventory_load(inventory_t *inv);
 
 /**
- * @brief Definition of the wrapper function for the flash_safe_execute function,
- * which is used to erase the last sector of the flash memory.
+ * @brief Persist the dirty fields of the catalog, coalesced into one journal commit,
+ * and the staged movements of the history.
  * 
+ * @param inv 
  */
-void invetory_wrapper();
+void inventory_flush(inventory_t *inv);
+
+/**
+ * @brief Check if the idle timeout of the write-back cache has expired.
+ * It is safe to call it from an interrupt handler.
+ * 
+ * @param inv 
+ * @return true if there are unpersisted changes older than the idle timeout
+ */
+static inline bool inventory_flush_due(inventory_t *inv)
+{
+    return inv->wb.pending && (time_us_64() - inv->wb.last_us) >= inv->wb.idle_us;
+}
+
+/**
+ * @brief Set one field of a product and mark it as dirty in the write-back cache.
+ * The product is added to the catalog if it does not exist.
+ * 
+ * @param inv 
+ * @param code Product code
+ * @param field 0: amount, 1: purchase_v, 2: sale_v
+ * @param value 
+ * @return true on success, false if the code is not valid or the catalog is full
+ */
+bool inventory_set_field(inventory_t *inv, uint16_t code, uint8_t field, uint32_t value);
+
+/**
+ * @brief Set a setting of the devices and append it to the journal if it changed.
+ * 
+ * @param inv 
+ * @param key inventory_config_t
+ * @param value 
+ */
+void inventory_set_config(inventory_t *inv, uint8_t key, uint32_t value);
 
 /**
  * @brief Auxiliary function to print the data of the inventory
  * 
- * @param data 
+ * @param inv 
  */
-void inventory_print_data(uint32_t *data);
+void inventory_print_data(inventory_t *inv);
 
 /**
- * @brief Perform a inbound transaction.
- * The parameters are each of the values stored in the tag.
+ * @brief Perform a inbound transaction with the data of inv->tag.
+ * The product is added to the catalog if it does not exist.
  * 
  * @param inv 
- * @param id 
- * @param amount 
- * @param purchase_v 
- * @param sale_v 
+ * @return true if the transaction was successful, false if the catalog is full
  */
-void inventory_in_transaction(inventory_t *inv);
+bool inventory_in_transaction(inventory_t *inv);
 
 /**
- * @brief Perform a outbound transaction.
- * The parameters are each of the values stored in the tag.
+ * @brief Perform a outbound transaction with the data of inv->tag.
  * 
  * @param inv 
- * @param id 
- * @param amount 
- * @param purchase_v 
- * @param sale_v 
  * @return true if the transaction was successful, false otherwise
  */
 bool inventory_out_transaction(inventory_t *inv);
 
+/**
+ * @brief Perform a batch of transactions of the same direction, all-or-nothing.
+ * The whole batch is validated against the stock (outbound) or the room in the catalog
+ * (inbound) before it is applied, and it is persisted with a single journal commit.
+ * 
+ * @param inv 
+ * @param tags Tags of the boxes, several tags can have the same product code
+ * @param n Number of tags (at most INVENTORY_BATCH_MAX)
+ * @param out false: inbound, true: outbound
+ * @return true if the batch was applied, false if nothing was changed
+ */
+bool inventory_apply_batch(inventory_t *inv, const tag_t *tags, uint8_t n, bool out);
+
 /**
  * @brief Reset the inventory to the initial values.
  * This should be only called when the ADMIN has pressed the reset button (E)
@@ -116,12 +199,14 @@ bool inventory_out_transaction(inventory_t *inv);
  */
 static inline void inventory_reset(inventory_t *inv)
 {
-    for (int i = 0; i < 5; i++){
-        for (int j = 0; j < 3; j++){
-            inv->database[i][j] = 0;
-        }
-    }
-    inventory_store(inv);
+    catalog_clear(&inv->catalog);
+    inv->count.slot = CATALOG_SIZE;
+    inv->wb.pending = 0;
+    inv->totals.purchase_value = 0;
+    inv->totals.sale_value = 0;
+    inv->totals.sales = 0;
+    inv->totals.sales_pending = 0;
+    journal_append(&inv->journal, JR_RESET, 0, 0, 0);
 }
 
 #endif // __INVENTORY_
\ No newline at end of file
@@ -64,7 +64,8 @@ typedef struct _TagInfo{
  */
 typedef struct _tag
 {
-    uint32_t id;
+    uint32_t id; ///< Kind of tag (byte 15): 0x07 admin, 0x06 inventory user, otherwise product box
+    uint16_t code; ///< Product code of a box tag
     uint32_t amount;
     uint32_t purchase_v;
     uint32_t sale_v;
@@ -178,7 +179,9 @@ typedef enum _PICC_Command{
     PICC_CMD_MF_TRANSFER	= 0xB0,		// Writes the contents of the internal data register to a block.
     // The commands used for MIFARE Ultralight (from http://www.nxp.com/documents/data_sheet/MF0ICU1.pdf, Section 8.6)
     // The PICC_CMD_MF_READ and PICC_CMD_MF_WRITE can also be used for MIFARE Ultralight.
-    PICC_CMD_UL_WRITE		= 0xA2		// Writes one 4 byte page to the PICC.
+    PICC_CMD_UL_WRITE		= 0xA2,		// Writes one 4 byte page to the PICC.
+    // NTAG21x and MIFARE Ultralight EV1 (from https://www.nxp.com/docs/en/data-sheet/NTAG213_215_216.pdf, Section 10.3)
+    PICC_CMD_UL_FAST_READ	= 0x3A		// Reads the pages from a start address to an end address.
 }PICC_Command;
 
 // Return codes from the functions in this class. Remember to update GetStatusCodeName() if you add more.
@@ -8,6 +8,7 @@
  * \copyright   Unlicensed
  */
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +20,46 @@
 #include "nfc_rfid.h"
 #include "functs.h"
 
+/**
+ * Registers owned by the driver. Excluded because the chip changes them: CommandReg, ComIrqReg,
+ * DivIrqReg, ErrorReg, Status1Reg, FIFODataReg, FIFOLevelReg, ControlReg, the CRC results,
+ * the timer counter and the test registers.
+ */
+const uint8_t nfc_shadow_rw[NFC_REGISTERS] = {
+    [ComIEnReg >> 1] = 0xFF,
+    [DivIEnReg >> 1] = 0x94,        ///< IRQPushPull, MfinActIEn, CRCIEn
+    [Status2Reg >> 1] = 0xC8,       ///< TempSensClear, I2CForceHS, MFCrypto1On
+    [WaterLevelReg >> 1] = 0x3F,
+    [BitFramingReg >> 1] = 0xF7,    ///< StartSend, RxAlign, TxLastBits
+    [CollReg >> 1] = 0x80,          ///< ValuesAfterColl, the rest is the collision position
+    [ModeReg >> 1] = 0xFF,
+    [TxModeReg >> 1] = 0xFF,
+    [RxModeReg >> 1] = 0xFF,
+    [TxControlReg >> 1] = 0xFF,
+    [TxASKReg >> 1] = 0xFF,
+    [TxSelReg >> 1] = 0xFF,
+    [RxSelReg >> 1] = 0xFF,
+    [RxThresholdReg >> 1] = 0xFF,
+    [DemodReg >> 1] = 0xFF,
+    [MfTxReg >> 1] = 0xFF,
+    [MfRxReg >> 1] = 0xFF,
+    [ModWidthReg >> 1] = 0xFF,
+    [RFCfgReg >> 1] = 0xFF,
+    [GsNReg >> 1] = 0xFF,
+    [CWGsPReg >> 1] = 0xFF,
+    [ModGsPReg >> 1] = 0xFF,
+    [TModeReg >> 1] = 0xFF,
+    [TPrescalerReg >> 1] = 0xFF,
+    [TReloadRegH >> 1] = 0xFF,
+    [TReloadRegL >> 1] = 0xFF,
+};
+
+const uint8_t nfc_shadow_hw[NFC_REGISTERS] = {
+    [Status2Reg >> 1] = 0x08,       ///< MFCrypto1On is set by a successful MFAuthent
+};
+
+const uint32_t nfc_spi_rates[NFC_SPI_RATES] = {10000000, 8000000, 6000000, 4000000, 2000000, NFC_SPI_BAUD_SAFE};
+
 void nfc_init_as_spi(nfc_rfid_t *nfc, spi_inst_t *_spi, uint8_t sck, uint8_t mosi, uint8_t miso, uint8_t cs, uint8_t irq, uint8_t rst)
 {
     nfc->spi = _spi;
@@ -29,12 +70,26 @@ void nfc_init_as_spi(nfc_rfid_t *nfc, spi_inst_t *_spi, uint8_t sck, uint8_t mos
     nfc->pinout.irq = irq;
     nfc->pinout.rst = rst;
     nfc->userType = NONE;
-    nfc->timeCheck = 1000000; ///< 1s = 1000000 us
+    memset(&nfc->poll, 0, sizeof(nfc->poll));
+    memset(&nfc->pipe, 0, sizeof(nfc->pipe));
+    uid_cache_init(&nfc->cache, UID_CACHE_TTL_US, UID_REPEAT_COUNT);
+    nfc->poll.start = time_us_64();
+    nfc->poll.last = time_us_32();
+    nfc_poll_activity(nfc); ///< Sets timeCheck to the fast interval
     nfc->timer_irq = TIMER_IRQ_1;
     nfc->blockAddr = 1;
     nfc->sizeRead = 18;
 	nfc->tag.is_present = false;
 	nfc->check = true;
+    nfc->spi_stats.transactions = 0;
+    nfc->spi_stats.bytes = 0;
+    memset(&nfc->cmd, 0, sizeof(nfc->cmd));
+    nfc->crc_hw = false; ///< CRC_A calculated by the MCU
+    memset(&nfc->shadow, 0, sizeof(nfc->shadow));
+    memset(&nfc->link, 0, sizeof(nfc->link));
+    memset(&nfc->manifest, 0, sizeof(nfc->manifest));
+    memset(&nfc->codec, 0, sizeof(nfc->codec));
+    nfc->link.rate = NFC_SPI_BAUD_SAFE;
 
     nfc->spi = _spi;
     if (_spi == spi0){
@@ -62,11 +117,12 @@ void nfc_init_as_spi(nfc_rfid_t *nfc, spi_inst_t *_spi, uint8_t sck, uint8_t mos
     gpio_put(cs, 1); ///< Set the CS pin to high
 
     // Configuring the ARM Primecell Synchronous Serial Port (SSP)
-    uint baud = spi_init(_spi, 1000000); ///< Initialize the SPI bus with a speed of 4 Mbps
+    nfc->link.baud = spi_init(_spi, NFC_SPI_BAUD_SAFE); ///< 1 Mbps until nfc_spi_probe() selects the clock
     spi_set_format(_spi, 8, 0, 0, SPI_MSB_FIRST);
     gpio_set_function(sck,  GPIO_FUNC_SPI);
     gpio_set_function(mosi, GPIO_FUNC_SPI);
     gpio_set_function(miso, GPIO_FUNC_SPI);
+    spi_dma_init(&nfc->dma, _spi, cs);
 
     nfc_write(nfc, CommandReg, PCD_SoftReset); // Perform a soft reset
 
@@ -81,8 +137,7 @@ void nfc_init_as_spi(nfc_rfid_t *nfc, spi_inst_t *_spi, uint8_t sck, uint8_t mos
 	// TPrescaler_Hi are the four low bits in TModeReg. TPrescaler_Lo is TPrescalerReg.
     nfc_write(nfc, TModeReg, 0x80); ///< TAuto=1; timer starts automatically at the end of the transmission in all communication modes at all speeds
     nfc_write(nfc, TPrescalerReg, 0xA9); // TPreScaler = TModeReg[3..0]:TPrescalerReg, ie 0x0A9 = 169 => f_timer=40kHz, ie a timer period of 25μs.
-    nfc_write(nfc, TReloadRegH, 0x03); ///< Reload timer with 0x3E8 = 1000, ie 25ms before timeout.
-    nfc_write(nfc, TReloadRegL, 0xE8);
+    nfc_set_timeout(nfc, NFC_TIMEOUT_RELOAD); ///< Reload timer with 0x3E8 = 1000, ie 25ms before timeout.
 
     nfc_write(nfc, TxASKReg, 0x40); ///< Default 0x00. Force a 100 % ASK modulation independent of the ModGsPReg register setting
     nfc_write(nfc, ModeReg, 0x3D); // Default 0x3F. Set the preset value for the CRC coprocessor for the CalcCRC command to 0x6363 (ISO 14443-3 part 6.2.4)
@@ -99,7 +154,7 @@ void nfc_init_as_spi(nfc_rfid_t *nfc, spi_inst_t *_spi, uint8_t sck, uint8_t mos
     bi_decl(bi_2pins_with_func(PICO_DEFAULT_I2C_SDA_PIN, PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C));
 
     // Initialize the configuration of the MFRC522 (comment or uncomment the desired configuration)
-    // nfc_config_mfrc522_irq(nfc); // IRQ's configuration
+    nfc_config_mfrc522_irq(nfc); // IRQ's configuration
     // nfc_config_blocking(nfc);    // Blocking configuration
 }
 
@@ -113,6 +168,394 @@ bool nfc_is_new_tag(nfc_rfid_t *nfc)
     return (result == STATUS_OK || result == STATUS_COLLISION);
 }
 
+/**
+ * @brief Update the cadence of the polls with the result of a presence check.
+ * 
+ * @param nfc 
+ * @param card A card answered the REQA
+ * @param now time_us_32() when the poll started
+ */
+static void nfc_poll_update(nfc_rfid_t *nfc, bool card, uint32_t now)
+{
+    uint32_t since = now - nfc->poll.last;
+    nfc->poll.last = now;
+    nfc->poll.busy_us += time_us_32() - now;
+    if (card) {
+        nfc->poll.detections++;
+        nfc->poll.detect_sum_us += since;
+        if (since > nfc->poll.detect_max_us) {
+            nfc->poll.detect_max_us = since;
+        }
+        nfc_poll_activity(nfc);
+    }else if (now - nfc->poll.activity >= NFC_POLL_HOLD_US) { ///< Idle dock: back off
+        nfc->poll.interval = MIN(nfc->poll.interval * 2, NFC_POLL_MAX_US);
+        nfc->timeCheck = nfc->poll.interval;
+    }
+}
+
+/**
+ * @brief Start the command of a stage of the pipeline.
+ * 
+ * @param nfc 
+ * @param stage 
+ * @param command 
+ * @param waitIRq 
+ * @param len Bytes of pipe.frame to send
+ * @param validBits Bits of the last byte, 0 for 8
+ */
+static void nfc_pipe_begin(nfc_rfid_t *nfc, nfc_stage_t stage, uint8_t command, uint8_t waitIRq, uint8_t len, uint8_t validBits)
+{
+    nfc->pipe.stage = stage;
+    nfc->pipe.start = time_us_32();
+    nfc_command_start(nfc, command, waitIRq, nfc->pipe.frame, len, &validBits, 0);
+}
+
+/**
+ * @brief Send a REQA, with the short timeout of the presence check or the full one.
+ * 
+ * @param nfc 
+ * @param full 
+ */
+static void nfc_pipe_reqa(nfc_rfid_t *nfc, bool full)
+{
+    nfc->pipe.full = full;
+    nfc_set_timeout(nfc, full ? NFC_TIMEOUT_RELOAD : NFC_PRECHECK_RELOAD);
+    nfc_clear_reg_bitmask(nfc, CollReg, 0x80); // ValuesAfterColl=1 => Bits received after collision are cleared.
+    nfc->pipe.frame[0] = PICC_CMD_REQA;
+    nfc_pipe_begin(nfc, NFC_STAGE_REQA, PCD_Transceive, 0x30, 1, 7);
+}
+
+/**
+ * @brief Send the ANTICOLLISION of the current cascade level.
+ * 
+ * @param nfc 
+ */
+static void nfc_pipe_anticoll(nfc_rfid_t *nfc)
+{
+    nfc->pipe.frame[0] = PICC_CMD_SEL_CL1 + 2 * (nfc->pipe.level - 1); // 0x93, 0x95, 0x97
+    nfc->pipe.frame[1] = 0x20; // NVB: SEL and NVB only
+    nfc_pipe_begin(nfc, NFC_STAGE_ANTICOLL, PCD_Transceive, 0x30, 2, 0);
+}
+
+/**
+ * @brief Send a frame with its CRC_A.
+ * 
+ * @param nfc 
+ * @param stage 
+ * @param len Bytes of the frame without the CRC_A
+ */
+static void nfc_pipe_frame(nfc_rfid_t *nfc, nfc_stage_t stage, uint8_t len)
+{
+    nfc_crc_a(nfc->pipe.frame, len, &nfc->pipe.frame[len]);
+    nfc_pipe_begin(nfc, stage, PCD_Transceive, 0x30, len + 2, 0);
+}
+
+/**
+ * @brief Authenticate the sector of a block with key A.
+ * 
+ * @param nfc 
+ * @param block 
+ */
+static void nfc_pipe_auth(nfc_rfid_t *nfc, uint8_t block)
+{
+    uint8_t *frame = nfc->pipe.frame;
+    nfc->pipe.block = block;
+    nfc->manifest.auths++;
+    frame[0] = PICC_CMD_MF_AUTH_KEY_A;
+    frame[1] = block;
+    for (uint8_t i = 0; i < MF_KEY_SIZE; i++) {
+        frame[2 + i] = nfc->keyByte[i];
+    }
+    for (uint8_t i = 0; i < 4; i++) { // The last 4 bytes of the UID
+        frame[8 + i] = nfc->uid.uidByte[i + nfc->uid.size - 4];
+    }
+    nfc_pipe_begin(nfc, NFC_STAGE_AUTH, PCD_MFAuthent, 0x10, 12, 0);
+}
+
+/**
+ * @brief Read a range of pages of a Type 2 tag.
+ * 
+ * @param nfc 
+ * @param first 
+ * @param last 
+ */
+static void nfc_pipe_fast_read(nfc_rfid_t *nfc, uint8_t first, uint8_t last)
+{
+    nfc->pipe.block = first;
+    nfc->pipe.pages = last - first + 1;
+    nfc->pipe.frame[0] = PICC_CMD_UL_FAST_READ;
+    nfc->pipe.frame[1] = first;
+    nfc->pipe.frame[2] = last;
+    nfc_pipe_frame(nfc, NFC_STAGE_FAST_READ, 3);
+}
+
+/**
+ * @brief Pages of the next FAST_READ of the entries of a manifest: whole entries, at most NFC_FAST_READ_PAGES.
+ * 
+ * @param nfc 
+ * @return uint8_t 
+ */
+static uint8_t nfc_fast_read_pages(nfc_rfid_t *nfc)
+{
+    uint8_t entries = nfc->manifest.count - nfc->manifest.read;
+    if (entries > NFC_FAST_READ_PAGES / 4) {
+        entries = NFC_FAST_READ_PAGES / 4;
+    }
+    return entries * 4;
+}
+
+/**
+ * @brief Add the latency of a stage to its histogram.
+ * 
+ * @param nfc 
+ * @param stage 
+ * @param us 
+ */
+static void nfc_pipe_record(nfc_rfid_t *nfc, uint8_t stage, uint32_t us)
+{
+    uint8_t bucket = 0;
+    if (us >= 64) {
+        bucket = (uint8_t)(31 - __builtin_clz(us)) - 5; // 64-127 us -> 1, 128-255 us -> 2, ...
+        if (bucket >= NFC_HIST_BUCKETS) {
+            bucket = NFC_HIST_BUCKETS - 1;
+        }
+    }
+    if (nfc->pipe.hist[stage][bucket] < UINT16_MAX) {
+        nfc->pipe.hist[stage][bucket]++;
+    }
+}
+
+/**
+ * @brief Report the result of the pipeline. After a select the card is halted, otherwise
+ * the pipeline ends.
+ * 
+ * @param nfc 
+ * @param status 
+ * @param selected The card is selected (it must be halted)
+ */
+static void nfc_pipe_report(nfc_rfid_t *nfc, uint8_t status, bool selected)
+{
+    if (status == STATUS_OK) {
+        nfc->pipe.reads++;
+        nfc->pipe.last_us = time_us_32() - nfc->pipe.begin;
+        if (!nfc->pipe.cached) {
+            uint8_t type = nfc_tag_type(nfc);
+            nfc->pipe.type[type].reads++;
+            nfc->pipe.type[type].sum_us += nfc->pipe.last_us;
+            if (nfc->pipe.last_us > nfc->pipe.type[type].max_us) {
+                nfc->pipe.type[type].max_us = nfc->pipe.last_us;
+            }
+        }
+    }else if (status == STATUS_COLLISION) {
+        nfc->pipe.fallbacks++;
+    }
+    if (selected) { // The answer to HLTA is a timeout of 1 ms
+        nfc_set_timeout(nfc, NFC_PRECHECK_RELOAD);
+        nfc->pipe.frame[0] = PICC_CMD_HLTA;
+        nfc->pipe.frame[1] = 0;
+        nfc_pipe_frame(nfc, NFC_STAGE_HALT, 2);
+    }else {
+        nfc->pipe.stage = NFC_STAGE_IDLE;
+    }
+    if (nfc->pipe.done) {
+        nfc->pipe.done(nfc, status);
+    }
+}
+
+bool nfc_pipe_start(nfc_rfid_t *nfc, void (*done)(nfc_rfid_t *nfc, uint8_t status))
+{
+    if (nfc_pipe_busy(nfc) || nfc->pipe.host) {
+        return false;
+    }
+    nfc->pipe.done = done;
+    nfc->pipe.cached = false;
+    nfc->pipe.runs++;
+    nfc->pipe.begin = time_us_32();
+    nfc->poll.polls++;
+    nfc_pipe_reqa(nfc, false);
+    return true;
+}
+
+void nfc_pipe_step(nfc_rfid_t *nfc)
+{
+    uint8_t stage = nfc->pipe.stage;
+    if (stage == NFC_STAGE_IDLE || nfc_command_poll(nfc) == NFC_CMD_BUSY) {
+        return;
+    }
+    nfc_pipe_record(nfc, stage, time_us_32() - nfc->pipe.start);
+
+    uint8_t *frame = nfc->pipe.frame;
+    uint8_t len = sizeof(nfc->pipe.frame);
+    uint8_t validBits = 0;
+    uint8_t status;
+    switch (stage) {
+    case NFC_STAGE_REQA:
+        status = nfc_command_finish(nfc, frame, &len, &validBits, false);
+        if (status == STATUS_OK && (len != 2 || validBits != 0)) { // ATQA must be exactly 16 bits.
+            status = STATUS_ERROR;
+        }
+        if (status != STATUS_OK && status != STATUS_COLLISION && status != STATUS_TIMEOUT && !nfc->pipe.full) {
+            nfc->poll.full++; ///< Something is in the field: confirm with the full timeout
+            nfc_pipe_reqa(nfc, true);
+            return;
+        }
+        nfc_set_timeout(nfc, NFC_TIMEOUT_RELOAD);
+        nfc_poll_update(nfc, status == STATUS_OK || status == STATUS_COLLISION, nfc->pipe.begin);
+        if (status != STATUS_OK) { // Empty field, error, or several cards (the ATQA collides)
+            nfc_pipe_report(nfc, status, false);
+            return;
+        }
+        nfc->pipe.level = 1;
+        nfc->uid.size = 0;
+        nfc_pipe_anticoll(nfc);
+        return;
+
+    case NFC_STAGE_ANTICOLL:
+        status = nfc_command_finish(nfc, frame, &len, &validBits, false);
+        if (status == STATUS_OK && (len != 5 || (frame[0] ^ frame[1] ^ frame[2] ^ frame[3]) != frame[4])) {
+            status = STATUS_ERROR; // 4 bytes and the BCC
+        }
+        if (status != STATUS_OK) {
+            nfc_pipe_report(nfc, status, false);
+            return;
+        }
+        // SEL, NVB = 7 whole bytes, the 4 bytes and the BCC received
+        for (int8_t i = 4; i >= 0; i--) {
+            frame[i + 2] = frame[i];
+        }
+        frame[0] = PICC_CMD_SEL_CL1 + 2 * (nfc->pipe.level - 1);
+        frame[1] = 0x70;
+        nfc_pipe_frame(nfc, NFC_STAGE_SELECT, 7);
+        return;
+
+    case NFC_STAGE_SELECT: {
+        uint8_t uid[4] = {frame[2], frame[3], frame[4], frame[5]};
+        status = nfc_command_finish(nfc, frame, &len, &validBits, true);
+        if (status == STATUS_OK && len != 3) { // SAK and CRC_A
+            status = STATUS_ERROR;
+        }
+        if (status != STATUS_OK) {
+            nfc_pipe_report(nfc, status, false);
+            return;
+        }
+        bool cascade = (uid[0] == PICC_CMD_CT);
+        for (uint8_t i = cascade ? 1 : 0; i < 4; i++) {
+            nfc->uid.uidByte[nfc->uid.size++] = uid[i];
+        }
+        if ((frame[0] & 0x04) && nfc->pipe.level < 3) { // Cascade bit: UID not complete
+            nfc->pipe.level++;
+            nfc_pipe_anticoll(nfc);
+            return;
+        }
+        nfc->uid.sak = frame[0];
+        nfc->piccType = nfc_picc_type(frame[0]);
+        nfc->pipe.cached = nfc_cache_lookup(nfc, &nfc->pipe.hit);
+        if (nfc->pipe.cached) { // Seen recently: no authentication, no read
+            nfc_pipe_report(nfc, STATUS_OK, true);
+            return;
+        }
+        nfc->manifest.count = 0;
+        nfc->manifest.auths = 0;
+        if (nfc_tag_type(nfc) == NFC_TAG_TYPE2) { // No Crypto1: the data block is read at once
+            nfc_pipe_fast_read(nfc, NFC_T2_PAGE, NFC_T2_PAGE + 3);
+            return;
+        }
+        nfc_pipe_auth(nfc, nfc->blockAddr);
+        return;
+    }
+
+    case NFC_STAGE_AUTH:
+        status = nfc_command_finish(nfc, NULL, NULL, NULL, false);
+        if (status != STATUS_OK) {
+            nfc_pipe_report(nfc, status, true);
+            return;
+        }
+        frame[0] = PICC_CMD_MF_READ;
+        frame[1] = nfc->pipe.block;
+        nfc_pipe_frame(nfc, NFC_STAGE_READ, 2);
+        return;
+
+    case NFC_STAGE_READ:
+        if (!nfc->manifest.count) { // Data block: a box, a user, or the header of a manifest
+            nfc->sizeRead = sizeof(nfc->bufferRead);
+            status = nfc_command_finish(nfc, nfc->bufferRead, &nfc->sizeRead, &validBits, true);
+            nfc->manifest.count = status == STATUS_OK ? nfc_manifest_count(nfc->bufferRead) : 0;
+            nfc->manifest.read = 0;
+            if (!nfc->manifest.count) {
+                nfc_pipe_report(nfc, status, true);
+                return;
+            }
+        }else { // Entry of a manifest
+            uint8_t size = sizeof(nfc->manifest.rx);
+            status = nfc_command_finish(nfc, nfc->manifest.rx, &size, &validBits, true);
+            if (status != STATUS_OK) {
+                nfc_pipe_report(nfc, status, true);
+                return;
+            }
+            memcpy(nfc->manifest.raw[nfc->manifest.read++], nfc->manifest.rx, 16);
+            if (nfc->manifest.read == nfc->manifest.count) {
+                nfc_pipe_report(nfc, STATUS_OK, true);
+                return;
+            }
+        }
+        nfc->pipe.block = nfc_manifest_block(nfc->manifest.read);
+        if (!(nfc->pipe.block & 3)) { // First block of a sector
+            nfc_pipe_auth(nfc, nfc->pipe.block);
+        }else {
+            frame[0] = PICC_CMD_MF_READ;
+            frame[1] = nfc->pipe.block;
+            nfc_pipe_frame(nfc, NFC_STAGE_READ, 2);
+        }
+        return;
+
+    case NFC_STAGE_FAST_READ:
+        if (!nfc->manifest.count) { // Pages of the data block
+            nfc->sizeRead = sizeof(nfc->bufferRead);
+            status = nfc_command_finish(nfc, nfc->bufferRead, &nfc->sizeRead, &validBits, true);
+            if (status == STATUS_OK && nfc->sizeRead != 18) {
+                status = STATUS_ERROR;
+            }
+            nfc->manifest.count = status == STATUS_OK ? nfc_manifest_count(nfc->bufferRead) : 0;
+            nfc->manifest.read = 0;
+            if (!nfc->manifest.count) {
+                nfc_pipe_report(nfc, status, true);
+                return;
+            }
+        }else { // Pages of several entries of a manifest
+            uint8_t size = sizeof(nfc->manifest.rx);
+            status = nfc_command_finish(nfc, nfc->manifest.rx, &size, &validBits, true);
+            if (status == STATUS_OK && size != nfc->pipe.pages * 4 + 2) {
+                status = STATUS_ERROR;
+            }
+            if (status != STATUS_OK) {
+                nfc_pipe_report(nfc, status, true);
+                return;
+            }
+            for (uint8_t i = 0; i + 2 < size; i += 16) {
+                memcpy(nfc->manifest.raw[nfc->manifest.read++], &nfc->manifest.rx[i], 16);
+            }
+            if (nfc->manifest.read == nfc->manifest.count) {
+                nfc_pipe_report(nfc, STATUS_OK, true);
+                return;
+            }
+        }
+        nfc_pipe_fast_read(nfc, nfc_manifest_page(nfc->manifest.read),
+                           nfc_manifest_page(nfc->manifest.read) + nfc_fast_read_pages(nfc) - 1);
+        return;
+
+    case NFC_STAGE_HALT:
+        nfc_command_finish(nfc, NULL, NULL, NULL, false); // Only a timeout is a success, nothing to do otherwise
+        nfc_stop_crypto1(nfc);
+        nfc_set_timeout(nfc, NFC_TIMEOUT_RELOAD);
+        nfc->pipe.stage = NFC_STAGE_IDLE;
+        return;
+
+    default:
+        nfc->pipe.stage = NFC_STAGE_IDLE;
+        return;
+    }
+}
+
 uint8_t nfc_authenticate(nfc_rfid_t *nfc, uint8_t command, uint8_t blockAddr, uint8_t *keyByte, Uid *uid)
 {
     uint8_t waitIRq = 0x10; // IdleIRq
@@ -124,8 +567,8 @@ uint8_t nfc_authenticate(nfc_rfid_t *nfc, uint8_t command, uint8_t blockAddr, ui
 	for (uint8_t i = 0; i < MF_KEY_SIZE; i++) { // 6 key uint8_ts
 		sendData[2 + i] = keyByte[i];
 	}
-	for (uint8_t i = 0; i < 4; i++) { // The first 4 uint8_ts of the UID
-		sendData[8 + i] = nfc->uid.uidByte[i];
+	for (uint8_t i = 0; i < 4; i++) { // The last 4 uint8_ts of the UID (the UID of CL1 for 4-byte UIDs)
+		sendData[8 + i] = uid->uidByte[i + uid->size - 4];
 	}
     StatusCode status = nfc_communicate(nfc, PCD_MFAuthent, waitIRq, &sendData[0], sizeof(sendData), NULL, 0, 0, 0, false);
     return status;
@@ -370,6 +813,68 @@ uint8_t nfc_select(nfc_rfid_t *nfc, Uid *uid, uint8_t validBits)
 	return STATUS_OK;
 } // End of nfc_select
 
+uint8_t nfc_halt(nfc_rfid_t *nfc)
+{
+	StatusCode result;
+	uint8_t buffer[4];
+
+	// Build command buffer
+	buffer[0] = PICC_CMD_HLTA;
+	buffer[1] = 0;
+	// Calculate CRC_A
+	result = nfc_calculate_crc(nfc, buffer, 2, &buffer[2]);
+	if (result != STATUS_OK) {
+		return result;
+	}
+
+	// Send the command.
+	// The standard says:
+	//		If the PICC responds with any modulation during a period of 1 ms
+	// after the end of the frame containing the
+	//		HLTA command, this response shall be interpreted as 'not
+	// acknowledge'.
+	// We interpret that this way: Only STATUS_TIMEOUT is a success.
+	result = nfc_transceive_data(nfc, buffer, sizeof(buffer), NULL, 0, NULL, 0, false);
+	if (result == STATUS_TIMEOUT) {
+		return STATUS_OK;
+	}
+	if (result == STATUS_OK) { // That is ironically NOT ok in this case ;-)
+		return STATUS_ERROR;
+	}
+	return result;
+} // End of nfc_halt
+
+uint8_t nfc_inventory(nfc_rfid_t *nfc, bool (*card)(nfc_rfid_t *nfc, void *ctx), void *ctx)
+{
+	uint8_t cards = 0;
+	uint8_t bufferATQA[2];
+	uint8_t bufferSize;
+
+	// The first card was invited by nfc_is_new_tag(), the next ones are invited here.
+	// Each card is halted after it is processed, so it does not answer the next REQA.
+	for (uint8_t i = 0; i < NFC_INVENTORY_MAX; i++) {
+		if (i) {
+			bufferSize = sizeof(bufferATQA);
+			StatusCode status = nfc_requestA(nfc, bufferATQA, &bufferSize);
+			if (status != STATUS_OK && status != STATUS_COLLISION) { ///< No more cards in the field
+				break;
+			}
+		}
+		if (nfc_select(nfc, &nfc->uid, 0) != STATUS_OK) {
+			continue; ///< Noise or a card that left the field, try the next one
+		}
+		nfc->piccType = nfc_picc_type(nfc->uid.sak);
+		cards++;
+		bool more = card(nfc, ctx);
+		nfc_halt(nfc); ///< Still encrypted if the card was authenticated
+		nfc_stop_crypto1(nfc);
+		if (!more) {
+			break;
+		}
+	}
+	return cards;
+} // End of nfc_inventory
+
 uint8_t nfc_read_card(nfc_rfid_t *nfc, uint8_t blockAddr, uint8_t *buffer, uint8_t *bufferSize)
 {
     StatusCode result;
@@ -392,8 +897,139 @@ uint8_t nfc_read_card(nfc_rfid_t *nfc, uint8_t blockAddr, uint8_t *buffer, uint8
 	return nfc_transceive_data(nfc, buffer, 4, buffer, bufferSize, NULL, 0, true);
 }
 
-uint8_t nfc_communicate(nfc_rfid_t *nfc, uint8_t command, uint8_t waitIRq, uint8_t *sendData, uint8_t sendLen, 
-                        uint8_t *backData, uint8_t *backLen, uint8_t *validBits, uint8_t rxAlign, bool checkCRC)
+uint8_t nfc_mifare_transceive(nfc_rfid_t *nfc, uint8_t *data, uint8_t len)
+{
+	uint8_t back[2]; // The ACK or NAK, 4 bits
+	uint8_t backLen = sizeof(back);
+	uint8_t validBits = 0;
+
+	uint8_t result = nfc_calculate_crc(nfc, data, len, &data[len]);
+	if (result != STATUS_OK) {
+		return result;
+	}
+	result = nfc_transceive_data(nfc, data, len + 2, back, &backLen, &validBits, 0, false);
+	if (result != STATUS_OK) {
+		return result;
+	}
+	if (backLen != 1 || validBits != 4) {
+		return STATUS_ERROR;
+	}
+	if (back[0] != MF_ACK) {
+		return STATUS_MIFARE_NACK;
+	}
+	return STATUS_OK;
+}
+
+uint8_t nfc_write_card(nfc_rfid_t *nfc, uint8_t blockAddr, const uint8_t *data)
+{
+	uint8_t buffer[18];
+
+	// Step 1: the command and the address
+	buffer[0] = PICC_CMD_MF_WRITE;
+	buffer[1] = blockAddr;
+	uint8_t result = nfc_mifare_transceive(nfc, buffer, 2);
+	if (result != STATUS_OK) {
+		return result;
+	}
+
+	// Step 2: the data
+	memcpy(buffer, data, 16);
+	return nfc_mifare_transceive(nfc, buffer, 16);
+}
+
+uint8_t nfc_ul_write(nfc_rfid_t *nfc, uint8_t page, const uint8_t *data)
+{
+	uint8_t buffer[8];
+
+	buffer[0] = PICC_CMD_UL_WRITE;
+	buffer[1] = page;
+	memcpy(&buffer[2], data, 4);
+	return nfc_mifare_transceive(nfc, buffer, 6);
+}
+
+uint8_t nfc_fast_read(nfc_rfid_t *nfc, uint8_t first, uint8_t last, uint8_t *buffer, uint8_t *bufferSize)
+{
+	uint8_t pages = last - first + 1;
+
+	// Sanity check
+	if (buffer == NULL || last < first || pages > NFC_FAST_READ_PAGES || *bufferSize < pages * 4 + 2) {
+		return STATUS_NO_ROOM;
+	}
+
+	// Build command buffer
+	buffer[0] = PICC_CMD_UL_FAST_READ;
+	buffer[1] = first;
+	buffer[2] = last;
+	uint8_t result = nfc_calculate_crc(nfc, buffer, 3, &buffer[3]);
+	if (result != STATUS_OK) {
+		return result;
+	}
+
+	// Transmit the buffer and receive the response, validate CRC_A.
+	result = nfc_transceive_data(nfc, buffer, 5, buffer, bufferSize, NULL, 0, true);
+	if (result == STATUS_OK && *bufferSize != pages * 4 + 2) {
+		return STATUS_ERROR;
+	}
+	return result;
+}
+
+uint8_t nfc_read_manifest(nfc_rfid_t *nfc)
+{
+    uint8_t count = nfc_manifest_count(nfc->bufferRead);
+    if (nfc_tag_type(nfc) == NFC_TAG_TYPE2) {
+        for (uint8_t k = 0; k < count; k += NFC_FAST_READ_PAGES / 4) {
+            uint8_t entries = count - k < NFC_FAST_READ_PAGES / 4 ? count - k : NFC_FAST_READ_PAGES / 4;
+            uint8_t size = sizeof(nfc->manifest.rx);
+            uint8_t status = nfc_fast_read(nfc, nfc_manifest_page(k), nfc_manifest_page(k) + entries * 4 - 1,
+                                           nfc->manifest.rx, &size);
+            if (status != STATUS_OK) {
+                return status;
+            }
+            memcpy(nfc->manifest.raw[k], nfc->manifest.rx, entries * 16);
+        }
+        nfc->manifest.count = count;
+        nfc->manifest.read = count;
+        return STATUS_OK;
+    }
+    for (uint8_t k = 0; k < count; k++) {
+        uint8_t block = nfc_manifest_block(k);
+        uint8_t size = sizeof(nfc->manifest.rx);
+        uint8_t status;
+        if (!(block & 3)) { // First block of a sector
+            nfc->manifest.auths++;
+            status = nfc_authenticate(nfc, PICC_CMD_MF_AUTH_KEY_A, block, nfc->keyByte, &nfc->uid);
+            if (status != STATUS_OK) {
+                return status;
+            }
+        }
+        status = nfc_read_card(nfc, block, nfc->manifest.rx, &size);
+        if (status != STATUS_OK) {
+            return status;
+        }
+        memcpy(nfc->manifest.raw[k], nfc->manifest.rx, 16);
+    }
+    nfc->manifest.count = count;
+    nfc->manifest.read = count;
+    return STATUS_OK;
+}
+
+void nfc_config_mfrc522_irq(nfc_rfid_t *nfc)
+{
+    gpio_init(nfc->pinout.irq);
+    gpio_set_dir(nfc->pinout.irq, GPIO_IN);
+    gpio_pull_up(nfc->pinout.irq);
+
+    nfc_write(nfc, ComIEnReg, 0x80 | 0x31); ///< IRqInv=1 (active low), RxIEn, IdleIEn, TimerIEn
+    nfc_write(nfc, DivIEnReg, 0x80 | 0x04); ///< IRQPushPull=1, CRCIEn
+    nfc_write(nfc, ComIrqReg, 0x7F);        ///< Release the pin
+    nfc_write(nfc, DivIrqReg, 0x7F);
+    nfc->cmd.irq = false;
+    nfc->cmd.enabled = true;
+    gpio_set_irq_enabled_with_callback(nfc->pinout.irq, GPIO_IRQ_EDGE_FALL, true, gpioCallback);
+}
+
+void nfc_command_start(nfc_rfid_t *nfc, uint8_t command, uint8_t waitIRq, uint8_t *sendData, uint8_t sendLen,
+                       uint8_t *validBits, uint8_t rxAlign)
 {
     // Prepare values for BitFramingReg
     uint8_t txLastBits = validBits ? *validBits : 0;
@@ -401,42 +1037,72 @@ uint8_t nfc_communicate(nfc_rfid_t *nfc, uint8_t command, uint8_t waitIRq, uint8
 
     nfc_write(nfc, CommandReg, PCD_Idle);  // Stop any active command.
     nfc_write(nfc, ComIrqReg, 0x7F);       // Clear all seven interrupt request bits
+    nfc->cmd.irq = false;                  // The IRQ pin is released
     nfc_write(nfc, FIFOLevelReg, 0x80);    // FlushBuffer = 1, FIFO initialization
     nfc_write_mult(nfc, FIFODataReg, sendData, sendLen); // Write sendData to the FIFO
     nfc_write(nfc, BitFramingReg, bitFraming); // Bit adjustments
+    nfc->cmd.waitIRq = waitIRq;
+    nfc->cmd.rxAlign = rxAlign;
+    nfc->cmd.state = NFC_CMD_BUSY;
+    nfc->cmd.commands++;
+    nfc->cmd.start = time_us_32();
     nfc_write(nfc, CommandReg, command); // Execute the command
     if (command == PCD_Transceive) {
         nfc_set_reg_bitmask(nfc, BitFramingReg, 0x80); // StartSend=1, transmission of data starts
     }
-
     // In PCD_Init() we set the TAuto flag in TModeReg. This means the timer
 	// automatically starts when the PCD stops transmitting.
+}
 
+/**
+ * @brief End the command in progress.
+ * 
+ * @param nfc 
+ * @param status 
+ */
+static void nfc_command_done(nfc_rfid_t *nfc, uint8_t status)
+{
+    nfc->cmd.state = NFC_CMD_DONE;
+    nfc->cmd.status = status;
+    nfc->cmd.wait_us += time_us_32() - nfc->cmd.start;
+    if (status == STATUS_TIMEOUT) {
+        nfc->cmd.timeouts++;
+    }
+}
+
+nfc_cmd_state_t nfc_command_poll(nfc_rfid_t *nfc)
+{
+    if (nfc->cmd.state != NFC_CMD_BUSY) {
+        return (nfc_cmd_state_t)nfc->cmd.state;
+    }
+    bool expired = time_us_32() - nfc->cmd.start >= NFC_CMD_TIMEOUT_US;
+    if (nfc->cmd.enabled && !nfc->cmd.irq && !expired) {
+        return NFC_CMD_BUSY; ///< Nothing to read until the interrupt
+    }
+    nfc->cmd.irq = false;
+    nfc->cmd.polls++;
+    uint8_t n = nfc_read(nfc, ComIrqReg); // ComIrqReg[7..0] bits are: Set1 TxIRq RxIRq IdleIRq HiAlertIRq LoAlertIRq ErrIRq TimerIRq
+    if (n & nfc->cmd.waitIRq) { // One of the interrupts that signal success has been set.
+        nfc_command_done(nfc, STATUS_OK);
+    }else if (n & 0x01) { // Timer interrupt - nothing received in 25ms
+        nfc_command_done(nfc, STATUS_TIMEOUT);
+    }else if (expired) { // The emergency break. Communication with the MFRC522 might be down.
+        nfc_command_done(nfc, STATUS_TIMEOUT);
+    }
+    if (nfc->cmd.state == NFC_CMD_DONE && nfc->cmd.enabled) {
+        nfc_write(nfc, ComIrqReg, 0x7F); ///< Release the IRQ pin for the next command
+    }
+    return (nfc_cmd_state_t)nfc->cmd.state;
+}
+
+uint8_t nfc_command_finish(nfc_rfid_t *nfc, uint8_t *backData, uint8_t *backLen, uint8_t *validBits, bool checkCRC)
+{
     uint8_t n;
-	unsigned int i;
 
-    // Wait for the command to complete.
-	// In PCD_Init() we set the TAuto flag in TModeReg. This means the timer
-	// automatically starts when the PCD stops transmitting.
-	// Each iteration of the do-while-loop takes 17.86us.
-	i = 2000;
-	while (1) {
-		n = nfc_read(nfc, ComIrqReg); // ComIrqReg[7..0] bits are: Set1
-											   // TxIRq RxIRq IdleIRq HiAlertIRq
-											   // LoAlertIRq ErrIRq TimerIRq
-		if (n & waitIRq) { // One of the interrupts that signal success has been
-						   // set.
-			break;
-		}
-		if (n & 0x01) { // Timer interrupt - nothing received in 25ms
-			return STATUS_TIMEOUT;
-		}
-		if (--i == 0) { // The emergency break. If all other conditions fail we
-						// will eventually terminate on this one after 35.7ms.
-						// Communication with the MFRC522 might be down.
-			return STATUS_TIMEOUT;
-		}
-	}
+    nfc->cmd.state = NFC_CMD_IDLE;
+    if (nfc->cmd.status != STATUS_OK) {
+        return nfc->cmd.status;
+    }
 
     // Stop now if any errors except collisions were detected.
     uint8_t errorRegValue = nfc_read(nfc, ErrorReg); ///< ErrorReg[7..0] bits are: WrErr TempErr reserved BufferOvfl CollErr CRCErr ParityErr ProtocolErr
@@ -454,7 +1120,7 @@ uint8_t nfc_communicate(nfc_rfid_t *nfc, uint8_t command, uint8_t waitIRq, uint8
             return STATUS_NO_ROOM;
         }
         *backLen = n; ///< Number of bytes returned
-        nfc_read_mult(nfc, FIFODataReg, backData, n, rxAlign); ///< Get received data from FIFO
+        nfc_read_mult(nfc, FIFODataReg, backData, n, nfc->cmd.rxAlign); ///< Get received data from FIFO
         _validBits = nfc_read(nfc, ControlReg) & 0x07; ///< RxLastBits[2:0] indicates the number of valid bits in the last received byte. If this value is 000b, the whole byte is valid
         if (validBits) {
             *validBits = _validBits;
@@ -488,6 +1154,19 @@ uint8_t nfc_communicate(nfc_rfid_t *nfc, uint8_t command, uint8_t waitIRq, uint8
     }
 
     return STATUS_OK;
+}
+
+uint8_t nfc_communicate(nfc_rfid_t *nfc, uint8_t command, uint8_t waitIRq, uint8_t *sendData, uint8_t sendLen, 
+                        uint8_t *backData, uint8_t *backLen, uint8_t *validBits, uint8_t rxAlign, bool checkCRC)
+{
+    nfc_command_start(nfc, command, waitIRq, sendData, sendLen, validBits, rxAlign);
+    absolute_time_t deadline = make_timeout_time_us(NFC_CMD_TIMEOUT_US);
+    while (nfc_command_poll(nfc) == NFC_CMD_BUSY) {
+        if (nfc->cmd.enabled) {
+            best_effort_wfe_or_timeout(deadline); ///< Sleep until the IRQ pin or the emergency break
+        }
+    }
+    return nfc_command_finish(nfc, backData, backLen, validBits, checkCRC);
 } // End of nfc_communicate
 
 uint8_t nfc_requestA_or_wakeupA(nfc_rfid_t *nfc, uint8_t command, uint8_t *bufferATQA, uint8_t *bufferSize)
@@ -511,66 +1190,367 @@ uint8_t nfc_requestA_or_wakeupA(nfc_rfid_t *nfc, uint8_t command, uint8_t *buffe
     return STATUS_OK;
 } // End of nfc_requestA_or_wakeupA
 
+/**
+ * @brief CRC_A table: reflected polynomial x^16 + x^12 + x^5 + 1 (0x8408).
+ * 
+ */
+static const uint16_t nfc_crc_a_table[256] = {
+    0x0000, 0x1189, 0x2312, 0x329B, 0x4624, 0x57AD, 0x6536, 0x74BF,
+    0x8C48, 0x9DC1, 0xAF5A, 0xBED3, 0xCA6C, 0xDBE5, 0xE97E, 0xF8F7,
+    0x1081, 0x0108, 0x3393, 0x221A, 0x56A5, 0x472C, 0x75B7, 0x643E,
+    0x9CC9, 0x8D40, 0xBFDB, 0xAE52, 0xDAED, 0xCB64, 0xF9FF, 0xE876,
+    0x2102, 0x308B, 0x0210, 0x1399, 0x6726, 0x76AF, 0x4434, 0x55BD,
+    0xAD4A, 0xBCC3, 0x8E58, 0x9FD1, 0xEB6E, 0xFAE7, 0xC87C, 0xD9F5,
+    0x3183, 0x200A, 0x1291, 0x0318, 0x77A7, 0x662E, 0x54B5, 0x453C,
+    0xBDCB, 0xAC42, 0x9ED9, 0x8F50, 0xFBEF, 0xEA66, 0xD8FD, 0xC974,
+    0x4204, 0x538D, 0x6116, 0x709F, 0x0420, 0x15A9, 0x2732, 0x36BB,
+    0xCE4C, 0xDFC5, 0xED5E, 0xFCD7, 0x8868, 0x99E1, 0xAB7A, 0xBAF3,
+    0x5285, 0x430C, 0x7197, 0x601E, 0x14A1, 0x0528, 0x37B3, 0x263A,
+    0xDECD, 0xCF44, 0xFDDF, 0xEC56, 0x98E9, 0x8960, 0xBBFB, 0xAA72,
+    0x6306, 0x728F, 0x4014, 0x519D, 0x2522, 0x34AB, 0x0630, 0x17B9,
+    0xEF4E, 0xFEC7, 0xCC5C, 0xDDD5, 0xA96A, 0xB8E3, 0x8A78, 0x9BF1,
+    0x7387, 0x620E, 0x5095, 0x411C, 0x35A3, 0x242A, 0x16B1, 0x0738,
+    0xFFCF, 0xEE46, 0xDCDD, 0xCD54, 0xB9EB, 0xA862, 0x9AF9, 0x8B70,
+    0x8408, 0x9581, 0xA71A, 0xB693, 0xC22C, 0xD3A5, 0xE13E, 0xF0B7,
+    0x0840, 0x19C9, 0x2B52, 0x3ADB, 0x4E64, 0x5FED, 0x6D76, 0x7CFF,
+    0x9489, 0x8500, 0xB79B, 0xA612, 0xD2AD, 0xC324, 0xF1BF, 0xE036,
+    0x18C1, 0x0948, 0x3BD3, 0x2A5A, 0x5EE5, 0x4F6C, 0x7DF7, 0x6C7E,
+    0xA50A, 0xB483, 0x8618, 0x9791, 0xE32E, 0xF2A7, 0xC03C, 0xD1B5,
+    0x2942, 0x38CB, 0x0A50, 0x1BD9, 0x6F66, 0x7EEF, 0x4C74, 0x5DFD,
+    0xB58B, 0xA402, 0x9699, 0x8710, 0xF3AF, 0xE226, 0xD0BD, 0xC134,
+    0x39C3, 0x284A, 0x1AD1, 0x0B58, 0x7FE7, 0x6E6E, 0x5CF5, 0x4D7C,
+    0xC60C, 0xD785, 0xE51E, 0xF497, 0x8028, 0x91A1, 0xA33A, 0xB2B3,
+    0x4A44, 0x5BCD, 0x6956, 0x78DF, 0x0C60, 0x1DE9, 0x2F72, 0x3EFB,
+    0xD68D, 0xC704, 0xF59F, 0xE416, 0x90A9, 0x8120, 0xB3BB, 0xA232,
+    0x5AC5, 0x4B4C, 0x79D7, 0x685E, 0x1CE1, 0x0D68, 0x3FF3, 0x2E7A,
+    0xE70E, 0xF687, 0xC41C, 0xD595, 0xA12A, 0xB0A3, 0x8238, 0x93B1,
+    0x6B46, 0x7ACF, 0x4854, 0x59DD, 0x2D62, 0x3CEB, 0x0E70, 0x1FF9,
+    0xF78F, 0xE606, 0xD49D, 0xC514, 0xB1AB, 0xA022, 0x92B9, 0x8330,
+    0x7BC7, 0x6A4E, 0x58D5, 0x495C, 0x3DE3, 0x2C6A, 0x1EF1, 0x0F78,
+};
+
+void nfc_crc_a(const uint8_t *data, uint8_t len, uint8_t *result)
+{
+	uint16_t crc = 0x6363; // ISO 14443-3 part 6.2.4
+	for (uint8_t i = 0; i < len; i++) {
+		crc = (crc >> 8) ^ nfc_crc_a_table[(crc ^ data[i]) & 0xFF];
+	}
+	result[0] = crc & 0xFF; // Low byte first, as CRCResultRegL
+	result[1] = crc >> 8;
+}
+
 uint8_t nfc_calculate_crc(nfc_rfid_t *nfc, uint8_t *data, uint8_t len, uint8_t *result)
+{
+	if (!nfc->crc_hw) {
+		nfc_crc_a(data, len, result);
+		return STATUS_OK;
+	}
+	return nfc_calculate_crc_hw(nfc, data, len, result);
+}
+
+uint8_t nfc_calculate_crc_hw(nfc_rfid_t *nfc, uint8_t *data, uint8_t len, uint8_t *result)
 {
     nfc_write(nfc, CommandReg, PCD_Idle); // Stop any active command.
 	nfc_write(nfc, DivIrqReg, 0x04); // Clear the CRCIRq interrupt request bit
+	nfc->cmd.irq = false;
 	nfc_set_reg_bitmask(nfc, FIFOLevelReg, 0x80); // FlushBuffer = 1, FIFO initialization
 	nfc_write_mult(nfc, FIFODataReg, data, len); // Write data to the FIFO
 	nfc_write(nfc, CommandReg, PCD_CalcCRC); // Start the calculation
 
-	// Wait for the CRC calculation to complete. Each iteration of the
-	// while-loop takes 17.73�s.
-	uint16_t i = 5000;
+	// Wait for the CRC calculation to complete. With the IRQ pin configured, DivIrqReg is
+	// only read when the pin is asserted.
+	uint32_t start = time_us_32();
+	absolute_time_t deadline = make_timeout_time_us(NFC_CRC_TIMEOUT_US);
 	uint8_t n;
 	while (1) {
+		bool expired = time_us_32() - start >= NFC_CRC_TIMEOUT_US;
+		if (nfc->cmd.enabled && !nfc->cmd.irq && !expired) {
+			best_effort_wfe_or_timeout(deadline);
+			continue;
+		}
+		nfc->cmd.irq = false;
+		nfc->cmd.polls++;
 		n = nfc_read(nfc, DivIrqReg); // DivIrqReg[7..0] bits are: Set2 reserved reserved MfinActIRq reserved CRCIRq reserved reserved
 		if (n & 0x04) { // CRCIRq bit set - calculation done
 			break;
 		}
-		if (--i == 0) { // The emergency break. We will eventually terminate on
-						// this one after 89ms. Communication with the MFRC522
-						// might be down.
+		if (expired) { // The emergency break. Communication with the MFRC522
+					   // might be down.
+			nfc->cmd.timeouts++;
 			return STATUS_TIMEOUT;
 		}
 	}
+	nfc->cmd.wait_us += time_us_32() - start;
+	if (nfc->cmd.enabled) {
+		nfc_write(nfc, DivIrqReg, 0x04); // Release the IRQ pin
+	}
 	nfc_write(nfc, CommandReg, PCD_Idle); // Stop calculating CRC for new content in the FIFO.
 
 	// Transfer the result from the registers to the result buffer
 	result[0] = nfc_read(nfc, CRCResultRegL);
 	result[1] = nfc_read(nfc, CRCResultRegH);
 	return STATUS_OK;
-} // End of nfc_calculate_crc
+} // End of nfc_calculate_crc_hw
+
+/**
+ * @brief Check if VersionReg holds a known chip: MFRC522 v0.0, v1.0 and v2.0, and the FM17522 clones.
+ * 
+ * @param version 
+ * @return true 
+ * @return false 
+ */
+static bool nfc_version_known(uint8_t version)
+{
+    switch (version)
+    {
+    case 0x88:
+    case 0x89:
+    case 0x90:
+    case 0x91:
+    case 0x92:
+    case 0xB2:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Run the self-test rounds at the current clock.
+ * 
+ * @param nfc 
+ * @return uint16_t Failed rounds
+ */
+static uint16_t nfc_spi_selftest(nfc_rfid_t *nfc)
+{
+    static const uint8_t fixed[4] = {0x00, 0xFF, 0x55, 0xAA};
+    uint8_t pattern[NFC_PROBE_BYTES];
+    uint8_t back[NFC_PROBE_BYTES];
+    uint16_t errors = 0;
+
+    for (uint8_t r = 0; r < NFC_PROBE_ROUNDS; r++) {
+        if (nfc_read(nfc, VersionReg) != nfc->link.version) {
+            errors++;
+            continue;
+        }
+        for (uint8_t i = 0; i < NFC_PROBE_BYTES; i++) { ///< Stuck bits, then walking ones
+            pattern[i] = i < 4 ? fixed[i] : (uint8_t)((1u << (i & 7)) ^ (r * 0x11));
+        }
+        nfc_write(nfc, FIFOLevelReg, 0x80); ///< Flush the FIFO
+        nfc_write_mult(nfc, FIFODataReg, pattern, NFC_PROBE_BYTES);
+        if ((nfc_read(nfc, FIFOLevelReg) & 0x7F) != NFC_PROBE_BYTES) {
+            errors++;
+            continue;
+        }
+        nfc_read_mult(nfc, FIFODataReg, back, NFC_PROBE_BYTES, 0);
+        errors += memcmp(pattern, back, NFC_PROBE_BYTES) != 0;
+    }
+    nfc_write(nfc, FIFOLevelReg, 0x80);
+    return errors;
+}
+
+/**
+ * @brief Change the clock of the SPI.
+ * 
+ * @param nfc 
+ * @param rate Nominal clock
+ */
+static void nfc_spi_clock(nfc_rfid_t *nfc, uint32_t rate)
+{
+    nfc->link.rate = rate;
+    nfc->link.baud = spi_set_baudrate(nfc->spi, rate);
+}
+
+uint32_t nfc_spi_probe(nfc_rfid_t *nfc, uint32_t saved)
+{
+    memset(nfc->link.errors, 0, sizeof(nfc->link.errors));
+    nfc->link.saved = false;
+    nfc_spi_clock(nfc, NFC_SPI_BAUD_SAFE);
+    nfc->link.version = nfc_read(nfc, VersionReg);
+    if (!nfc_version_known(nfc->link.version)) {
+        printf("NFC SPI: unknown chip version 0x%02X, clock %u Hz\n", nfc->link.version, nfc->link.baud);
+        return 0;
+    }
+
+    for (uint8_t i = 0; saved && i < NFC_SPI_RATES; i++) {
+        if (nfc_spi_rates[i] != saved) {
+            continue;
+        }
+        nfc_spi_clock(nfc, saved);
+        nfc->link.errors[i] = nfc_spi_selftest(nfc);
+        if (!nfc->link.errors[i]) {
+            nfc->link.saved = true;
+            printf("NFC SPI: saved clock %u Hz verified, chip 0x%02X\n", nfc->link.baud, nfc->link.version);
+            return saved;
+        }
+        printf("NFC SPI: saved clock %u Hz failed %u/%u rounds, probing\n",
+               nfc->link.baud, nfc->link.errors[i], NFC_PROBE_ROUNDS);
+    }
+
+    for (uint8_t i = 0; i < NFC_SPI_RATES; i++) {
+        nfc_spi_clock(nfc, nfc_spi_rates[i]);
+        nfc->link.errors[i] = nfc_spi_selftest(nfc);
+        printf("NFC SPI: %u Hz, %u/%u rounds failed\n", nfc->link.baud, nfc->link.errors[i], NFC_PROBE_ROUNDS);
+        if (!nfc->link.errors[i]) {
+            printf("NFC SPI: clock %u Hz selected, chip 0x%02X\n", nfc->link.baud, nfc->link.version);
+            return nfc_spi_rates[i];
+        }
+    }
+    nfc_spi_clock(nfc, NFC_SPI_BAUD_SAFE);
+    printf("NFC SPI: self-test failed at every clock, kept %u Hz\n", nfc->link.baud);
+    return 0;
+}
+
+void nfc_print_stats(nfc_rfid_t *nfc)
+{
+    printf("NFC SPI: %u transactions, %u bytes, DMA %u transfers, clock %u Hz (%s), chip 0x%02X\n",
+           nfc->spi_stats.transactions, nfc->spi_stats.bytes, nfc->dma.stats.transfers,
+           nfc->link.baud, nfc->link.saved ? "saved" : "probed", nfc->link.version);
+    printf("NFC SPI self-test errors:");
+    for (uint8_t i = 0; i < NFC_SPI_RATES; i++) {
+        printf(" %u MHz %u", nfc_spi_rates[i] / 1000000, nfc->link.errors[i]);
+    }
+    printf("\n");
+    printf("NFC commands: %u, irqs %u, status polls %u, timeouts %u, wait %u us\n",
+           nfc->cmd.commands, nfc->cmd.irqs, nfc->cmd.polls, nfc->cmd.timeouts, nfc->cmd.wait_us);
+    uint64_t uptime = time_us_64() - nfc->poll.start;
+    printf("NFC polls: %u, full REQA %u, interval %u us, reader busy %" PRIu64 ".%02" PRIu64 "%%\n",
+           nfc->poll.polls, nfc->poll.full, nfc->poll.interval,
+           nfc->poll.busy_us * 100 / uptime, nfc->poll.busy_us * 10000 / uptime % 100);
+    printf("NFC detections: %u, time to detect max %u us, mean %" PRIu64 " us\n", nfc->poll.detections,
+           nfc->poll.detect_max_us, nfc->poll.detections ? nfc->poll.detect_sum_us / nfc->poll.detections : 0);
+    static const char *stages[NFC_STAGES] = {"", "REQA", "ANTICOLL", "SELECT", "AUTH", "READ", "FAST_READ", "HALT"};
+    printf("NFC pipeline: %u runs, %u reads (last %u us), %u collisions to the inventory loop\n",
+           nfc->pipe.runs, nfc->pipe.reads, nfc->pipe.last_us, nfc->pipe.fallbacks);
+    printf("%-10s <64us <128 <256 <512  <1ms  <2ms  <4ms  <8ms <16ms >16ms\n", "Stage");
+    for (uint8_t st = NFC_STAGE_REQA; st < NFC_STAGES; st++) {
+        printf("%-10s", stages[st]);
+        for (uint8_t b = 0; b < NFC_HIST_BUCKETS; b++) {
+            printf(" %5u", nfc->pipe.hist[st][b]);
+        }
+        printf("\n");
+    }
+    static const char *types[NFC_TAG_TYPES] = {"Classic", "Type 2"};
+    for (uint8_t t = 0; t < NFC_TAG_TYPES; t++) {
+        printf("NFC %s reads: %u, mean %" PRIu64 " us, max %u us\n", types[t], nfc->pipe.type[t].reads,
+               nfc->pipe.type[t].reads ? nfc->pipe.type[t].sum_us / nfc->pipe.type[t].reads : 0, nfc->pipe.type[t].max_us);
+    }
+    printf("NFC manifests: %u, %u entries, %u authentications, decode max %u us\n",
+           nfc->manifest.manifests, nfc->manifest.total, nfc->manifest.total_auths, nfc->manifest.decode_max_us);
+    printf("NFC coded tags: %u decoded, rejected:", nfc->codec.decoded);
+    for (uint8_t st = TAG_BAD_VERSION; st < TAG_STATUSES; st++) {
+        printf(" %s %u", tag_status_name[st], nfc->codec.rejected[st]);
+    }
+    printf("\n");
+    uid_cache_print_stats(&nfc->cache);
+    printf("NFC shadow: %u hits, %u misses, %u mismatches\n",
+           nfc->shadow.hits, nfc->shadow.misses, nfc->shadow.mismatches);
+}
+
+/**
+ * @brief Count the result of the decode of a coded block.
+ * 
+ * @param nfc 
+ * @param status tag_status_t
+ * @return true if the block is valid
+ */
+static bool nfc_codec_count(nfc_rfid_t *nfc, uint8_t status)
+{
+    nfc->codec.last = status;
+    if (status == TAG_OK) {
+        nfc->codec.decoded++;
+        return true;
+    }
+    nfc->codec.rejected[status]++;
+    return false;
+}
+
+/**
+ * @brief Decode the entries of a manifest from manifest.raw.
+ * 
+ * @param nfc 
+ * @return true if every entry is a valid box
+ */
+static bool nfc_get_manifest(nfc_rfid_t *nfc)
+{
+    for (uint8_t k = 0; k < nfc->manifest.count; k++) {
+        tag_t *e = &nfc->manifest.entries[k];
+        if (!nfc_codec_count(nfc, tag_decode(nfc->manifest.raw[k], e))) {
+            return false;
+        }
+        if (!e->code) { ///< No product code
+            nfc->codec.last = TAG_RANGE;
+            return false;
+        }
+        e->is_present = true;
+    }
+    return true;
+}
 
 bool nfc_get_data_tag(nfc_rfid_t *nfc)
 {
-    // The first byte of bufferRead is the product ID.
-    nfc->tag.id = nfc->bufferRead[15];
-	printf("ID: %02x\n", nfc->tag.id);
+    nfc->manifest.n = 0;
+    uint32_t start = time_us_32();
+    uint8_t status = tag_decode(nfc->bufferRead, &nfc->tag);
+    if (status != TAG_NOT_CODED && !nfc_codec_count(nfc, status)) {
+        nfc->tag.is_present = false;
+        return false;
+    }
+
+    // The last byte of bufferRead is the kind of a legacy tag.
+    if (status == TAG_NOT_CODED) {
+        nfc->codec.last = TAG_NOT_CODED;
+        nfc->tag.id = nfc->bufferRead[15];
+    }
 
 	// From the ID, we can determine the type of the user
 	if (nfc->tag.id == 0x07) {
 		nfc->userType = ADMIN;
 	} else if (nfc->tag.id == 0x06) {
 		nfc->userType = INV;
-	} else if (nfc->tag.id == 0x01 || nfc->tag.id == 0x02 || nfc->tag.id == 0x03 || nfc->tag.id == 0x04 || nfc->tag.id == 0x05) {
+	} else if (status == TAG_NOT_CODED && nfc->tag.id == NFC_MANIFEST_ID) {
+		// The entries were read by the pipeline or by nfc_read_manifest()
+		if (!nfc_manifest_count(nfc->bufferRead) || nfc->manifest.read != nfc->manifest.count) {
+			nfc->codec.last = TAG_BAD_LENGTH;
+			nfc->tag.is_present = false;
+			return false;
+		}
+		if (!nfc_get_manifest(nfc)) {
+			nfc->tag.is_present = false;
+			return false;
+		}
+		nfc->manifest.n = nfc->manifest.count;
+		nfc->tag = nfc->manifest.entries[nfc->manifest.n - 1];
 		nfc->userType = USER;
-		nfc->tag.amount = (nfc->bufferRead[11] << 24) | (nfc->bufferRead[12] << 16) | (nfc->bufferRead[13] << 8) | nfc->bufferRead[14];
-		nfc->tag.purchase_v = (nfc->bufferRead[7] << 24) | (nfc->bufferRead[8] << 16) | (nfc->bufferRead[9] << 8) | nfc->bufferRead[10];
-		nfc->tag.sale_v = (nfc->bufferRead[3] << 24) | (nfc->bufferRead[4] << 16) | (nfc->bufferRead[5] << 8) | nfc->bufferRead[6];
+		nfc->manifest.decode_us = time_us_32() - start;
+		nfc->manifest.manifests++;
+		nfc->manifest.total += nfc->manifest.n;
+		nfc->manifest.total_auths += nfc->manifest.auths;
+		if (nfc->manifest.decode_us > nfc->manifest.decode_max_us) {
+			nfc->manifest.decode_max_us = nfc->manifest.decode_us;
+		}
+		return true; ///< Not cached: the cache keeps one tag per card
+	} else {
+		if (status == TAG_NOT_CODED) {
+			// Product code in bytes 1-2. Legacy tags leave them at zero and store the product (1-5) in byte 15.
+			nfc->tag.code = (nfc->bufferRead[1] << 8) | nfc->bufferRead[2];
+			if (!nfc->tag.code) {
+				nfc->tag.code = nfc->tag.id;
+			}
+			nfc->tag.amount = (nfc->bufferRead[11] << 24) | (nfc->bufferRead[12] << 16) | (nfc->bufferRead[13] << 8) | nfc->bufferRead[14];
+			nfc->tag.purchase_v = (nfc->bufferRead[7] << 24) | (nfc->bufferRead[8] << 16) | (nfc->bufferRead[9] << 8) | nfc->bufferRead[10];
+			nfc->tag.sale_v = (nfc->bufferRead[3] << 24) | (nfc->bufferRead[4] << 16) | (nfc->bufferRead[5] << 8) | nfc->bufferRead[6];
+		}
 
-		if ((nfc->tag.amount >> 31) | (nfc->tag.purchase_v >> 31) | (nfc->tag.sale_v >> 31)) { ///< Negative values
+		if (!nfc->tag.code || (nfc->tag.amount >> 31) | (nfc->tag.purchase_v >> 31) | (nfc->tag.sale_v >> 31)) { ///< Invalid code or negative values
+			nfc->codec.last = TAG_RANGE;
 			nfc->tag.is_present = false;
 			return false;
 		}
-		printf("Amount: %u\n", nfc->tag.amount);
-		printf("Purchase value: %u\n", nfc->tag.purchase_v);
-		printf("Sale value: %u\n", nfc->tag.sale_v);
-	} else { ///< Invalid ID
-		nfc->tag.is_present = false;
-		return false;
+		nfc->userType = USER;
 	}
 
+	nfc->manifest.decode_us = time_us_32() - start;
+	uid_cache_put(&nfc->cache, &nfc->uid, &nfc->tag, nfc->userType, time_us_64());
 	return true;
 } // End of nfc_get_data_tag
-
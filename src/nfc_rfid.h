@@ -12,22 +12,89 @@
 #define __NFC_RFID_
 
 #include <stdint.h>
+#include <stdio.h>
 #include "hardware/spi.h"
 #include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
 
 #include "nfc_enums.h"
+#include "spi_dma.h"
+#include "uid_cache.h"
+#include "tag_codec.h"
 
 #define ADDRESS_SLAVE_MFRC522 0x28  ///< 0b0101 -> 0010 1000
 #define MF_KEY_SIZE             6	///< A Mifare Crypto1 key is 6 bytes.
 #define READ_BIT 0x80 ///< Bit used in I2C to read a register
 #define BUFFER_SIZE  1 ///< Buffer size for the SPI communication
+#define NFC_INVENTORY_MAX 8 ///< Maximum number of cards processed in one inventory pass
+#define NFC_BURST_MAX 64 ///< Maximum bytes of a burst transfer (size of the MFRC522 FIFO)
+#define NFC_CMD_TIMEOUT_US 36000 ///< Emergency break of a command, the chip timer stops it after 25 ms
+#define NFC_CRC_TIMEOUT_US 90000 ///< Emergency break of a CRC calculation
+#define NFC_REGISTERS 64 ///< Registers of the MFRC522
+#define NFC_POLL_MIN_US 75000   ///< Poll interval right after an activity
+#define NFC_POLL_MAX_US 1000000 ///< Poll interval when the dock is idle
+#define NFC_POLL_HOLD_US 3000000 ///< Time at the fast interval after an activity, then it doubles on each empty poll
+#define NFC_TIMEOUT_RELOAD 1000 ///< Chip timer reload of the commands: 1000 x 25 us = 25 ms
+#define NFC_PRECHECK_RELOAD 40  ///< Chip timer reload of the presence check: 1 ms, the ATQA comes after ~100 us
+#define NFC_HIST_BUCKETS 10     ///< Latency buckets of a stage: < 64 us, < 128 us, ..., >= 16 ms
+#define NFC_SPI_BAUD_SAFE 1000000 ///< SPI clock of the init, every module works at it
+#define NFC_SPI_RATES 6         ///< Candidate SPI clocks of the self-test
+#define NFC_PROBE_ROUNDS 16     ///< Self-test rounds of a candidate clock
+#define NFC_PROBE_BYTES 16      ///< Pattern written to the FIFO and read back in each round
+#define NFC_MANIFEST_ID 0x4D    ///< Kind of tag (byte 15 of the data block) of a manifest of a mixed box
+#define NFC_MANIFEST_SECTOR 1   ///< First sector of the entries of a manifest
+#define NFC_MANIFEST_MAX 12     ///< Entries of a manifest: the three data blocks of sectors 1-4
+#define NFC_T2_PAGE 4           ///< First user page of a Type 2 tag: the data block is pages 4-7
+#define NFC_FAST_READ_PAGES 12  ///< Pages of a FAST_READ: the answer and its CRC_A fit in the FIFO
+// #define NFC_SHADOW_CHECK ///< Debug: read the register anyway and compare it with its shadow
+
+extern const uint8_t nfc_shadow_rw[NFC_REGISTERS]; ///< Writable bits of the cached registers, 0 if the register is not cached
+extern const uint8_t nfc_shadow_hw[NFC_REGISTERS]; ///< Writable bits that the chip changes by itself
+extern const uint32_t nfc_spi_rates[NFC_SPI_RATES]; ///< Candidate SPI clocks, the fastest first
+
+/**
+ * \typedef nfc_cmd_state_t
+ * \brief State of the command executed by the MFRC522.
+ */
+typedef enum {
+    NFC_CMD_IDLE,   ///< No command started
+    NFC_CMD_BUSY,   ///< Waiting for the completion
+    NFC_CMD_DONE    ///< Completed, nfc_command_finish() gets the result
+} nfc_cmd_state_t;
+
+/**
+ * \typedef nfc_tag_type_t
+ * \brief Families of tags, by the way they are read.
+ */
+typedef enum {
+    NFC_TAG_CLASSIC,    ///< MIFARE Classic: authentication of each sector, READ of each block
+    NFC_TAG_TYPE2,      ///< NTAG21x, Ultralight EV1 (SAK 0x00): FAST_READ of a page range
+    NFC_TAG_TYPES
+} nfc_tag_type_t;
+
+/**
+ * \typedef nfc_stage_t
+ * \brief Stages of the tag read pipeline, each one is a command of the MFRC522.
+ */
+typedef enum {
+    NFC_STAGE_IDLE,     ///< No read in progress
+    NFC_STAGE_REQA,     ///< Presence check (short timeout), then full REQA if the field is disturbed
+    NFC_STAGE_ANTICOLL, ///< ANTICOLLISION of the current cascade level
+    NFC_STAGE_SELECT,   ///< SELECT of the current cascade level
+    NFC_STAGE_AUTH,     ///< MFAuthent with key A
+    NFC_STAGE_READ,     ///< READ of the data block, then the tag is reported
+    NFC_STAGE_FAST_READ,///< FAST_READ of the pages of a Type 2 tag, no authentication
+    NFC_STAGE_HALT,     ///< HLTA and stop of the crypto unit
+    NFC_STAGES
+} nfc_stage_t;
 
 
 /**
  * \typedef nfc_rfic_t
  * \brief Data strcuture to manage the NFC RFID device.
  */
-typedef struct
+typedef struct nfc_rfid
 {
     struct {
         uint8_t irq;
@@ -39,16 +106,19 @@ typedef struct
     }pinout;
 	
     uint8_t keyByte[MF_KEY_SIZE]; ///< Mifare Crypto1 key	
-    uint32_t timeCheck; ///< Time check (1s)
+    uint32_t timeCheck; ///< Interval of the check tag alarm (us), adapted by nfc_poll()
     bool check; ///< Check flag
     uint8_t timer_irq; ///< Alarm timer IRQ number (TIMER_IRQ_1)
 
     uint8_t spi_irq; ///< SPI IRQ number (25 or 26)
     spi_inst_t *spi; ///< SPI instance
+    spi_dma_t dma; ///< DMA engine of the FIFO transfers
 
     uint8_t Tx_Buf[BUFFER_SIZE];
 	uint8_t Rx_Buf[BUFFER_SIZE];
     Uid uid; ///< UID of the tag
+    PICC_Type piccType; ///< Type of the selected tag, from its SAK
+    bool crc_hw; ///< CRC_A calculated by the MFRC522 coprocessor instead of the MCU (fallback)
     tag_t tag; ///< Tag data
 
     uint8_t bufferRead[18]; ///< Buffer for the read data
@@ -56,7 +126,106 @@ typedef struct
     uint8_t blockAddr; ///< Block address
 
     enum {NONE, ADMIN, INV, USER} userType;
-    
+    uid_cache_t cache; ///< Cards seen recently, with their decoded tag
+
+    struct {
+        volatile bool irq;  ///< The IRQ pin of the MFRC522 was asserted
+        bool enabled;       ///< Completion signalled by the IRQ pin, ComIrqReg is polled otherwise
+        uint8_t state;      ///< nfc_cmd_state_t
+        uint8_t status;     ///< StatusCode of the completion
+        uint8_t waitIRq;    ///< ComIrqReg bits that signal the completion
+        uint8_t rxAlign;    ///< Bit position of the first bit received
+        uint32_t start;     ///< time_us_32() when the command started
+
+        uint32_t commands;  ///< Commands executed
+        uint32_t irqs;      ///< Interrupts of the IRQ pin
+        uint32_t polls;     ///< Reads of ComIrqReg/DivIrqReg
+        uint32_t timeouts;  ///< Commands stopped by the chip timer or the emergency break
+        uint32_t wait_us;   ///< Time waiting for the completions, the core is free (irq) or busy polling
+    } cmd;
+
+    struct {
+        uint32_t interval;  ///< Current interval between polls (us)
+        uint32_t activity;  ///< time_us_32() of the last activity (card detected, key pressed)
+        uint32_t last;      ///< time_us_32() of the previous poll
+        uint64_t start;     ///< time_us_64() at init, for the duty cycle
+        uint64_t busy_us;   ///< Time the reader spent polling
+
+        uint32_t polls;     ///< Presence checks
+        uint32_t full;      ///< Presence checks repeated as a full REQA (field disturbed, no clean answer)
+        uint32_t detections; ///< Cards detected
+        uint32_t detect_max_us; ///< Worst time to detect: time since the previous poll when a card answered
+        uint64_t detect_sum_us; ///< Sum of the times to detect
+    } poll; ///< Adaptive polling of the dock
+
+    struct {
+        volatile uint8_t stage; ///< nfc_stage_t
+        volatile bool host; ///< The main loop is using the chip, no pipeline can start
+        bool full;          ///< The REQA stage is the full one
+        bool cached;        ///< The card was found in the cache: no authentication and no read
+        uid_entry_t hit;    ///< Copy of the cache entry of the card
+        uint8_t level;      ///< Cascade level of the anticollision (1-3)
+        uint8_t block;      ///< Block of the current AUTH or READ stage, first page of a FAST_READ
+        uint8_t pages;      ///< Pages of the current FAST_READ stage
+        uint8_t frame[12];  ///< Frame of the current stage
+        uint32_t start;     ///< time_us_32() when the stage started
+        uint32_t begin;     ///< time_us_32() when the pipeline started
+        uint32_t last_us;   ///< Time from the REQA to the report of the last tag read
+        void (*done)(struct nfc_rfid *nfc, uint8_t status); ///< Report of the read (interrupt context)
+
+        uint32_t runs;      ///< Pipelines started
+        uint32_t reads;     ///< Tags read
+        uint32_t fallbacks; ///< Collisions left to nfc_inventory()
+        struct {
+            uint32_t reads;     ///< Tags read (not cached)
+            uint32_t max_us;    ///< Worst time from the REQA to the report
+            uint64_t sum_us;    ///< Sum of the times from the REQA to the report
+        } type[NFC_TAG_TYPES]; ///< Read latency of each family of tags
+        uint16_t hist[NFC_STAGES][NFC_HIST_BUCKETS]; ///< Latency histogram of each stage
+    } pipe; ///< Tag read pipeline, driven by the IRQ pin
+
+    struct {
+        uint8_t value[NFC_REGISTERS]; ///< Last value written or read, writable bits only
+        uint64_t valid;     ///< Registers whose shadow is known
+        uint32_t hits;      ///< Read-modify-write operations served by the shadow
+        uint32_t misses;    ///< Read-modify-write operations that read the chip
+        uint32_t mismatches; ///< Differences found by NFC_SHADOW_CHECK
+    } shadow; ///< Write-through shadow of the configuration registers
+
+    struct {
+        uint32_t transactions; ///< SPI transactions (CS windows)
+        uint32_t bytes;        ///< Bytes clocked on the SPI bus, address bytes included
+    } spi_stats;
+
+    struct {
+        uint32_t rate;      ///< Nominal clock in use (one of nfc_spi_rates)
+        uint32_t baud;      ///< Actual clock of the SPI (divider of clk_peri)
+        uint8_t version;    ///< VersionReg read at the safe clock
+        bool saved;         ///< The saved clock passed the self-test, no probing
+        uint16_t errors[NFC_SPI_RATES]; ///< Failed rounds of each candidate tested
+    } link; ///< Result of the SPI self-test
+
+    struct {
+        uint8_t count;      ///< Entries announced by the header block, 0 while it is not read
+        uint8_t read;       ///< Entry blocks read
+        uint8_t n;          ///< Entries decoded, 0 if the last tag was not a manifest
+        uint8_t rx[NFC_FAST_READ_PAGES * 4 + 2]; ///< Entry blocks being read, with the CRC_A
+        uint8_t raw[NFC_MANIFEST_MAX][16]; ///< Entry blocks (coded blocks, see tag_codec.h)
+        tag_t entries[NFC_MANIFEST_MAX]; ///< Decoded entries, the last one is also the tag
+        uint8_t auths;      ///< Authentications to read the last tag
+        uint32_t decode_us; ///< Time to decode the last tag
+
+        uint32_t manifests; ///< Manifests decoded
+        uint32_t total;     ///< Entries of the manifests decoded
+        uint32_t total_auths; ///< Authentications of the manifests decoded
+        uint32_t decode_max_us; ///< Worst time to decode a manifest
+    } manifest; ///< Manifest of a mixed box: one (product, amount, prices) entry per block
+
+    struct {
+        uint32_t decoded;   ///< Coded blocks accepted
+        uint32_t rejected[TAG_STATUSES]; ///< Coded blocks rejected, by reason
+        uint8_t last;       ///< Result of the last nfc_get_data_tag() (tag_status_t), TAG_NOT_CODED for a valid legacy tag
+    } codec; ///< Decodes of coded blocks (tag_codec.h)
     
 }nfc_rfid_t;
 
@@ -86,6 +255,53 @@ void nfc_init_as_spi(nfc_rfid_t *nfc, spi_inst_t *_spi, uint8_t sck, uint8_t mos
  */
 bool nfc_is_new_tag(nfc_rfid_t *nfc);
 
+/**
+ * @brief Start the tag read pipeline: REQA (presence check), anticollision and select of each
+ * cascade level, authentication and block read (FAST_READ of the pages of a Type 2 tag) and halt.
+ * Each stage starts the next one from nfc_pipe_step() when the chip signals its completion,
+ * without the main loop. The done callback gets STATUS_OK with the block in bufferRead,
+ * STATUS_TIMEOUT if the field is empty, STATUS_COLLISION if there are several cards (left to
+ * nfc_inventory()) or an error.
+ * The interval of the next poll is left in nfc->timeCheck.
+ * 
+ * @param nfc 
+ * @param done Report of the read (interrupt context)
+ * @return true if the pipeline was started, false if it is busy or the main loop has the chip
+ */
+bool nfc_pipe_start(nfc_rfid_t *nfc, void (*done)(nfc_rfid_t *nfc, uint8_t status));
+
+/**
+ * @brief Advance the pipeline. Call it from the IRQ pin interrupt, and periodically as the
+ * emergency break (or as the only driver without the IRQ pin).
+ * 
+ * @param nfc 
+ */
+void nfc_pipe_step(nfc_rfid_t *nfc);
+
+/**
+ * @brief Check if a pipeline is running.
+ * 
+ * @param nfc 
+ * @return true 
+ * @return false 
+ */
+static inline bool nfc_pipe_busy(nfc_rfid_t *nfc)
+{
+    return nfc->pipe.stage != NFC_STAGE_IDLE;
+}
+
+/**
+ * @brief Register an activity at the dock: the next polls use the fast interval.
+ * 
+ * @param nfc 
+ */
+static inline void nfc_poll_activity(nfc_rfid_t *nfc)
+{
+    nfc->poll.activity = time_us_32();
+    nfc->poll.interval = NFC_POLL_MIN_US;
+    nfc->timeCheck = NFC_POLL_MIN_US;
+}
+
 /**
  * @brief 
  * Executes the MFRC522 MFAuthent command.
@@ -112,6 +328,54 @@ uint8_t nfc_authenticate(nfc_rfid_t *nfc, uint8_t command, uint8_t blockAddr, ui
  */
 uint8_t nfc_select(nfc_rfid_t *nfc, Uid *uid, uint8_t validBits);
 
+/**
+ * @brief Instructs a PICC in state ACTIVE(*) to go to state HALT.
+ * 
+ * @param nfc 
+ * @return uint8_t STATUS_OK on success, STATUS_??? otherwise.
+ */
+uint8_t nfc_halt(nfc_rfid_t *nfc);
+
+/**
+ * @brief Process every card in the field: select one (anticollision), call the card callback,
+ * halt it and invite the remaining ones with a new REQA, until no card answers.
+ * The cards must be in state READY: call nfc_is_new_tag() first, or use it after the pipeline
+ * reports a collision.
+ * 
+ * @param nfc 
+ * @param card Called with the card selected (nfc->uid, nfc->piccType), returns false to stop
+ * @param ctx Context passed to the callback
+ * @return uint8_t Number of cards selected
+ */
+uint8_t nfc_inventory(nfc_rfid_t *nfc, bool (*card)(nfc_rfid_t *nfc, void *ctx), void *ctx);
+
+/**
+ * @brief Translates the SAK (Select Acknowledge) to a PICC type.
+ * 
+ * @param sak The SAK byte returned from nfc_select()
+ * @return PICC_Type 
+ */
+static inline PICC_Type nfc_picc_type(uint8_t sak)
+{
+	// http://www.nxp.com/documents/application_note/AN10833.pdf
+	// 3.2 Coding of Select Acknowledge (SAK)
+	// ignore 8-bit (iso14443 starts with LSBit = bit 1)
+	// fixes wrong type for manufacturer Infineon (http://nfc-tools.org/index.php?title=ISO14443A)
+	switch (sak & 0x7F) {
+	case 0x04:	return PICC_TYPE_NOT_COMPLETE;	// UID not complete
+	case 0x09:	return PICC_TYPE_MIFARE_MINI;
+	case 0x08:	return PICC_TYPE_MIFARE_1K;
+	case 0x18:	return PICC_TYPE_MIFARE_4K;
+	case 0x00:	return PICC_TYPE_MIFARE_UL;
+	case 0x10:
+	case 0x11:	return PICC_TYPE_MIFARE_PLUS;
+	case 0x01:	return PICC_TYPE_TNP3XXX;
+	case 0x20:	return PICC_TYPE_ISO_14443_4;
+	case 0x40:	return PICC_TYPE_ISO_18092;
+	default:	return PICC_TYPE_UNKNOWN;
+	}
+}
+
 /**
  * @brief Reads a block of data from the active PICC.
  * 
@@ -123,6 +387,106 @@ uint8_t nfc_select(nfc_rfid_t *nfc, Uid *uid, uint8_t validBits);
  */
 uint8_t nfc_read_card(nfc_rfid_t *nfc, uint8_t blockAddr, uint8_t *buffer, uint8_t *bufferSize);
 
+/**
+ * @brief Send a frame of the MIFARE protocol with its CRC_A and check the 4-bit ACK of the card.
+ * 
+ * @param nfc 
+ * @param data Frame, with room for the CRC_A after len bytes
+ * @param len Bytes of the frame without the CRC_A
+ * @return StatusCode STATUS_MIFARE_NACK if the card answered a NAK
+ */
+uint8_t nfc_mifare_transceive(nfc_rfid_t *nfc, uint8_t *data, uint8_t len);
+
+/**
+ * @brief Writes a block of data to the active PICC (MIFARE WRITE): the command and the block
+ * address, then the 16 bytes, each step acknowledged by the card. The sector must be authenticated.
+ * 
+ * @param nfc 
+ * @param blockAddr 
+ * @param data 16 bytes
+ * @return StatusCode 
+ */
+uint8_t nfc_write_card(nfc_rfid_t *nfc, uint8_t blockAddr, const uint8_t *data);
+
+/**
+ * @brief Writes a 4-byte page of a Type 2 tag (WRITE), acknowledged by the tag.
+ * 
+ * @param nfc 
+ * @param page 
+ * @param data 4 bytes
+ * @return StatusCode 
+ */
+uint8_t nfc_ul_write(nfc_rfid_t *nfc, uint8_t page, const uint8_t *data);
+
+/**
+ * @brief Reads a range of pages of a Type 2 tag (FAST_READ) in one transceive.
+ * 
+ * @param nfc 
+ * @param first First page
+ * @param last Last page, at most NFC_FAST_READ_PAGES pages
+ * @param buffer At least 4 bytes per page and the CRC_A
+ * @param bufferSize In: size of the buffer. Out: bytes received, CRC_A included
+ * @return StatusCode 
+ */
+uint8_t nfc_fast_read(nfc_rfid_t *nfc, uint8_t first, uint8_t last, uint8_t *buffer, uint8_t *bufferSize);
+
+/**
+ * @brief Family of the selected tag, from its SAK.
+ * 
+ * @param nfc 
+ * @return nfc_tag_type_t 
+ */
+static inline uint8_t nfc_tag_type(nfc_rfid_t *nfc)
+{
+    return nfc->piccType == PICC_TYPE_MIFARE_UL ? NFC_TAG_TYPE2 : NFC_TAG_CLASSIC;
+}
+
+/**
+ * @brief First page of an entry of a manifest in a Type 2 tag: 4 pages per entry after the header.
+ * 
+ * @param k Entry
+ * @return uint8_t 
+ */
+static inline uint8_t nfc_manifest_page(uint8_t k)
+{
+    return NFC_T2_PAGE + 4 * (k + 1);
+}
+
+/**
+ * @brief Block of an entry of a manifest: the three data blocks of each sector, from NFC_MANIFEST_SECTOR.
+ * 
+ * @param k Entry
+ * @return uint8_t 
+ */
+static inline uint8_t nfc_manifest_block(uint8_t k)
+{
+    return 4 * (NFC_MANIFEST_SECTOR + k / 3) + k % 3;
+}
+
+/**
+ * @brief Entries announced by a header block: byte 15 is NFC_MANIFEST_ID and byte 0 the number of entries.
+ * 
+ * @param header Data block
+ * @return uint8_t 0 if the block is not the header of a valid manifest
+ */
+static inline uint8_t nfc_manifest_count(const uint8_t *header)
+{
+    if (header[15] != NFC_MANIFEST_ID || !header[0] || header[0] > NFC_MANIFEST_MAX) {
+        return 0;
+    }
+    return header[0];
+}
+
+/**
+ * @brief Read the entry blocks of a manifest whose header is in bufferRead, with one
+ * authentication (key A) per sector, or with FAST_READ of NFC_FAST_READ_PAGES pages for a
+ * Type 2 tag. The card must be selected.
+ * 
+ * @param nfc 
+ * @return StatusCode 
+ */
+uint8_t nfc_read_manifest(nfc_rfid_t *nfc);
+
 /**
  * @brief Simple wrapper around PICC_Select.
  * Returns true if a UID could be read.
@@ -139,6 +503,61 @@ static inline bool nfc_read_card_serial(nfc_rfid_t *nfc)
     return (status == STATUS_OK);
 }
 
+/**
+ * @brief Configure the IRQ pin of the MFRC522: active low push-pull, asserted by RxIRq, IdleIRq,
+ * TimerIRq and CRCIRq. The falling edge is delivered to gpioCallback(), which calls nfc_irq().
+ * 
+ * @param nfc 
+ */
+void nfc_config_mfrc522_irq(nfc_rfid_t *nfc);
+
+/**
+ * @brief IRQ pin interrupt: the command in progress may be complete.
+ * 
+ * @param nfc 
+ */
+static inline void nfc_irq(nfc_rfid_t *nfc)
+{
+    nfc->cmd.irq = true;
+    nfc->cmd.irqs++;
+    __sev(); ///< Wake the core waiting for the completion
+}
+
+/**
+ * @brief Load the FIFO and start a command without waiting for its completion.
+ * 
+ * @param nfc 
+ * @param command   ///< The command to execute. One of the PCD_Command enums.
+ * @param waitIRq   ///< The bits in the ComIrqReg register that signals successful completion of the command.
+ * @param sendData  ///< Pointer to the data to transfer to the FIFO.
+ * @param sendLen   ///< Number of bytes to transfer to the FIFO.
+ * @param validBits ///< Number of valid bits in the last byte sent, NULL for 8.
+ * @param rxAlign   ///< Bit position in backData[0] for the first bit received.
+ */
+void nfc_command_start(nfc_rfid_t *nfc, uint8_t command, uint8_t waitIRq, uint8_t *sendData, uint8_t sendLen,
+                       uint8_t *validBits, uint8_t rxAlign);
+
+/**
+ * @brief Advance the command in progress. With the IRQ pin configured there is no SPI
+ * transaction until the interrupt arrives, ComIrqReg is read once to find out why.
+ * 
+ * @param nfc 
+ * @return nfc_cmd_state_t NFC_CMD_BUSY while the command runs
+ */
+nfc_cmd_state_t nfc_command_poll(nfc_rfid_t *nfc);
+
+/**
+ * @brief Get the result of a completed command: the errors and the data of the FIFO.
+ * 
+ * @param nfc 
+ * @param backData  ///< nullptr or pointer to buffer if data should be read back after executing the command.
+ * @param backLen   ///< In: Max number of bytes to write to *backData. Out: The number of bytes returned.
+ * @param validBits ///< Out: The number of valid bits in the last byte. 0 for 8 valid bits.
+ * @param checkCRC  ///< In: True => The last two bytes of the response is assumed to be a CRC_A that must be validated.
+ * @return uint8_t  ///< STATUS_OK on success, STATUS_??? otherwise.
+ */
+uint8_t nfc_command_finish(nfc_rfid_t *nfc, uint8_t *backData, uint8_t *backLen, uint8_t *validBits, bool checkCRC);
+
 /**
  * @brief Transfers data to the MFRC522 FIFO, executes a command, waits for completion and transfers data back from the FIFO.
  * CRC validation can only be done if backData and backLen are specified.
@@ -240,6 +659,37 @@ static inline void cs_deselect(nfc_rfid_t *nfc) {
     asm volatile("nop \n nop \n nop");
 }
 
+/**
+ * @brief Count a SPI transaction.
+ * 
+ * @param nfc 
+ * @param bytes Bytes clocked in the transaction
+ */
+static inline void nfc_spi_count(nfc_rfid_t *nfc, uint32_t bytes)
+{
+    nfc->spi_stats.transactions++;
+    nfc->spi_stats.bytes += bytes;
+}
+
+/**
+ * @brief Update the shadow of a register after a write or a read. A soft reset
+ * invalidates every shadow.
+ * 
+ * @param nfc 
+ * @param reg 
+ * @param data 
+ */
+static inline void nfc_shadow_store(nfc_rfid_t *nfc, uint8_t reg, uint8_t data)
+{
+    uint8_t i = (reg >> 1) & (NFC_REGISTERS - 1);
+    if (nfc_shadow_rw[i]) {
+        nfc->shadow.value[i] = data & nfc_shadow_rw[i];
+        nfc->shadow.valid |= 1ULL << i;
+    }else if (reg == CommandReg && (data & 0x0F) == PCD_SoftReset) {
+        nfc->shadow.valid = 0; ///< Every register goes back to its reset value
+    }
+}
+
 /**
  * @brief Perform a write operation to the NFC.
  * 
@@ -253,26 +703,35 @@ static inline void nfc_write(nfc_rfid_t *nfc, uint8_t reg, uint8_t data)
     cs_select(nfc);
     spi_write_blocking(nfc->spi, buf, 2);
     cs_deselect(nfc);
+    nfc_spi_count(nfc, 2);
+    nfc_shadow_store(nfc, reg, data);
 }
 
 /**
  * @brief Perform multiple write operations to the NFC.
+ * Burst write: the address is sent once and the data follows in the same CS window,
+ * the MFRC522 keeps writing to the same register (the FIFO). From SPI_DMA_MIN bytes the
+ * transfer runs on the DMA and the core sleeps until it is done.
  * 
  * @param nfc 
  * @param reg 
  * @param data 
- * @param len 
+ * @param len At most NFC_BURST_MAX bytes, the rest is ignored
  */
 static inline void nfc_write_mult(nfc_rfid_t *nfc, uint8_t reg, uint8_t *data, uint8_t len)
 {
-    uint8_t buf[64] = {reg};
-    for (int i = 0; i < len; i++)
-    {
-        buf[i+1] = data[i];
+    if (len > NFC_BURST_MAX) {
+        len = NFC_BURST_MAX;
     }
-    cs_select(nfc);
-    spi_write_blocking(nfc->spi, buf, len+1);
-    cs_deselect(nfc);
+    if (len >= SPI_DMA_MIN && spi_dma_write(&nfc->dma, reg, data, len, NULL, NULL)) {
+        spi_dma_wait(&nfc->dma);
+    }else {
+        cs_select(nfc);
+        spi_write_blocking(nfc->spi, &reg, 1);
+        spi_write_blocking(nfc->spi, data, len);
+        cs_deselect(nfc);
+    }
+    nfc_spi_count(nfc, len + 1);
 }
 
 /**
@@ -290,31 +749,74 @@ static inline uint8_t nfc_read(nfc_rfid_t *nfc, uint8_t reg)
     spi_write_blocking(nfc->spi, &reg, 1);
     spi_read_blocking(nfc->spi, 0, &data, 1);
     cs_deselect(nfc);
+    nfc_spi_count(nfc, 2);
+    nfc_shadow_store(nfc, reg & ~READ_BIT, data);
     return data;
 }
 
+/**
+ * @brief Get the value of a register for a read-modify-write operation. Registers with a
+ * known shadow are not read, unless the chip can change bits that the operation keeps.
+ * 
+ * @param nfc 
+ * @param reg 
+ * @param mask Bits that the operation overwrites
+ * @return uint8_t 
+ */
+static inline uint8_t nfc_read_cached(nfc_rfid_t *nfc, uint8_t reg, uint8_t mask)
+{
+    uint8_t i = (reg >> 1) & (NFC_REGISTERS - 1);
+    if (!(nfc->shadow.valid & (1ULL << i)) || (nfc_shadow_hw[i] & ~mask)) {
+        nfc->shadow.misses++;
+        return nfc_read(nfc, reg);
+    }
+    nfc->shadow.hits++;
+#ifdef NFC_SHADOW_CHECK
+    uint8_t chip = nfc_read(nfc, reg);
+    if ((chip ^ nfc->shadow.value[i]) & nfc_shadow_rw[i] & ~nfc_shadow_hw[i]) {
+        nfc->shadow.mismatches++;
+        printf("Shadow of register %02X: %02X, chip %02X\n", i, nfc->shadow.value[i], chip);
+    }
+#endif
+    return nfc->shadow.value[i];
+}
+
 /**
  * @brief Perform multiple read operations to the NFC.
+ * Burst read: the address is repeated while the data of the previous one is clocked out,
+ * all in one CS window, and 0x00 ends the transfer. From SPI_DMA_MIN bytes the transfer
+ * runs on the DMA and the core sleeps until it is done.
  * 
  * @param nfc 
  * @param reg 
  * @param data 
- * @param len 
+ * @param len At most NFC_BURST_MAX bytes, the rest is ignored
  * @param rxAlign ///< Only bit positions rxAlign..7 in values[0] are updated. Default 0.
  */ 
 static inline void nfc_read_mult(nfc_rfid_t *nfc, uint8_t reg, uint8_t *data, uint8_t len, uint8_t rxAlign)
 {
+    if (!len) {
+        return;
+    }
+    if (len > NFC_BURST_MAX) {
+        len = NFC_BURST_MAX;
+    }
     const uint8_t msg = reg | READ_BIT;
-    cs_select(nfc);
-    for (int i = 0; i < len; i++)
-    {
-        data[i] = nfc_read(nfc, msg);
+    uint8_t first = data[0]; ///< Bits below rxAlign are kept
+    if (len >= SPI_DMA_MIN && spi_dma_read(&nfc->dma, msg, data, len, NULL, NULL)) {
+        spi_dma_wait(&nfc->dma);
+    }else {
+        cs_select(nfc);
+        spi_write_blocking(nfc->spi, &msg, 1);
+        spi_read_blocking(nfc->spi, msg, data, len - 1);   ///< Address repeated
+        spi_read_blocking(nfc->spi, 0, &data[len - 1], 1); ///< Stop
+        cs_deselect(nfc);
     }
-    cs_deselect(nfc);
+    nfc_spi_count(nfc, len + 1);
     if (rxAlign)
     {
         uint8_t mask = (0xFF << rxAlign) & 0xFF;
-        data[0] = (data[0] & ~mask) | (data[1] & mask);
+        data[0] = (first & ~mask) | (data[0] & mask);
     }
 }
 
@@ -327,7 +829,7 @@ static inline void nfc_read_mult(nfc_rfid_t *nfc, uint8_t reg, uint8_t *data, ui
  */
 static inline void nfc_clear_reg_bitmask(nfc_rfid_t *nfc, uint8_t reg, uint8_t mask)
 {
-    uint8_t value = nfc_read(nfc, reg);
+    uint8_t value = nfc_read_cached(nfc, reg, mask);
     nfc_write(nfc, reg, (uint8_t)(value & (~mask)));
 }
 
@@ -340,7 +842,7 @@ static inline void nfc_clear_reg_bitmask(nfc_rfid_t *nfc, uint8_t reg, uint8_t m
  */
 static inline void nfc_set_reg_bitmask(nfc_rfid_t *nfc, uint8_t reg, uint8_t mask)
 {
-    uint8_t value = nfc_read(nfc, reg);
+    uint8_t value = nfc_read_cached(nfc, reg, mask);
     nfc_write(nfc, reg, (uint8_t)(value | mask));
 }
 
@@ -353,13 +855,25 @@ static inline void nfc_set_reg_bitmask(nfc_rfid_t *nfc, uint8_t reg, uint8_t mas
  */
 static inline void nfc_antenna_on(nfc_rfid_t *nfc)
 {
-    uint8_t value = nfc_read(nfc, TxControlReg);
+    uint8_t value = nfc_read_cached(nfc, TxControlReg, 0);
     if ((value & 0x03) != 0x03)
     {
         nfc_write(nfc, TxControlReg, value | 0x03);
     }
 }
 
+/**
+ * @brief Set the reload value of the chip timer, which stops the commands without answer.
+ * 
+ * @param nfc 
+ * @param reload Periods of 25 us
+ */
+static inline void nfc_set_timeout(nfc_rfid_t *nfc, uint16_t reload)
+{
+    nfc_write(nfc, TReloadRegH, reload >> 8);
+    nfc_write(nfc, TReloadRegL, reload & 0xFF);
+}
+
 /**
  * @brief Performs a soft reset on the MFRC522 chip and waits for it to be ready again.
  * 
@@ -385,21 +899,99 @@ static inline void nfc_stop_crypto1(nfc_rfid_t *nfc)
 }
 
 /**
- * @brief Use the CRC coprocessor in the MFRC522 to calculate a CRC_A.
+ * @brief Calculate a CRC_A, by the MCU or by the MFRC522 coprocessor when nfc->crc_hw is set.
  * 
  * @param nfc 
  * @param data 
  * @param len 
- * @param result 
+ * @param result Low byte first
  * @return uint8_t STATUS_OK on success, STATUS_??? otherwise.
  */
 uint8_t nfc_calculate_crc(nfc_rfid_t *nfc, uint8_t *data, uint8_t len, uint8_t *result);
 
 /**
- * @brief Get the data of the product from the bufferRead.
+ * @brief Use the CRC coprocessor in the MFRC522 to calculate a CRC_A.
+ * 
+ * @param nfc 
+ * @param data 
+ * @param len 
+ * @param result Low byte first
+ * @return uint8_t STATUS_OK on success, STATUS_??? otherwise.
+ */
+uint8_t nfc_calculate_crc_hw(nfc_rfid_t *nfc, uint8_t *data, uint8_t len, uint8_t *result);
+
+/**
+ * @brief Table-driven CRC_A (ISO 14443-3: preset 0x6363, reflected, no final XOR), without SPI traffic.
+ * CRC_A(00 00) = A0 1E, CRC_A(12 34) = 26 CF.
+ * 
+ * @param data 
+ * @param len 
+ * @param result Low byte first
+ */
+void nfc_crc_a(const uint8_t *data, uint8_t len, uint8_t *result);
+
+/**
+ * @brief Self-test of the SPI link and selection of its clock. Each round checks VersionReg and
+ * writes a pattern to the FIFO and reads it back. The saved clock is verified alone; if there
+ * is none or it fails, the candidates are tested from the fastest one and the first one without
+ * errors is kept. Call it when no pipeline can run.
+ * 
+ * @param nfc 
+ * @param saved Clock chosen in a previous boot, 0 to probe
+ * @return uint32_t Nominal clock to persist, 0 if no candidate passed (the safe clock is kept)
+ */
+uint32_t nfc_spi_probe(nfc_rfid_t *nfc, uint32_t saved);
+
+/**
+ * @brief Print the statistics of the SPI traffic, the commands and the register shadow.
+ * 
+ * @param nfc 
+ */
+void nfc_print_stats(nfc_rfid_t *nfc);
+
+/**
+ * @brief Look for the selected card (nfc->uid) in the cache of the cards seen recently.
+ * 
+ * @param nfc 
+ * @param hit Copy of the entry, if found
+ * @return true if the card was seen within the window
+ */
+static inline bool nfc_cache_lookup(nfc_rfid_t *nfc, uid_entry_t *hit)
+{
+    uid_entry_t *e = uid_cache_get(&nfc->cache, &nfc->uid, time_us_64());
+    if (e) {
+        *hit = *e;
+    }
+    return e != NULL;
+}
+
+/**
+ * @brief Use the tag of a cache entry as the tag read (as nfc_get_data_tag() does).
+ * 
+ * @param nfc 
+ * @param hit 
+ */
+static inline void nfc_cache_apply(nfc_rfid_t *nfc, const uid_entry_t *hit)
+{
+    nfc->tag = hit->tag;
+    nfc->tag.is_present = true;
+    nfc->userType = hit->user;
+    nfc->manifest.n = 0;
+    nfc->manifest.auths = 0;
+    nfc->manifest.decode_us = 0;
+}
+
+/**
+ * @brief Get the data of the product from the bufferRead, decoded in place.
+ * A coded block (tag_codec.h) is checked and decoded with tag_layout[]. In the legacy layout
+ * byte 15 is the kind of tag (0x07 admin, 0x06 inventory user, NFC_MANIFEST_ID manifest, otherwise box),
+ * bytes 1-2 the product code of a box (legacy tags store it in byte 15).
+ * The entries of a manifest are the coded blocks of manifest.raw; the tag is the last entry.
+ * A valid tag, other than a manifest, is stored in the cache of the cards seen recently.
+ * It prints nothing, it runs in the pipeline report: codec.last is the reason of a rejection.
  * 
  * @param nfc 
- * @return true if the ID is valid (range 1-7), false otherwise.
+ * @return true if the tag is valid, false otherwise.
  */
 bool nfc_get_data_tag(nfc_rfid_t *nfc);
 
@@ -0,0 +1,137 @@
+/**
+ * \file        nfc_sched.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "nfc_sched.h"
+
+void nfc_sched_init(nfc_sched_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->timer_irq = TIMER_IRQ_1;
+}
+
+bool nfc_sched_add(nfc_sched_t *s, nfc_rfid_t *nfc)
+{
+    if (s->n >= NFC_READERS_MAX) {
+        return false;
+    }
+    s->reader[s->n++] = nfc;
+    return true;
+}
+
+nfc_rfid_t *nfc_sched_by_irq(nfc_sched_t *s, uint8_t pin)
+{
+    for (uint8_t i = 0; i < s->n; i++) {
+        if (s->reader[i]->pinout.irq == pin) {
+            return s->reader[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t nfc_sched_run(nfc_sched_t *s, bool (*ready)(nfc_rfid_t *nfc), void (*done)(nfc_rfid_t *nfc, uint8_t status))
+{
+    uint32_t next_us = NFC_POLL_MAX_US;
+    s->stats.rounds++;
+    for (uint8_t k = 0; k < s->n; k++) {
+        uint8_t i = (s->next + k) % s->n;
+        nfc_rfid_t *nfc = s->reader[i];
+        uint32_t wait_us = nfc->timeCheck;
+        // A pipeline in progress is stepped soon: the emergency break after a missed IRQ edge, or
+        // each stage when the chip is polled without the IRQ pin
+        uint32_t step_us = nfc->cmd.enabled ? NFC_CMD_TIMEOUT_US : NFC_SCHED_MIN_US;
+        if (nfc_pipe_busy(nfc)) {
+            nfc_pipe_step(nfc); ///< Emergency break, or the only driver without the IRQ pin
+            s->stats.steps[i]++;
+        }else if (ready(nfc)) {
+            uint32_t since = time_us_32() - nfc->poll.last;
+            if (since + NFC_SCHED_MIN_US >= nfc->timeCheck) { ///< Due, or due before the next round
+                s->stats.starts[i] += nfc_pipe_start(nfc, done);
+            }else {
+                wait_us = nfc->timeCheck - since;
+            }
+        }
+        if (nfc_pipe_busy(nfc)) { ///< Still running, or just started
+            wait_us = step_us;
+        }
+        if (wait_us < next_us) {
+            next_us = wait_us;
+        }
+    }
+    if (s->n) {
+        s->next = (s->next + 1) % s->n; ///< Another reader gets the bus first in the next round
+    }
+    return MAX(next_us, NFC_SCHED_MIN_US);
+}
+
+void nfc_sched_claim(nfc_sched_t *s, nfc_rfid_t *nfc)
+{
+    uint32_t start = time_us_32();
+    for (uint8_t i = 0; i < s->n; i++) {
+        if (s->reader[i]->spi == nfc->spi) {
+            s->reader[i]->pipe.host = true; ///< No pipeline can start on the bus
+        }
+    }
+    for (uint8_t i = 0; i < s->n; i++) {
+        while (s->reader[i]->spi == nfc->spi && nfc_pipe_busy(s->reader[i])) { ///< The halt of a previous read
+            tight_loop_contents();
+        }
+    }
+    uint32_t wait_us = time_us_32() - start;
+    s->stats.claims++;
+    if (wait_us > s->stats.claim_max_us) {
+        s->stats.claim_max_us = wait_us;
+    }
+}
+
+void nfc_sched_release(nfc_sched_t *s, nfc_rfid_t *nfc)
+{
+    for (uint8_t i = 0; i < s->n; i++) {
+        if (s->reader[i]->spi == nfc->spi) {
+            s->reader[i]->pipe.host = false;
+        }
+    }
+}
+
+uint32_t nfc_sched_probe(nfc_sched_t *s, uint32_t saved)
+{
+    uint32_t rate = saved;
+    bool probed[NFC_READERS_MAX];
+    for (uint8_t i = 0; i < s->n; i++) {
+        printf("NFC reader %u:\n", i);
+        uint32_t r = nfc_spi_probe(s->reader[i], rate);
+        probed[i] = r != 0;
+        if (r && (!rate || r < rate)) {
+            rate = r;
+        }
+    }
+    for (uint8_t i = 0; rate && i < s->n; i++) { ///< The slowest clock on every reader
+        if (probed[i] && s->reader[i]->link.rate != rate) {
+            printf("NFC reader %u:\n", i);
+            nfc_spi_probe(s->reader[i], rate);
+        }
+    }
+    return rate;
+}
+
+void nfc_sched_print_stats(nfc_sched_t *s)
+{
+    printf("NFC scheduler: %u readers, %u rounds, %u bus claims (wait max %u us)\n",
+           s->n, s->stats.rounds, s->stats.claims, s->stats.claim_max_us);
+    for (uint8_t i = 0; i < s->n; i++) {
+        nfc_rfid_t *nfc = s->reader[i];
+        printf("NFC reader %u: SPI%u CS %u IRQ %u, %u pipelines started, %u emergency steps\n", i,
+               spi_get_index(nfc->spi), nfc->pinout.cs, nfc->pinout.irq, s->stats.starts[i], s->stats.steps[i]);
+    }
+}
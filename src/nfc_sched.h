@@ -0,0 +1,119 @@
+/**
+ * \file        nfc_sched.h
+ * \brief       Round-robin scheduler of several MFRC522 readers.
+ * \details     Each reader runs its own read pipeline, whose stages are started from the
+ *              completion interrupts of its chip. The check tag alarm calls nfc_sched_run(),
+ *              which serves the readers in turns: a busy pipeline gets its emergency step and
+ *              an idle reader whose poll is due starts a new one. The reader served first
+ *              rotates on each round, so no reader gets the bus first every time.
+ *              The stages are short and run in interrupt handlers of the same priority (GPIO
+ *              and TIMER_IRQ_1), so the stages of readers on the same SPI never overlap. The
+ *              blocking functions called from the main loop take the bus first with
+ *              nfc_sched_claim().
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __NFC_SCHED_
+#define __NFC_SCHED_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nfc_rfid.h"
+
+#define NFC_READERS_MAX     SPI_DMA_INSTANCES ///< Readers of the scheduler, each one takes four DMA channels
+#define NFC_SCHED_MIN_US    1000 ///< Shortest interval of the check tag alarm, and step of a pipeline without the IRQ pin
+
+/**
+ * \typedef nfc_sched_t
+ * \brief Data structure to manage the readers.
+ */
+typedef struct {
+    nfc_rfid_t *reader[NFC_READERS_MAX];
+    uint8_t n;          ///< Readers added
+    uint8_t next;       ///< Reader served first in the next round
+    uint8_t timer_irq;  ///< Alarm timer IRQ number of the polls (TIMER_IRQ_1)
+
+    struct {
+        uint32_t rounds;                    ///< Calls of nfc_sched_run()
+        uint32_t starts[NFC_READERS_MAX];   ///< Pipelines started by reader
+        uint32_t steps[NFC_READERS_MAX];    ///< Emergency steps by reader
+        uint32_t claims;                    ///< Bus taken by the main loop
+        uint32_t claim_max_us;              ///< Longest wait for the pipelines of the bus
+    } stats;
+} nfc_sched_t;
+
+/**
+ * @brief This function initializes the nfc_sched_t structure.
+ *
+ * @param s
+ */
+void nfc_sched_init(nfc_sched_t *s);
+
+/**
+ * @brief Add an initialized reader.
+ *
+ * @param s
+ * @param nfc
+ * @return false if there is no room
+ */
+bool nfc_sched_add(nfc_sched_t *s, nfc_rfid_t *nfc);
+
+/**
+ * @brief Find the reader of an IRQ pin, for gpioCallback().
+ *
+ * @param s
+ * @param pin
+ * @return nfc_rfid_t* NULL if no reader uses the pin
+ */
+nfc_rfid_t *nfc_sched_by_irq(nfc_sched_t *s, uint8_t pin);
+
+/**
+ * @brief One round of the scheduler, from the check tag alarm: step the busy pipelines and start
+ * a pipeline on each idle reader whose poll is due, in turns.
+ *
+ * @param s
+ * @param ready The reader can start a read (no session in progress)
+ * @param done Report of the pipelines started
+ * @return uint32_t Time to the next due poll (us), for the alarm
+ */
+uint32_t nfc_sched_run(nfc_sched_t *s, bool (*ready)(nfc_rfid_t *nfc), void (*done)(nfc_rfid_t *nfc, uint8_t status));
+
+/**
+ * @brief Take the bus of a reader for the blocking functions of the main loop: no pipeline starts
+ * on the readers of the same SPI and the ones in progress are waited for.
+ *
+ * @param s
+ * @param nfc
+ */
+void nfc_sched_claim(nfc_sched_t *s, nfc_rfid_t *nfc);
+
+/**
+ * @brief Give the bus back to the pipelines.
+ *
+ * @param s
+ * @param nfc
+ */
+void nfc_sched_release(nfc_sched_t *s, nfc_rfid_t *nfc);
+
+/**
+ * @brief Select the same SPI clock on every reader: the one chosen in a previous boot is only
+ * verified, else each reader is probed and the bus runs at the slowest clock that passed.
+ *
+ * @param s
+ * @param saved Clock of a previous boot, 0 if none
+ * @return uint32_t Clock selected, to be saved
+ */
+uint32_t nfc_sched_probe(nfc_sched_t *s, uint32_t saved);
+
+/**
+ * @brief Print the statistics of the scheduler.
+ *
+ * @param s
+ */
+void nfc_sched_print_stats(nfc_sched_t *s);
+
+#endif // __NFC_SCHED_
@@ -0,0 +1,174 @@
+/**
+ * \file        spi_dma.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "spi_dma.h"
+
+static spi_dma_t *gDevices[SPI_DMA_INSTANCES]; ///< Devices served by the DMA_IRQ_0 handler
+static uint8_t gDeviceCount;
+
+/**
+ * @brief DMA_IRQ_0 handler: complete the transfers whose receive data channel finished.
+ *
+ */
+static void spi_dma_irq_handler(void)
+{
+    for (uint8_t i = 0; i < gDeviceCount; i++) {
+        spi_dma_t *d = gDevices[i];
+        if (!dma_channel_get_irq0_status(d->rx_data)) {
+            continue;
+        }
+        dma_channel_acknowledge_irq0(d->rx_data);
+        while (spi_is_busy(d->spi)) { ///< The last byte is received, the bus is idle in a few cycles
+            tight_loop_contents();
+        }
+        gpio_put(d->cs, 1);
+        d->stats.transfers++;
+        d->busy = false;
+        __sev(); ///< Wake spi_dma_wait()
+        if (d->done) {
+            d->done(d, d->ctx);
+        }
+    }
+}
+
+void spi_dma_init(spi_dma_t *d, spi_inst_t *spi, uint8_t cs)
+{
+    d->spi = spi;
+    d->cs = cs;
+    d->tx_addr = (uint8_t)dma_claim_unused_channel(true);
+    d->tx_data = (uint8_t)dma_claim_unused_channel(true);
+    d->rx_addr = (uint8_t)dma_claim_unused_channel(true);
+    d->rx_data = (uint8_t)dma_claim_unused_channel(true);
+    d->stop = 0x00;
+    d->busy = false;
+    d->done = NULL;
+    d->ctx = NULL;
+    d->stats.transfers = 0;
+    d->stats.bytes = 0;
+    d->stats.busy = 0;
+
+    dma_channel_set_irq0_enabled(d->rx_data, true);
+    if (gDeviceCount < SPI_DMA_INSTANCES) {
+        gDevices[gDeviceCount++] = d;
+    }
+    if (gDeviceCount == 1) {
+        irq_add_shared_handler(DMA_IRQ_0, spi_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_priority(DMA_IRQ_0, PICO_HIGHEST_IRQ_PRIORITY); ///< spi_dma_wait() can be called from other interrupt handlers
+        irq_set_enabled(DMA_IRQ_0, true);
+    }
+}
+
+/**
+ * @brief Configure a channel of 8-bit transfers without starting it.
+ *
+ * @param ch
+ * @param chain Channel started when this one finishes, ch to not chain
+ * @param dreq
+ * @param dst
+ * @param src
+ * @param count
+ * @param src_inc
+ * @param dst_inc
+ */
+static void spi_dma_channel(uint8_t ch, uint8_t chain, uint dreq, volatile void *dst, const volatile void *src,
+                            uint16_t count, bool src_inc, bool dst_inc)
+{
+    dma_channel_config c = dma_channel_get_default_config(ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_dreq(&c, dreq);
+    channel_config_set_read_increment(&c, src_inc);
+    channel_config_set_write_increment(&c, dst_inc);
+    channel_config_set_chain_to(&c, chain);
+    dma_channel_configure(ch, &c, dst, src, count, false);
+}
+
+/**
+ * @brief Check that the device is free and take it for a new transfer.
+ *
+ * @param d
+ * @param done
+ * @param ctx
+ * @return true if the device was taken
+ */
+static bool spi_dma_claim(spi_dma_t *d, void (*done)(spi_dma_t *d, void *ctx), void *ctx)
+{
+    if (d->busy) {
+        d->stats.busy++;
+        return false;
+    }
+    d->busy = true;
+    d->done = done;
+    d->ctx = ctx;
+    return true;
+}
+
+/**
+ * @brief Select the device and start the address channels, the data channels follow by chaining.
+ *
+ * @param d
+ * @param bytes Bytes of the transfer
+ */
+static void spi_dma_start(spi_dma_t *d, uint16_t bytes)
+{
+    d->stats.bytes += bytes;
+    gpio_put(d->cs, 0);
+    dma_start_channel_mask((1u << d->tx_addr) | (1u << d->rx_addr));
+}
+
+bool spi_dma_write(spi_dma_t *d, uint8_t reg, const uint8_t *data, uint16_t len,
+                   void (*done)(spi_dma_t *d, void *ctx), void *ctx)
+{
+    if (!spi_dma_claim(d, done, ctx)) {
+        return false;
+    }
+    volatile void *dr = &spi_get_hw(d->spi)->dr;
+    uint tx = spi_get_dreq(d->spi, true);
+    uint rx = spi_get_dreq(d->spi, false);
+    d->addr = reg;
+    spi_dma_channel(d->tx_addr, d->tx_data, tx, dr, &d->addr, 1, false, false);
+    spi_dma_channel(d->tx_data, d->tx_data, tx, dr, data, len, true, false);
+    spi_dma_channel(d->rx_addr, d->rx_data, rx, &d->sink, dr, 1, false, false);
+    spi_dma_channel(d->rx_data, d->rx_data, rx, &d->sink, dr, len, false, false);
+    spi_dma_start(d, len + 1);
+    return true;
+}
+
+bool spi_dma_read(spi_dma_t *d, uint8_t reg, uint8_t *data, uint16_t len,
+                  void (*done)(spi_dma_t *d, void *ctx), void *ctx)
+{
+    if (!spi_dma_claim(d, done, ctx)) {
+        return false;
+    }
+    volatile void *dr = &spi_get_hw(d->spi)->dr;
+    uint tx = spi_get_dreq(d->spi, true);
+    uint rx = spi_get_dreq(d->spi, false);
+    d->addr = reg;
+    spi_dma_channel(d->tx_addr, d->tx_data, tx, dr, &d->addr, len, false, false);
+    spi_dma_channel(d->tx_data, d->tx_data, tx, dr, &d->stop, 1, false, false);
+    spi_dma_channel(d->rx_addr, d->rx_data, rx, &d->sink, dr, 1, false, false);
+    spi_dma_channel(d->rx_data, d->rx_data, rx, data, dr, len, false, true);
+    spi_dma_start(d, len + 1);
+    return true;
+}
+
+void spi_dma_wait(spi_dma_t *d)
+{
+    while (d->busy) {
+        __wfe();
+    }
+}
@@ -0,0 +1,116 @@
+/**
+ * \file        spi_dma.h
+ * \brief       DMA engine for the register transfers of a SPI device.
+ * \details     A transfer is an address phase followed by a data phase in one CS window. Each
+ *              direction uses two DMA channels: the address channel is chained to the data
+ *              channel, so both phases run without the CPU. The end of the receive data channel
+ *              raises DMA_IRQ_0, whose handler releases CS and calls the completion callback.
+ *                  write:  TX reg, data[0..len-1]          RX discarded
+ *                  read:   TX reg x len, 0x00              RX discarded, data[0..len-1]
+ *              The read is the burst read of the MFRC522: the address is repeated while the data
+ *              of the previous one is clocked out.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __SPI_DMA_
+#define __SPI_DMA_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/spi.h"
+
+#define SPI_DMA_INSTANCES   3 ///< Devices that can share the DMA interrupt (one per reader, 12 channels / 4)
+#define SPI_DMA_MIN         4 ///< Data bytes below which the blocking functions are faster than the DMA setup
+
+typedef struct spi_dma spi_dma_t;
+
+/**
+ * \typedef spi_dma_t
+ * \brief Data structure to manage the DMA transfers of a SPI device.
+ */
+struct spi_dma {
+    spi_inst_t *spi;    ///< SPI instance
+    uint8_t cs;         ///< Chip select GPIO (active low)
+    uint8_t tx_addr;    ///< DMA channel of the transmitted address phase
+    uint8_t tx_data;    ///< DMA channel of the transmitted data phase
+    uint8_t rx_addr;    ///< DMA channel of the received address phase
+    uint8_t rx_data;    ///< DMA channel of the received data phase, its end completes the transfer
+
+    uint8_t addr;       ///< Address byte of the transfer
+    uint8_t stop;       ///< Byte that ends a burst read (0x00)
+    uint8_t sink;       ///< Destination of the received bytes that are discarded
+
+    volatile bool busy; ///< A transfer is in progress
+    void (*done)(spi_dma_t *d, void *ctx); ///< Completion callback (interrupt context), it can be NULL
+    void *ctx;          ///< Context passed to the callback
+
+    struct {
+        uint32_t transfers; ///< Transfers completed
+        uint32_t bytes;     ///< Bytes clocked, address bytes included
+        uint32_t busy;      ///< Submissions rejected because a transfer was in progress
+    } stats;
+};
+
+/**
+ * @brief This function initializes the spi_dma_t structure, claims four DMA channels and
+ * registers the device in the DMA_IRQ_0 handler. The SPI and the CS pin must be configured.
+ *
+ * @param d
+ * @param spi
+ * @param cs
+ */
+void spi_dma_init(spi_dma_t *d, spi_inst_t *spi, uint8_t cs);
+
+/**
+ * @brief Start a write transfer: the address and then the data, in one CS window.
+ * The data must stay valid until the transfer is done.
+ *
+ * @param d
+ * @param reg Address byte
+ * @param data
+ * @param len
+ * @param done Completion callback, it can be NULL
+ * @param ctx Context passed to the callback
+ * @return true if the transfer was started, false if another one is in progress
+ */
+bool spi_dma_write(spi_dma_t *d, uint8_t reg, const uint8_t *data, uint16_t len,
+                   void (*done)(spi_dma_t *d, void *ctx), void *ctx);
+
+/**
+ * @brief Start a burst read transfer: the address repeated len times and 0x00, in one CS window.
+ *
+ * @param d
+ * @param reg Address byte (with the read bit)
+ * @param data Destination of len bytes
+ * @param len At least 1
+ * @param done Completion callback, it can be NULL
+ * @param ctx Context passed to the callback
+ * @return true if the transfer was started, false if another one is in progress
+ */
+bool spi_dma_read(spi_dma_t *d, uint8_t reg, uint8_t *data, uint16_t len,
+                  void (*done)(spi_dma_t *d, void *ctx), void *ctx);
+
+/**
+ * @brief Check if a transfer is in progress.
+ *
+ * @param d
+ * @return true
+ * @return false
+ */
+static inline bool spi_dma_busy(spi_dma_t *d)
+{
+    return d->busy;
+}
+
+/**
+ * @brief Wait for the end of the transfer in progress. The core sleeps (WFE) and keeps
+ * serving the interrupts.
+ *
+ * @param d
+ */
+void spi_dma_wait(spi_dma_t *d);
+
+#endif // __SPI_DMA_
@@ -0,0 +1,153 @@
+/**
+ * \file        tag_codec.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "tag_codec.h"
+#include "nfc_rfid.h"
+
+const tag_field_t tag_layout[] = {
+    {TAG_KEY_CODE,      offsetof(tag_t, code),          2, 0xFFFF},
+    {TAG_KEY_AMOUNT,    offsetof(tag_t, amount),        4, 0x7FFFFFFF},
+    {TAG_KEY_PURCHASE,  offsetof(tag_t, purchase_v),    4, 0x7FFFFFFF},
+    {TAG_KEY_SALE,      offsetof(tag_t, sale_v),        4, 0x7FFFFFFF},
+};
+
+const uint8_t tag_layout_fields = sizeof(tag_layout) / sizeof(tag_layout[0]);
+
+const char *const tag_status_name[TAG_STATUSES] = {
+    "ok", "not coded", "version", "CRC", "length", "duplicate", "range"
+};
+
+/**
+ * @brief Read a member of the tag.
+ *
+ * @param tag
+ * @param f
+ * @return uint32_t
+ */
+static uint32_t tag_field_get(const tag_t *tag, const tag_field_t *f)
+{
+    const uint8_t *p = (const uint8_t *)tag + f->offset;
+    return f->size == 2 ? *(const uint16_t *)p : *(const uint32_t *)p;
+}
+
+/**
+ * @brief Write a member of the tag.
+ *
+ * @param tag
+ * @param f
+ * @param value
+ */
+static void tag_field_set(tag_t *tag, const tag_field_t *f, uint32_t value)
+{
+    uint8_t *p = (uint8_t *)tag + f->offset;
+    if (f->size == 2) {
+        *(uint16_t *)p = (uint16_t)value;
+    }else {
+        *(uint32_t *)p = value;
+    }
+}
+
+/**
+ * @brief Find the row of a key.
+ *
+ * @param key
+ * @return const tag_field_t* NULL if the key is unknown
+ */
+static const tag_field_t *tag_field_find(uint8_t key)
+{
+    for (uint8_t i = 0; i < tag_layout_fields; i++) {
+        if (tag_layout[i].key == key) {
+            return &tag_layout[i];
+        }
+    }
+    return NULL;
+}
+
+bool tag_encode(const tag_t *tag, uint8_t *block)
+{
+    uint8_t pos = 2;
+    memset(block, 0, TAG_CODEC_BLOCK);
+    block[0] = TAG_CODEC_MAGIC | TAG_CODEC_VERSION;
+    block[1] = (uint8_t)tag->id;
+    for (uint8_t i = 0; i < tag_layout_fields; i++) {
+        const tag_field_t *f = &tag_layout[i];
+        uint32_t value = tag_field_get(tag, f);
+        if (value > f->max) {
+            return false;
+        }
+        if (!value) {
+            continue;
+        }
+        uint8_t len = (uint8_t)((32 - __builtin_clz(value) + 7) / 8); // Minimal big endian length
+        if (pos + 1 + len > TAG_CODEC_CRC) {
+            return false;
+        }
+        block[pos++] = (uint8_t)(f->key << 4 | len);
+        while (len--) {
+            block[pos++] = (uint8_t)(value >> (8 * len));
+        }
+    }
+    nfc_crc_a(block, TAG_CODEC_CRC, &block[TAG_CODEC_CRC]);
+    return true;
+}
+
+tag_status_t tag_decode(const uint8_t *block, tag_t *tag)
+{
+    uint8_t crc[2];
+    uint16_t seen = 0; ///< Keys found
+
+    if ((block[0] & 0xF0) != TAG_CODEC_MAGIC) {
+        return TAG_NOT_CODED;
+    }
+    if ((block[0] & 0x0F) != TAG_CODEC_VERSION) {
+        return TAG_BAD_VERSION;
+    }
+    nfc_crc_a(block, TAG_CODEC_CRC, crc);
+    if (crc[0] != block[TAG_CODEC_CRC] || crc[1] != block[TAG_CODEC_CRC + 1]) {
+        return TAG_BAD_CRC;
+    }
+
+    tag->id = block[1];
+    for (uint8_t i = 0; i < tag_layout_fields; i++) {
+        tag_field_set(tag, &tag_layout[i], 0);
+    }
+    for (uint8_t pos = 2; pos < TAG_CODEC_CRC && block[pos] != TAG_KEY_END;) {
+        uint8_t key = block[pos] >> 4;
+        uint8_t len = block[pos++] & 0x0F;
+        if (pos + len > TAG_CODEC_CRC) {
+            return TAG_BAD_LENGTH;
+        }
+        const tag_field_t *f = tag_field_find(key);
+        if (!f) { // Field of a later revision of this version
+            pos += len;
+            continue;
+        }
+        if (len > 4) {
+            return TAG_BAD_LENGTH;
+        }
+        if (seen & (1u << key)) {
+            return TAG_DUPLICATE;
+        }
+        seen |= 1u << key;
+        uint32_t value = 0;
+        while (len--) {
+            value = (value << 8) | block[pos++];
+        }
+        if (value > f->max) {
+            return TAG_RANGE;
+        }
+        tag_field_set(tag, f, value);
+    }
+    return TAG_OK;
+}
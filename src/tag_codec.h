@@ -0,0 +1,93 @@
+/**
+ * \file        tag_codec.h
+ * \brief       Versioned payload of the data block of a tag.
+ * \details     A coded block starts with the magic and the version, then the kind of tag, a
+ *              stream of TLV records and the CRC_A of the first 14 bytes:
+ *                  [0] 0xA0 | version   [1] kind   [2..13] records   [14..15] CRC_A (low byte first)
+ *              The high nibble of the first byte of a record is its key and the low nibble the
+ *              length of its value (0-4 bytes, big endian, 0 is an empty value). A zero byte ends
+ *              the records. The fields, their keys and their ranges are the rows of tag_layout[],
+ *              shared by the encoder and the decoder. Records with an unknown key are skipped.
+ *              Blocks without the magic are the legacy fixed layout, decoded by nfc_get_data_tag().
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __TAG_CODEC_
+#define __TAG_CODEC_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nfc_enums.h"
+
+#define TAG_CODEC_MAGIC     0xA0 ///< High nibble of the first byte of a coded block
+#define TAG_CODEC_VERSION   1    ///< Low nibble of the first byte
+#define TAG_CODEC_BLOCK     16   ///< Bytes of a coded block
+#define TAG_CODEC_CRC       14   ///< Offset of the CRC_A, the records end before it
+
+/**
+ * \typedef tag_status_t
+ * \brief Result of the decode of a block.
+ */
+typedef enum {
+    TAG_OK,             ///< Valid coded block
+    TAG_NOT_CODED,      ///< No magic: legacy layout
+    TAG_BAD_VERSION,    ///< Version not supported
+    TAG_BAD_CRC,        ///< The CRC_A does not match
+    TAG_BAD_LENGTH,     ///< A record is longer than its field or than the block
+    TAG_DUPLICATE,      ///< A field is repeated
+    TAG_RANGE,          ///< A value is out of the range of its field
+    TAG_STATUSES
+} tag_status_t;
+
+/**
+ * \typedef tag_key_t
+ * \brief Keys of the records.
+ */
+typedef enum {
+    TAG_KEY_END,        ///< End of the records
+    TAG_KEY_CODE,       ///< Product code
+    TAG_KEY_AMOUNT,     ///< Items in the box
+    TAG_KEY_PURCHASE,   ///< Unit purchase value
+    TAG_KEY_SALE        ///< Unit sale value
+} tag_key_t;
+
+/**
+ * \typedef tag_field_t
+ * \brief Row of the layout: a field of tag_t and its record.
+ */
+typedef struct {
+    uint8_t key;        ///< tag_key_t
+    uint8_t offset;     ///< Offset of the member in tag_t
+    uint8_t size;       ///< Size of the member: 2 or 4 bytes
+    uint32_t max;       ///< Largest valid value
+} tag_field_t;
+
+extern const tag_field_t tag_layout[]; ///< Fields of a coded block
+extern const uint8_t tag_layout_fields; ///< Rows of tag_layout[]
+extern const char *const tag_status_name[TAG_STATUSES]; ///< Names of tag_status_t, for the reports
+
+/**
+ * @brief Encode a tag in a block. The fields whose value is 0 are omitted.
+ *
+ * @param tag
+ * @param block Destination of TAG_CODEC_BLOCK bytes
+ * @return true on success, false if the records do not fit in the block or a value is out of range
+ */
+bool tag_encode(const tag_t *tag, uint8_t *block);
+
+/**
+ * @brief Decode a block in place. The fields of the layout that are not present are 0;
+ * the other members of the tag are not changed. Nothing is decoded if the block is rejected
+ * before the records.
+ *
+ * @param block TAG_CODEC_BLOCK bytes (the CRC_A of the READ can follow)
+ * @param tag
+ * @return tag_status_t
+ */
+tag_status_t tag_decode(const uint8_t *block, tag_t *tag);
+
+#endif // __TAG_CODEC_
@@ -0,0 +1,188 @@
+/**
+ * \file        tag_writer.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/time.h"
+
+#include "tag_writer.h"
+
+void tag_writer_init(tag_writer_t *w)
+{
+    memset(w, 0, sizeof(*w));
+}
+
+uint8_t tag_writer_push(tag_writer_t *w, const tag_t *tag, uint8_t copies)
+{
+    uint8_t block[TAG_CODEC_BLOCK];
+    if (!tag_encode(tag, block)) {
+        return 0;
+    }
+    if (!w->count) { ///< New session
+        w->stats.session = 0;
+        w->refused.size = 0;
+    }
+    uint8_t queued = 0;
+    for (; queued < copies && w->count < TAG_WRITER_QUEUE; queued++) {
+        memcpy(w->block[(w->head + w->count) & (TAG_WRITER_QUEUE - 1)], block, TAG_CODEC_BLOCK);
+        w->count++;
+    }
+    return queued;
+}
+
+void tag_writer_clear(tag_writer_t *w)
+{
+    w->count = 0;
+}
+
+/**
+ * @brief Count a failed write.
+ *
+ * @param w
+ * @param fail tag_writer_fail_t
+ * @param status Status of the failed step
+ * @return uint8_t status
+ */
+static uint8_t tag_writer_fail(tag_writer_t *w, uint8_t fail, uint8_t status)
+{
+    static const char *reasons[TAG_WRITER_FAILS] = {"authentication", "write", "read back", "verify", "not a box tag"};
+    w->stats.fails[fail]++;
+    printf("Tag write failed: %s (status %u)\n", reasons[fail], status);
+    return status;
+}
+
+/**
+ * @brief Check if a card can be overwritten: its data block is blank or a box tag.
+ *
+ * @param block Data block read from the card
+ * @return true
+ * @return false for the admin, inventory user and manifest cards, and damaged coded tags
+ */
+static bool tag_writer_writable(const uint8_t *block)
+{
+    bool zeros = true;
+    bool ones = true;
+    for (uint8_t i = 0; i < TAG_CODEC_BLOCK; i++) {
+        zeros &= block[i] == 0x00;
+        ones &= block[i] == 0xFF;
+    }
+    if (zeros || ones) { ///< Blank card
+        return true;
+    }
+    tag_t tag;
+    uint8_t status = tag_decode(block, &tag);
+    if (status != TAG_NOT_CODED) {
+        return status == TAG_OK && tag.id == TAG_KIND_BOX;
+    }
+    // Legacy box: kind in byte 15, product code in bytes 1-2 (or the kind), values not negative
+    uint8_t kind = block[15];
+    uint16_t code = (block[1] << 8) | block[2];
+    if (kind == TAG_KIND_ADMIN || kind == TAG_KIND_INV || kind == NFC_MANIFEST_ID || !(code || kind)) {
+        return false;
+    }
+    return !((block[3] | block[7] | block[11]) & 0x80);
+}
+
+/**
+ * @brief Check if a card is the UID.
+ *
+ * @param nfc
+ * @param uid
+ * @return true
+ * @return false
+ */
+static bool tag_writer_same(nfc_rfid_t *nfc, const Uid *uid)
+{
+    return nfc->uid.size == uid->size && !memcmp(nfc->uid.uidByte, uid->uidByte, uid->size);
+}
+
+uint8_t tag_writer_write(tag_writer_t *w, nfc_rfid_t *nfc)
+{
+    if (tag_writer_same(nfc, &w->last)) {
+        w->stats.repeats++;
+        return STATUS_INVALID;
+    }
+    if (tag_writer_same(nfc, &w->refused)) { ///< Still in the field, counted once
+        return STATUS_INVALID;
+    }
+    uint32_t start = time_us_32();
+    const uint8_t *block = w->block[w->head];
+    uint8_t back[18];
+    uint8_t size = sizeof(back);
+
+    // Read the card first: only blank cards and box tags are overwritten
+    uint8_t status;
+    if (nfc_tag_type(nfc) == NFC_TAG_TYPE2) {
+        status = nfc_fast_read(nfc, NFC_T2_PAGE, NFC_T2_PAGE + 3, back, &size);
+    }else {
+        status = nfc_authenticate(nfc, PICC_CMD_MF_AUTH_KEY_A, nfc->blockAddr, nfc->keyByte, &nfc->uid);
+        if (status != STATUS_OK) {
+            return tag_writer_fail(w, TAG_WRITER_AUTH, status);
+        }
+        status = nfc_read_card(nfc, nfc->blockAddr, back, &size);
+    }
+    if (status != STATUS_OK) {
+        return tag_writer_fail(w, TAG_WRITER_READ, status);
+    }
+    if (!tag_writer_writable(back)) {
+        w->refused = nfc->uid;
+        return tag_writer_fail(w, TAG_WRITER_REFUSED, STATUS_ERROR);
+    }
+    size = sizeof(back);
+
+    if (nfc_tag_type(nfc) == NFC_TAG_TYPE2) { ///< Pages 4-7, no authentication
+        for (uint8_t i = 0; i < 4 && status == STATUS_OK; i++) {
+            status = nfc_ul_write(nfc, NFC_T2_PAGE + i, &block[4 * i]);
+        }
+        if (status != STATUS_OK) {
+            return tag_writer_fail(w, TAG_WRITER_WRITE, status);
+        }
+        status = nfc_fast_read(nfc, NFC_T2_PAGE, NFC_T2_PAGE + 3, back, &size);
+    }else { ///< The sector is authenticated by the read
+        status = nfc_write_card(nfc, nfc->blockAddr, block);
+        if (status != STATUS_OK) {
+            return tag_writer_fail(w, TAG_WRITER_WRITE, status);
+        }
+        status = nfc_read_card(nfc, nfc->blockAddr, back, &size);
+    }
+    if (status != STATUS_OK) {
+        return tag_writer_fail(w, TAG_WRITER_READ, status);
+    }
+    if (memcmp(back, block, TAG_CODEC_BLOCK)) {
+        return tag_writer_fail(w, TAG_WRITER_VERIFY, STATUS_ERROR);
+    }
+
+    uint32_t now = time_us_32();
+    uid_cache_forget(&nfc->cache, &nfc->uid); ///< The cached tag is the old content
+    w->last = nfc->uid;
+    w->head = (w->head + 1) & (TAG_WRITER_QUEUE - 1);
+    w->count--;
+    if (!w->stats.session++) {
+        w->stats.first_us = now;
+    }
+    w->stats.last_us = now;
+    w->stats.written++;
+    if (now - start > w->stats.max_us) {
+        w->stats.max_us = now - start;
+    }
+    return STATUS_OK;
+}
+
+void tag_writer_print_stats(tag_writer_t *w)
+{
+    uint32_t span = w->stats.last_us - w->stats.first_us;
+    uint32_t rate = w->stats.session > 1 && span ? (uint32_t)((uint64_t)(w->stats.session - 1) * 60000000U / span) : 0;
+    printf("Tag writer: %u queued, %u written (%u this session, %u tags/min), %u repeats ignored, worst %u us\n",
+           w->count, w->stats.written, w->stats.session, rate, w->stats.repeats, w->stats.max_us);
+    printf("Tag writer failures: auth %u, write %u, read back %u, verify %u, refused %u\n",
+           w->stats.fails[TAG_WRITER_AUTH], w->stats.fails[TAG_WRITER_WRITE],
+           w->stats.fails[TAG_WRITER_READ], w->stats.fails[TAG_WRITER_VERIFY], w->stats.fails[TAG_WRITER_REFUSED]);
+}
@@ -0,0 +1,121 @@
+/**
+ * \file        tag_writer.h
+ * \brief       Provisioning of box tags from a queue of payloads.
+ * \details     The console queues the payloads, coded with tag_encode(). While the queue is not
+ *              empty the reader is in writer mode: the poll does not read the tags, it writes the
+ *              payload at the head of the queue to the next card presented, reads it back and
+ *              compares it. Only blank cards and box tags (coded or legacy) are written: the
+ *              admin, inventory user and manifest cards are refused, so they can not be
+ *              overwritten by a provisioning session. A verified card leaves the queue and is remembered, so a card kept
+ *              in the field or presented again is not written twice. A failed card keeps the
+ *              payload for the next one.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __TAG_WRITER_
+#define __TAG_WRITER_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nfc_rfid.h"
+#include "tag_codec.h"
+
+#define TAG_WRITER_QUEUE    32   ///< Payloads waiting for a card (power of 2)
+#define TAG_KIND_BOX        0x01 ///< Kind of tag written for a box
+#define TAG_KIND_INV        0x06 ///< Kind of tag of the inventory user card
+#define TAG_KIND_ADMIN      0x07 ///< Kind of tag of the admin card
+
+/**
+ * \typedef tag_writer_fail_t
+ * \brief Reasons of a failed write.
+ */
+typedef enum {
+    TAG_WRITER_AUTH,    ///< The authentication of the sector failed
+    TAG_WRITER_WRITE,   ///< The card did not acknowledge the write (NAK or no answer)
+    TAG_WRITER_READ,    ///< The read back failed
+    TAG_WRITER_VERIFY,  ///< The block read back is not the payload
+    TAG_WRITER_REFUSED, ///< The card is not blank nor a box tag, it is not written
+    TAG_WRITER_FAILS
+} tag_writer_fail_t;
+
+/**
+ * \typedef tag_writer_t
+ * \brief Data structure to manage the queue and the statistics of the writer.
+ */
+typedef struct {
+    uint8_t block[TAG_WRITER_QUEUE][TAG_CODEC_BLOCK]; ///< Coded payloads
+    uint8_t head;       ///< Next payload to write
+    uint8_t count;      ///< Payloads in the queue
+    Uid last;           ///< Last card written
+    Uid refused;        ///< Last card refused
+
+    struct {
+        uint32_t written;   ///< Cards written and verified
+        uint32_t repeats;   ///< Presentations of the last card written, ignored
+        uint32_t fails[TAG_WRITER_FAILS]; ///< Failed writes, by reason
+        uint32_t first_us;  ///< time_us_32() of the first card written of the session
+        uint32_t last_us;   ///< time_us_32() of the last card written
+        uint32_t session;   ///< Cards written since the queue was filled from empty
+        uint32_t max_us;    ///< Worst time to write and verify a card
+    } stats;
+} tag_writer_t;
+
+/**
+ * @brief This function initializes the tag_writer_t structure.
+ *
+ * @param w
+ */
+void tag_writer_init(tag_writer_t *w);
+
+/**
+ * @brief Queue copies of a payload.
+ *
+ * @param w
+ * @param tag
+ * @param copies
+ * @return uint8_t Copies queued: 0 if the payload can not be coded, less if the queue is full
+ */
+uint8_t tag_writer_push(tag_writer_t *w, const tag_t *tag, uint8_t copies);
+
+/**
+ * @brief Remove every payload of the queue.
+ *
+ * @param w
+ */
+void tag_writer_clear(tag_writer_t *w);
+
+/**
+ * @brief Check if the reader is in writer mode. It is safe to call it from an interrupt handler.
+ *
+ * @param w
+ * @return true if there are payloads waiting for a card
+ */
+static inline bool tag_writer_pending(tag_writer_t *w)
+{
+    return w->count != 0;
+}
+
+/**
+ * @brief Write the payload at the head of the queue to the selected card (data block
+ * nfc->blockAddr with key A, or pages 4-7 of a Type 2 tag) and verify it. The block is read
+ * first: a card that is not blank nor a box tag is refused. A verified card is removed from the UID cache.
+ *
+ * @param w
+ * @param nfc
+ * @return uint8_t STATUS_OK if the card was written, STATUS_INVALID if it is the last card
+ * written or refused, the status of the failed step otherwise (STATUS_ERROR for a new refusal)
+ */
+uint8_t tag_writer_write(tag_writer_t *w, nfc_rfid_t *nfc);
+
+/**
+ * @brief Print the queue, the throughput and the failures.
+ *
+ * @param w
+ */
+void tag_writer_print_stats(tag_writer_t *w);
+
+#endif // __TAG_WRITER_
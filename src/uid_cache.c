@@ -0,0 +1,144 @@
+/**
+ * \file        uid_cache.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "uid_cache.h"
+
+/**
+ * @brief FNV-1a hash of a UID.
+ *
+ * @param uid
+ * @return uint8_t First slot of the probe run
+ */
+static uint8_t uid_cache_hash(const Uid *uid)
+{
+    uint32_t h = 2166136261U;
+    for (uint8_t i = 0; i < uid->size; i++) {
+        h = (h ^ uid->uidByte[i]) * 16777619U;
+    }
+    return (uint8_t)(h & (UID_CACHE_SIZE - 1));
+}
+
+/**
+ * @brief Check if an entry is the card.
+ *
+ * @param e
+ * @param uid
+ * @return true
+ * @return false
+ */
+static bool uid_cache_match(const uid_entry_t *e, const Uid *uid)
+{
+    return e->size == uid->size && !memcmp(e->uid, uid->uidByte, uid->size);
+}
+
+/**
+ * @brief Check if an entry is still within the window.
+ *
+ * @param c
+ * @param e
+ * @param now
+ * @return true
+ * @return false
+ */
+static bool uid_cache_live(uid_cache_t *c, const uid_entry_t *e, uint64_t now)
+{
+    return e->size && e->seen && now - e->seen < c->ttl_us;
+}
+
+void uid_cache_init(uid_cache_t *c, uint32_t ttl_us, uint8_t repeat)
+{
+    memset(c, 0, sizeof(*c));
+    c->ttl_us = ttl_us;
+    c->repeat = repeat;
+}
+
+uid_entry_t *uid_cache_get(uid_cache_t *c, const Uid *uid, uint64_t now)
+{
+    uint8_t i = uid_cache_hash(uid);
+    for (uint8_t n = 0; n < UID_CACHE_SIZE; n++, i = (i + 1) & (UID_CACHE_SIZE - 1)) {
+        uid_entry_t *e = &c->slot[i];
+        if (!e->size) { ///< End of the probe run
+            break;
+        }
+        if (uid_cache_match(e, uid)) {
+            if (!uid_cache_live(c, e, now)) {
+                break;
+            }
+            e->seen = now;
+            c->stats.hits++;
+            return e;
+        }
+    }
+    c->stats.misses++;
+    return NULL;
+}
+
+void uid_cache_put(uid_cache_t *c, const Uid *uid, const tag_t *tag, uint8_t user, uint64_t now)
+{
+    uint8_t i = uid_cache_hash(uid);
+    uid_entry_t *free = NULL;   ///< First expired or empty slot of the run
+    uid_entry_t *oldest = NULL; ///< Victim if every slot is live
+    for (uint8_t n = 0; n < UID_CACHE_SIZE; n++, i = (i + 1) & (UID_CACHE_SIZE - 1)) {
+        uid_entry_t *e = &c->slot[i];
+        if (e->size && uid_cache_match(e, uid)) { ///< Update in place
+            free = e;
+            break;
+        }
+        if (!uid_cache_live(c, e, now)) {
+            if (!free) {
+                free = e;
+            }
+            if (!e->size) { ///< The card can not be further on
+                break;
+            }
+        }else if (!oldest || now - e->seen > now - oldest->seen) {
+            oldest = e;
+        }
+    }
+    if (!free) {
+        free = oldest;
+        c->stats.evictions++;
+    }
+    free->size = uid->size;
+    memcpy(free->uid, uid->uidByte, uid->size);
+    free->user = user;
+    free->seen = now;
+    free->tag = *tag;
+}
+
+void uid_cache_forget(uid_cache_t *c, const Uid *uid)
+{
+    uint8_t i = uid_cache_hash(uid);
+    for (uint8_t n = 0; n < UID_CACHE_SIZE; n++, i = (i + 1) & (UID_CACHE_SIZE - 1)) {
+        uid_entry_t *e = &c->slot[i];
+        if (!e->size) {
+            return;
+        }
+        if (uid_cache_match(e, uid)) {
+            e->seen = 0; ///< Expired, the slot keeps the probe run
+            return;
+        }
+    }
+}
+
+void uid_cache_print_stats(uid_cache_t *c)
+{
+    uint8_t used = 0;
+    for (uint8_t i = 0; i < UID_CACHE_SIZE; i++) {
+        used += c->slot[i].size != 0;
+    }
+    printf("UID cache: %u hits, %u misses, %u evictions, %u/%u slots, window %u ms, repeats %s\n",
+           c->stats.hits, c->stats.misses, c->stats.evictions, used, UID_CACHE_SIZE,
+           c->ttl_us / 1000, c->repeat == UID_REPEAT_SKIP ? "ignored" : "counted");
+}
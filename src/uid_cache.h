@@ -0,0 +1,107 @@
+/**
+ * \file        uid_cache.h
+ * \brief       Cache of the cards seen recently, indexed by UID.
+ * \details     Small open-addressing hash set (linear probing) of the UIDs read in the last
+ *              ttl_us, each one with its decoded tag. A card presented again within the window
+ *              is known without the Crypto1 authentication and the block read. Expired entries
+ *              keep the probe chains and are reused by the next insertions.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __UID_CACHE_
+#define __UID_CACHE_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nfc_enums.h"
+
+#define UID_CACHE_SIZE      16 ///< Slots of the hash set (power of 2)
+#define UID_CACHE_TTL_US    10000000 ///< Default window of a repeat (10 s)
+
+/**
+ * \typedef uid_repeat_t
+ * \brief Policy for a card presented again within the window.
+ */
+typedef enum {
+    UID_REPEAT_COUNT,   ///< It is a new transaction, with the cached tag
+    UID_REPEAT_SKIP     ///< It is the same presentation, it is ignored
+} uid_repeat_t;
+
+/**
+ * \typedef uid_entry_t
+ * \brief Card seen recently.
+ */
+typedef struct {
+    uint8_t size;       ///< Bytes of the UID, 0 if the slot was never used
+    uint8_t uid[10];
+    uint8_t user;       ///< Kind of card (userType of nfc_rfid_t)
+    uint64_t seen;      ///< time_us_64() of the last presentation (64 bits: time_us_32() wraps every 71 min), 0 if forgotten
+    tag_t tag;          ///< Decoded data block
+} uid_entry_t;
+
+/**
+ * \typedef uid_cache_t
+ * \brief Data structure to manage the cache.
+ */
+typedef struct {
+    uid_entry_t slot[UID_CACHE_SIZE];
+    uint32_t ttl_us;    ///< Window of a repeat
+    uint8_t repeat;     ///< uid_repeat_t
+
+    struct {
+        uint32_t hits;      ///< Presentations found in the window
+        uint32_t misses;    ///< Presentations not found (or expired)
+        uint32_t evictions; ///< Live entries replaced because the probe run was full
+    } stats;
+} uid_cache_t;
+
+/**
+ * @brief This function initializes the uid_cache_t structure.
+ *
+ * @param c
+ * @param ttl_us Window of a repeat
+ * @param repeat uid_repeat_t
+ */
+void uid_cache_init(uid_cache_t *c, uint32_t ttl_us, uint8_t repeat);
+
+/**
+ * @brief Find a card seen within the window. A hit renews the window.
+ *
+ * @param c
+ * @param uid
+ * @param now time_us_64()
+ * @return uid_entry_t* NULL if the card is not known or expired
+ */
+uid_entry_t *uid_cache_get(uid_cache_t *c, const Uid *uid, uint64_t now);
+
+/**
+ * @brief Store (or update) a card with its decoded tag.
+ *
+ * @param c
+ * @param uid
+ * @param tag
+ * @param user Kind of card
+ * @param now time_us_64()
+ */
+void uid_cache_put(uid_cache_t *c, const Uid *uid, const tag_t *tag, uint8_t user, uint64_t now);
+
+/**
+ * @brief Forget a card, after its data block is written.
+ *
+ * @param c
+ * @param uid
+ */
+void uid_cache_forget(uid_cache_t *c, const Uid *uid);
+
+/**
+ * @brief Print the statistics of the cache.
+ *
+ * @param c
+ */
+void uid_cache_print_stats(uid_cache_t *c);
+
+#endif // __UID_CACHE_
@@ -0,0 +1,179 @@
+/**
+ * \file        bench_history.c
+ * \brief       Host benchmark of the history: varint blocks against the 32-byte raw layout.
+ * \details     A dock workload (mostly sales of one to three items, some inbound boxes, a few
+ *              operators and rare price changes) is appended to the history on the flash
+ *              emulator and, for comparison, to pages of the raw 32-byte records of the
+ *              previous layout (fixed fields and a CRC32 each). The benchmark reports the bytes
+ *              per transaction, the transactions that fit in the ring, and the decode
+ *              throughput of a full query over both; the two queries must agree.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/time.h"
+
+#include "host_test.h"
+#include "flash_emu.h"
+#include "history.h"
+
+#define BENCH_TRANSACTIONS  6000 ///< Below the capacity of the ring, nothing is overwritten
+#define BENCH_PRODUCTS      40
+#define BENCH_RAW_SIZE      32   ///< Record of the raw layout
+#define BENCH_RAW_PER_PAGE  (FLASH_PAGE_SIZE / BENCH_RAW_SIZE)
+#define BENCH_ROUNDS        200  ///< Full queries timed on each layout
+
+/**
+ * \typedef raw_rec_t
+ * \brief Record of the raw layout (32 bytes), as the history stored it before the varint blocks.
+ */
+typedef struct {
+    uint32_t time;
+    uint16_t code;
+    uint8_t uid_size;
+    uint8_t reserved;
+    int32_t delta;
+    uint32_t purchase_v;
+    uint32_t sale_v;
+    uint8_t uid[8];
+    uint32_t crc; ///< CRC32 of the previous 28 bytes
+} raw_rec_t;
+
+_Static_assert(sizeof(raw_rec_t) == BENCH_RAW_SIZE, "Raw record of the previous layout");
+
+static history_t history;
+static raw_rec_t raw[BENCH_TRANSACTIONS + BENCH_RAW_PER_PAGE];
+static uint32_t raw_n;
+static uint32_t seed = 12345;
+
+static uint32_t bench_rand(void)
+{
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 8;
+}
+
+/**
+ * @brief Query of the raw layout: every slot is checked, as the previous history_query() did.
+ *
+ * @return history_result_t
+ */
+static history_result_t raw_query(void)
+{
+    history_result_t res = {0, 0, 0};
+    for (uint32_t i = 0; i < raw_n; i++) {
+        const raw_rec_t *rec = &raw[i];
+        if (rec->crc != journal_crc32((const uint8_t *)rec, BENCH_RAW_SIZE - sizeof(uint32_t))) {
+            continue;
+        }
+        res.moves++;
+        res.net += rec->delta;
+        if (rec->delta < 0) {
+            res.sales += (uint64_t)rec->sale_v * (uint32_t)(-rec->delta);
+        }
+    }
+    return res;
+}
+
+static void workload(void)
+{
+    static const uint8_t operators[3][7] = {
+        {0x04, 0x11, 0x22, 0x33},
+        {0x04, 0xA1, 0xB2, 0xC3, 0xD4, 0xE5, 0xF6},
+        {0x9C, 0x01, 0x02, 0x03},
+    };
+    static const uint8_t sizes[3] = {4, 7, 4};
+    uint32_t purchase[BENCH_PRODUCTS], sale[BENCH_PRODUCTS];
+    for (uint16_t p = 0; p < BENCH_PRODUCTS; p++) {
+        purchase[p] = 150 + 37 * p;
+        sale[p] = purchase[p] * 13 / 10;
+    }
+    uint32_t now = 1790000000; ///< October 2026
+    uint8_t op = 0;
+
+    for (uint32_t t = 0; t < BENCH_TRANSACTIONS; t++) {
+        if (!(t % 25)) { ///< A new shift at the dock
+            op = bench_rand() % 3;
+            history_set_operator(&history, operators[op], sizes[op]);
+        }
+        now += 30 + bench_rand() % 870;
+        CHECK(history_set_time(&history, now));
+        uint16_t p = (bench_rand() % BENCH_PRODUCTS) * (bench_rand() % 2) + bench_rand() % 8; ///< Few products sell most
+        p %= BENCH_PRODUCTS;
+        if (!(bench_rand() % 100)) {
+            sale[p] += 10;
+        }
+        int32_t delta = (bench_rand() % 5) ? -(int32_t)(1 + bench_rand() % 3) : 12 * (int32_t)(1 + bench_rand() % 2);
+        history_append(&history, 1 + p, delta, purchase[p], sale[p]);
+        if (!(t % 4)) {
+            history_sync(&history);
+        }
+
+        raw_rec_t *r = &raw[raw_n++];
+        memset(r, 0, sizeof(*r));
+        r->time = history_now(&history);
+        r->code = 1 + p;
+        r->uid_size = sizes[op];
+        r->delta = delta;
+        r->purchase_v = purchase[p];
+        r->sale_v = sale[p];
+        memcpy(r->uid, operators[op], sizes[op]);
+        r->crc = journal_crc32((const uint8_t *)r, BENCH_RAW_SIZE - sizeof(uint32_t));
+    }
+    history_sync(&history);
+}
+
+int main(void)
+{
+    flash_emu_reset();
+    host_test_quiet(true);
+    history_init(&history);
+    host_test_quiet(false);
+    workload();
+    CHECK(history.stats.records == BENCH_TRANSACTIONS);
+    CHECK(history.stats.erases <= HISTORY_SECTORS); ///< The ring never wrapped, every record is still there
+
+    // Flash used: whole data pages, the index pages are the same in both layouts
+    uint32_t pages = 0;
+    for (uint8_t s = 0; s < HISTORY_SECTORS; s++) {
+        const history_index_t *idx = (const history_index_t *)&flash_emu_xip[HISTORY_OFFSET + s * FLASH_SECTOR_SIZE];
+        for (uint8_t p = 0; idx->magic == HISTORY_MAGIC && p < HISTORY_PAGES && idx->page[p].first_time != 0xFFFFFFFFU; p++) {
+            pages++;
+        }
+    }
+    uint32_t raw_pages = (raw_n + BENCH_RAW_PER_PAGE - 1) / BENCH_RAW_PER_PAGE;
+    uint32_t ring = HISTORY_SECTORS * HISTORY_PAGES * FLASH_PAGE_SIZE;
+    double varint_bpt = (double)pages * FLASH_PAGE_SIZE / BENCH_TRANSACTIONS;
+    double raw_bpt = (double)raw_pages * FLASH_PAGE_SIZE / BENCH_TRANSACTIONS;
+    printf("%u transactions, %u products, 3 operators\n", BENCH_TRANSACTIONS, BENCH_PRODUCTS);
+    printf("Varint blocks: %.2f record bytes, %.2f flash bytes per transaction, %u pages, %u transactions per ring\n",
+           (double)history.stats.bytes / BENCH_TRANSACTIONS, varint_bpt, pages, (uint32_t)(ring / varint_bpt));
+    printf("Raw layout:    %u record bytes, %.2f flash bytes per transaction, %u pages, %u transactions per ring\n",
+           BENCH_RAW_SIZE, raw_bpt, raw_pages, (uint32_t)(ring / raw_bpt));
+    CHECK(varint_bpt < raw_bpt / 2);
+
+    // Decode throughput of a query over every record
+    history_result_t a = {0, 0, 0}, b = {0, 0, 0};
+    uint64_t t0 = time_us_64();
+    for (uint16_t r = 0; r < BENCH_ROUNDS; r++) {
+        a = history_query(&history, HISTORY_ALL, 0, UINT32_MAX, NULL, NULL);
+    }
+    uint64_t varint_us = time_us_64() - t0;
+    t0 = time_us_64();
+    for (uint16_t r = 0; r < BENCH_ROUNDS; r++) {
+        b = raw_query();
+    }
+    uint64_t raw_us = time_us_64() - t0;
+    CHECK(a.moves == BENCH_TRANSACTIONS && a.moves == b.moves && a.net == b.net && a.sales == b.sales);
+
+    double records = (double)BENCH_TRANSACTIONS * BENCH_ROUNDS;
+    printf("Decode, varint blocks: %.1f Mrecords/s, %.1f MB/s of flash\n",
+           records / (varint_us ? varint_us : 1), (double)pages * FLASH_PAGE_SIZE * BENCH_ROUNDS / (varint_us ? varint_us : 1));
+    printf("Decode, raw layout:    %.1f Mrecords/s, %.1f MB/s of flash\n",
+           records / (raw_us ? raw_us : 1), (double)raw_pages * FLASH_PAGE_SIZE * BENCH_ROUNDS / (raw_us ? raw_us : 1));
+    return host_test_result("bench_history");
+}
@@ -0,0 +1,129 @@
+/**
+ * \file        flash_emu.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "flash_emu.h"
+#include "flash_worker.h"
+
+uint8_t flash_emu_xip[PICO_FLASH_SIZE_BYTES];
+flash_emu_stats_t flash_emu_stats;
+
+static uint64_t flash_emu_budget = FLASH_EMU_NO_CUT; ///< Steps left before the power cut
+static bool flash_emu_down;
+
+/**
+ * @brief Take one step, if the power is still there.
+ *
+ * @return true if the step reaches the flash
+ */
+static bool flash_emu_step(void)
+{
+    if (flash_emu_budget != FLASH_EMU_NO_CUT) {
+        if (!flash_emu_budget) {
+            flash_emu_down = true;
+            return false;
+        }
+        flash_emu_budget--;
+    }
+    flash_emu_stats.steps++;
+    return true;
+}
+
+void flash_emu_reset(void)
+{
+    memset(flash_emu_xip, 0xFF, sizeof(flash_emu_xip));
+    memset(&flash_emu_stats, 0, sizeof(flash_emu_stats));
+    flash_emu_budget = FLASH_EMU_NO_CUT;
+    flash_emu_down = false;
+}
+
+void flash_emu_cut(uint64_t steps)
+{
+    flash_emu_budget = steps;
+    flash_emu_down = false;
+}
+
+bool flash_emu_lost(void)
+{
+    return flash_emu_down;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    assert(!(flash_offs % FLASH_SECTOR_SIZE) && !(count % FLASH_SECTOR_SIZE));
+    assert(flash_offs + count <= PICO_FLASH_SIZE_BYTES);
+    for (size_t s = 0; s < count; s += FLASH_SECTOR_SIZE) {
+        if (!flash_emu_step()) {
+            return;
+        }
+        memset(&flash_emu_xip[flash_offs + s], 0xFF, FLASH_SECTOR_SIZE);
+        flash_emu_stats.erases++;
+        flash_emu_stats.sector_erases[(flash_offs + s) / FLASH_SECTOR_SIZE]++;
+        flash_emu_stats.busy_us += FLASH_EMU_ERASE_US;
+    }
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    assert(!(flash_offs % FLASH_PAGE_SIZE) && !(count % FLASH_PAGE_SIZE));
+    assert(flash_offs + count <= PICO_FLASH_SIZE_BYTES);
+    flash_emu_stats.programs += count / FLASH_PAGE_SIZE;
+    flash_emu_stats.busy_us += (count / FLASH_PAGE_SIZE) * FLASH_EMU_PROGRAM_US;
+    for (size_t i = 0; i < count; i++) {
+        if (!flash_emu_step()) {
+            return;
+        }
+        uint8_t *cell = &flash_emu_xip[flash_offs + i];
+        if (data[i] != 0xFF && (*cell & data[i]) != data[i]) { ///< 0xFF leaves the byte as it is
+            flash_emu_stats.conflicts++;
+        }
+        *cell &= data[i];
+    }
+}
+
+// The worker of the target runs on core 1, here the operations run as they are queued
+
+void flash_worker_init(void)
+{
+}
+
+void flash_worker_erase(uint32_t offset)
+{
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+}
+
+void flash_worker_program(uint32_t offset, const uint8_t *data)
+{
+    flash_range_program(offset, data, FLASH_PAGE_SIZE);
+}
+
+void flash_worker_wait(void)
+{
+}
+
+bool flash_worker_busy(void)
+{
+    return false;
+}
+
+void flash_worker_irq_latency(uint32_t us)
+{
+    (void)us;
+}
+
+void flash_worker_print_stats(void)
+{
+    printf("Flash emulator: %u erases, %u programs, %u conflicts, %llu steps, modeled %llu us\n",
+           flash_emu_stats.erases, flash_emu_stats.programs, flash_emu_stats.conflicts,
+           (unsigned long long)flash_emu_stats.steps, (unsigned long long)flash_emu_stats.busy_us);
+}
@@ -0,0 +1,67 @@
+/**
+ * \file        flash_emu.h
+ * \brief       RAM emulator of the QSPI flash for the host tests.
+ * \details     The flash is an array that the modules read through XIP_BASE. An erase sets a
+ *              sector to 0xFF and a program can only clear bits (NOR): a byte programmed to
+ *              a value other than 0xFF that needs a bit back to 1 is counted as a conflict. The flash worker runs the operations at
+ *              once, in the order they are queued.
+ *
+ *              Power cut: the operations are a sequence of steps, an erase is one step and each
+ *              programmed byte is another one. After flash_emu_cut(n) only n more steps reach
+ *              the array, the rest are lost as if the power went down in the middle of
+ *              flash_range_program(). The modules keep running, so the test can "reboot" and
+ *              mount the image left in the array.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __FLASH_EMU_
+#define __FLASH_EMU_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/flash.h"
+
+#define FLASH_EMU_SECTORS       (PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE)
+#define FLASH_EMU_PROGRAM_US    400   ///< Typical page program time of the W25Q16 (datasheet tPP)
+#define FLASH_EMU_ERASE_US      45000 ///< Typical sector erase time of the W25Q16 (datasheet tSE)
+#define FLASH_EMU_NO_CUT        UINT64_MAX
+
+/**
+ * \typedef flash_emu_stats_t
+ * \brief Statistics of the emulator.
+ */
+typedef struct {
+    uint32_t erases;        ///< Sectors erased
+    uint32_t programs;      ///< Pages programmed
+    uint32_t conflicts;     ///< Programmed bytes (not 0xFF) that needed a 0 bit back to 1
+    uint64_t steps;         ///< Steps executed (erases and programmed bytes)
+    uint64_t busy_us;       ///< Modeled time of the flash operations (us)
+    uint32_t sector_erases[FLASH_EMU_SECTORS]; ///< Erases of each sector
+} flash_emu_stats_t;
+
+extern flash_emu_stats_t flash_emu_stats;
+
+/**
+ * @brief Erase the whole flash, clear the statistics and remove any power cut.
+ *
+ */
+void flash_emu_reset(void);
+
+/**
+ * @brief Lose the power after steps more steps.
+ *
+ * @param steps FLASH_EMU_NO_CUT to keep the power
+ */
+void flash_emu_cut(uint64_t steps);
+
+/**
+ * @brief Check if the power was lost.
+ *
+ * @return true if a step was dropped
+ */
+bool flash_emu_lost(void);
+
+#endif // __FLASH_EMU_
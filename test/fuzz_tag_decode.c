@@ -0,0 +1,226 @@
+/**
+ * \file        fuzz_tag_decode.c
+ * \brief       Host fuzz target of tag_decode().
+ * \details     tag_decode() gets random blocks, valid blocks with one or two bits flipped, and
+ *              blocks of random records with a good CRC_A, which reach the record parser. Every
+ *              damaged block must be rejected, a random block is accepted about once in 2^24,
+ *              and an accepted block must hold values in range that encode again to the same
+ *              fields. The rejections are counted by status, and the decode throughput is
+ *              measured on valid blocks and on blocks with a bad CRC_A.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/time.h"
+
+#include "host_test.h"
+#include "tag_codec.h"
+#include "nfc_rfid.h"
+
+#define FUZZ_RANDOM     1000000 ///< Random blocks
+#define FUZZ_VALID      2000    ///< Valid blocks whose bits are flipped
+#define FUZZ_RECORDS    1000000 ///< Blocks of random records with a good CRC_A
+#define FUZZ_BENCH      256     ///< Blocks of each kind in the throughput measure
+#define FUZZ_ROUNDS     4000    ///< Passes over them
+
+typedef struct {
+    const char *name;
+    uint32_t blocks;
+    uint32_t status[TAG_STATUSES];
+} fuzz_run_t;
+
+/**
+ * @brief Random 32-bit value (xorshift), reproducible from one run to the next.
+ *
+ * @return uint32_t
+ */
+static uint32_t fuzz_rand(void)
+{
+    static uint32_t x = 22;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+/**
+ * @brief Random value of a field, 0 included, with every length of its record.
+ *
+ * @param f
+ * @return uint32_t
+ */
+static uint32_t fuzz_value(const tag_field_t *f)
+{
+    uint32_t value = fuzz_rand() >> (fuzz_rand() % 32);
+    return value % ((uint64_t)f->max + 1);
+}
+
+/**
+ * @brief Random tag that fits in a coded block.
+ *
+ * @param tag
+ * @param block
+ */
+static void fuzz_valid(tag_t *tag, uint8_t *block)
+{
+    do {
+        memset(tag, 0, sizeof(*tag));
+        tag->id = fuzz_rand() & 0xFF;
+        tag->code = fuzz_value(&tag_layout[0]);
+        tag->amount = fuzz_value(&tag_layout[1]);
+        tag->purchase_v = fuzz_value(&tag_layout[2]);
+        tag->sale_v = fuzz_value(&tag_layout[3]);
+    } while (!tag_encode(tag, block));
+}
+
+/**
+ * @brief Decode a block and count its status.
+ *
+ * @param run
+ * @param block
+ * @return tag_status_t
+ */
+static tag_status_t fuzz_decode(fuzz_run_t *run, const uint8_t *block)
+{
+    tag_t tag;
+    memset(&tag, 0, sizeof(tag));
+    tag_status_t status = tag_decode(block, &tag);
+    run->blocks++;
+    CHECK(status < TAG_STATUSES);
+    if (status >= TAG_STATUSES) {
+        return status;
+    }
+    run->status[status]++;
+    if (status == TAG_OK) { ///< In range, and the same fields once encoded again
+        uint8_t again[TAG_CODEC_BLOCK];
+        tag_t copy;
+        memset(&copy, 0, sizeof(copy));
+        CHECK(tag.amount <= 0x7FFFFFFF && tag.purchase_v <= 0x7FFFFFFF && tag.sale_v <= 0x7FFFFFFF);
+        CHECK(tag_encode(&tag, again));
+        CHECK(tag_decode(again, &copy) == TAG_OK);
+        CHECK(copy.id == tag.id && copy.code == tag.code && copy.amount == tag.amount &&
+              copy.purchase_v == tag.purchase_v && copy.sale_v == tag.sale_v);
+    }
+    return status;
+}
+
+static void fuzz_print(const fuzz_run_t *run)
+{
+    printf("%s: %u blocks\n", run->name, run->blocks);
+    for (uint8_t s = 0; s < TAG_STATUSES; s++) {
+        if (run->status[s]) {
+            printf("    %-10s %u\n", tag_status_name[s], run->status[s]);
+        }
+    }
+}
+
+static void fuzz_random(void)
+{
+    fuzz_run_t run = {.name = "random blocks"};
+    uint8_t block[TAG_CODEC_BLOCK];
+    for (uint32_t i = 0; i < FUZZ_RANDOM; i++) {
+        for (uint8_t k = 0; k < TAG_CODEC_BLOCK; k++) {
+            block[k] = fuzz_rand();
+        }
+        fuzz_decode(&run, block);
+    }
+    fuzz_print(&run);
+    // Magic and version pass 1 in 256 blocks, the CRC_A 1 in 65536 of them
+    CHECK(run.status[TAG_OK] <= 2);
+    CHECK(run.status[TAG_NOT_CODED] > FUZZ_RANDOM * 15 / 16 * 99 / 100);
+    CHECK(run.status[TAG_BAD_CRC] > FUZZ_RANDOM / 256 * 9 / 10);
+}
+
+static void fuzz_flips(void)
+{
+    fuzz_run_t run = {.name = "valid blocks, 1 and 2 bits flipped"};
+    uint8_t block[TAG_CODEC_BLOCK];
+    tag_t tag;
+    uint32_t accepted = 0;
+    for (uint32_t i = 0; i < FUZZ_VALID; i++) {
+        fuzz_valid(&tag, block);
+        for (uint8_t a = 0; a < TAG_CODEC_BLOCK * 8; a++) {
+            block[a / 8] ^= 1 << (a % 8);
+            accepted += fuzz_decode(&run, block) == TAG_OK;
+            uint8_t b = fuzz_rand() % (TAG_CODEC_BLOCK * 8);
+            if (b != a) {
+                block[b / 8] ^= 1 << (b % 8);
+                accepted += fuzz_decode(&run, block) == TAG_OK;
+                block[b / 8] ^= 1 << (b % 8);
+            }
+            block[a / 8] ^= 1 << (a % 8);
+        }
+        tag_t back;
+        CHECK(tag_decode(block, &back) == TAG_OK && back.code == tag.code && back.amount == tag.amount);
+    }
+    fuzz_print(&run);
+    CHECK(!accepted); ///< The CRC_A detects every error of 1 or 2 bits
+}
+
+static void fuzz_records(void)
+{
+    fuzz_run_t run = {.name = "random records, good CRC_A"};
+    uint8_t block[TAG_CODEC_BLOCK];
+    for (uint32_t i = 0; i < FUZZ_RECORDS; i++) {
+        block[0] = TAG_CODEC_MAGIC | TAG_CODEC_VERSION;
+        block[1] = fuzz_rand();
+        for (uint8_t k = 2; k < TAG_CODEC_CRC; k++) {
+            uint8_t b = fuzz_rand();
+            block[k] = (b & 0x80) ? (uint8_t)((b & 0x70) | (b % 6)) : b; ///< Half of them with plausible headers
+        }
+        nfc_crc_a(block, TAG_CODEC_CRC, &block[TAG_CODEC_CRC]);
+        fuzz_decode(&run, block);
+    }
+    fuzz_print(&run);
+    CHECK(!run.status[TAG_BAD_CRC] && !run.status[TAG_NOT_CODED] && !run.status[TAG_BAD_VERSION]);
+    for (uint8_t s = TAG_OK; s < TAG_STATUSES; s++) { ///< Every path of the record parser is reached
+        if (s != TAG_NOT_CODED && s != TAG_BAD_VERSION && s != TAG_BAD_CRC) {
+            CHECK(run.status[s] > 0);
+        }
+    }
+}
+
+/**
+ * @brief Decode throughput of valid blocks, and of blocks rejected by the CRC_A.
+ *
+ */
+static void fuzz_bench(void)
+{
+    static uint8_t blocks[2][FUZZ_BENCH][TAG_CODEC_BLOCK];
+    static const char *const kind[2] = {"valid blocks", "blocks with a bad CRC_A"};
+    tag_t tag;
+    for (uint32_t i = 0; i < FUZZ_BENCH; i++) {
+        fuzz_valid(&tag, blocks[0][i]);
+        memcpy(blocks[1][i], blocks[0][i], TAG_CODEC_BLOCK);
+        blocks[1][i][TAG_CODEC_CRC] ^= 1;
+    }
+    for (uint8_t k = 0; k < 2; k++) {
+        uint32_t ok = 0;
+        uint64_t start = time_us_64();
+        for (uint32_t r = 0; r < FUZZ_ROUNDS; r++) {
+            for (uint32_t i = 0; i < FUZZ_BENCH; i++) {
+                ok += tag_decode(blocks[k][i], &tag) == TAG_OK;
+            }
+        }
+        uint64_t us = time_us_64() - start;
+        printf("tag_decode() of %s: %.1f M decodes/s\n", kind[k],
+               us ? (double)FUZZ_ROUNDS * FUZZ_BENCH / us : 0.0);
+        CHECK(ok == (k ? 0 : FUZZ_ROUNDS * FUZZ_BENCH));
+    }
+}
+
+int main(void)
+{
+    fuzz_random();
+    fuzz_flips();
+    fuzz_records();
+    fuzz_bench();
+    return host_test_result("fuzz_tag_decode");
+}
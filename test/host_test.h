@@ -0,0 +1,67 @@
+/**
+ * \file        host_test.h
+ * \brief       Checks and helpers shared by the host tests.
+ * \details     Each test is one executable: a failed CHECK() prints its location and the test
+ *              returns non-zero at the end, so that ctest reports it.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __HOST_TEST_
+#define __HOST_TEST_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+static unsigned host_test_checks;
+static unsigned host_test_failures;
+
+#define CHECK(cond) do { \
+        host_test_checks++; \
+        if (!(cond)) { \
+            host_test_failures++; \
+            host_test_quiet(false); \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+/**
+ * @brief Silence the printf of the modules under test, e.g. the mount message of the journal
+ * in a loop of thousands of reboots.
+ *
+ * @param quiet
+ */
+static inline void host_test_quiet(bool quiet)
+{
+    static int saved = -1;
+    fflush(stdout);
+    if (quiet && saved < 0) {
+        int null = open("/dev/null", O_WRONLY);
+        saved = dup(STDOUT_FILENO);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }else if (!quiet && saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        saved = -1;
+    }
+}
+
+/**
+ * @brief Print the summary of the test.
+ *
+ * @param name
+ * @return int Exit code of the test
+ */
+static inline int host_test_result(const char *name)
+{
+    host_test_quiet(false);
+    printf("%s: %u checks, %u failed\n", name, host_test_checks, host_test_failures);
+    return host_test_failures ? 1 : 0;
+}
+
+#endif // __HOST_TEST_
@@ -0,0 +1,124 @@
+/**
+ * \file        journal_model.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "journal_model.h"
+
+#define MODEL_SALES_CODE 0xFFFF ///< Code of the snapshot entry of the sales
+
+/**
+ * \typedef model_entry_t
+ * \brief Snapshot entry (JOURNAL_REC_SIZE bytes).
+ */
+typedef struct {
+    uint16_t code;
+    uint16_t reserved;
+    int32_t amount;
+    uint32_t price;
+    uint32_t sales_hi; ///< High word of the sales in the entry of MODEL_SALES_CODE, price is the low one
+} model_entry_t;
+
+_Static_assert(sizeof(model_entry_t) == JOURNAL_REC_SIZE, "A snapshot entry is one record slot");
+
+static void model_apply(void *ctx, const journal_rec_t *rec)
+{
+    model_t *m = ctx;
+    switch (rec->type) {
+    case JR_ADD:
+        m->amount[rec->id % MODEL_CODES] += (int32_t)rec->value;
+        break;
+    case JR_SET:
+        m->price[rec->id % MODEL_CODES] = rec->value;
+        break;
+    case JR_SALES:
+        m->sales += ((uint64_t)rec->id << 32) | rec->value;
+        break;
+    case JR_RESET:
+        memset(m->amount, 0, sizeof(m->amount));
+        memset(m->price, 0, sizeof(m->price));
+        break;
+    default: ///< JR_BATCH only frames the records that follow
+        break;
+    }
+}
+
+static void model_load(void *ctx, const void *entry)
+{
+    model_t *m = ctx;
+    model_entry_t e;
+    memcpy(&e, entry, sizeof(e));
+    if (e.code == MODEL_SALES_CODE) {
+        m->sales = ((uint64_t)e.sales_hi << 32) | e.price;
+    }else if (e.code < MODEL_CODES) {
+        m->amount[e.code] = e.amount;
+        m->price[e.code] = e.price;
+    }
+}
+
+static void model_snapshot(void *ctx)
+{
+    model_t *m = ctx;
+    uint16_t entries = 1;
+    for (uint16_t i = 0; i < MODEL_CODES; i++) {
+        entries += m->amount[i] || m->price[i];
+    }
+    journal_snapshot_begin(m->journal, entries);
+    for (uint16_t i = 0; i < MODEL_CODES; i++) {
+        if (m->amount[i] || m->price[i]) {
+            model_entry_t e = {.code = i, .amount = m->amount[i], .price = m->price[i]};
+            journal_snapshot_entry(m->journal, &e);
+        }
+    }
+    model_entry_t s = {.code = MODEL_SALES_CODE, .price = (uint32_t)m->sales, .sales_hi = (uint32_t)(m->sales >> 32)};
+    journal_snapshot_entry(m->journal, &s);
+}
+
+bool model_mount(model_t *m, journal_t *j)
+{
+    memset(m, 0, sizeof(*m));
+    m->journal = j;
+    return journal_init(j, model_apply, model_load, model_snapshot, m);
+}
+
+void model_format(model_t *m, journal_t *j)
+{
+    m->journal = j;
+    j->apply = model_apply;
+    j->load = model_load;
+    j->snapshot = model_snapshot;
+    j->ctx = m;
+    journal_format(j);
+}
+
+void model_add(model_t *m, uint16_t code, int32_t delta)
+{
+    m->amount[code] += delta;
+    journal_put(m->journal, JR_ADD, code, 0, (uint32_t)delta);
+}
+
+void model_set(model_t *m, uint16_t code, uint32_t price)
+{
+    m->price[code] = price;
+    journal_put(m->journal, JR_SET, code, 2, price);
+}
+
+void model_sale(model_t *m, uint64_t value)
+{
+    m->sales += value;
+    journal_put(m->journal, JR_SALES, (uint16_t)(value >> 32), 0, (uint32_t)value);
+}
+
+bool model_equal(const model_t *a, const model_t *b)
+{
+    return !memcmp(a->amount, b->amount, sizeof(a->amount)) && !memcmp(a->price, b->price, sizeof(a->price)) &&
+           a->sales == b->sales;
+}
@@ -0,0 +1,86 @@
+/**
+ * \file        journal_model.h
+ * \brief       Small database kept through the flash journal, for the host tests.
+ * \details     It follows the pattern of the inventory: the RAM copy is changed first, then the
+ *              record is put into the journal, so that the snapshot of a compaction already
+ *              holds the change. A snapshot entry is the state of one product code.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __JOURNAL_MODEL_
+#define __JOURNAL_MODEL_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flash_journal.h"
+
+#define MODEL_CODES 48 ///< Product codes of the database
+
+/**
+ * \typedef model_t
+ * \brief State rebuilt by the replay of the journal.
+ */
+typedef struct {
+    journal_t *journal;             ///< Journal of the changes
+    int32_t amount[MODEL_CODES];    ///< Stock of each code
+    uint32_t price[MODEL_CODES];    ///< Sale value of each code
+    uint64_t sales;                 ///< Cumulative sales
+} model_t;
+
+/**
+ * @brief Mount the journal into an empty model.
+ *
+ * @param m
+ * @param j
+ * @return true if a journal was mounted
+ */
+bool model_mount(model_t *m, journal_t *j);
+
+/**
+ * @brief Erase the journal and write the snapshot of the model.
+ *
+ * @param m
+ * @param j
+ */
+void model_format(model_t *m, journal_t *j);
+
+/**
+ * @brief Change the stock of a code and put the record (not programmed until journal_sync()).
+ *
+ * @param m
+ * @param code
+ * @param delta
+ */
+void model_add(model_t *m, uint16_t code, int32_t delta);
+
+/**
+ * @brief Change the sale value of a code and put the record.
+ *
+ * @param m
+ * @param code
+ * @param price
+ */
+void model_set(model_t *m, uint16_t code, uint32_t price);
+
+/**
+ * @brief Add to the sales and put the record.
+ *
+ * @param m
+ * @param value
+ */
+void model_sale(model_t *m, uint64_t value);
+
+/**
+ * @brief Compare the state of two models.
+ *
+ * @param a
+ * @param b
+ * @return true if they hold the same state
+ */
+bool model_equal(const model_t *a, const model_t *b);
+
+#endif // __JOURNAL_MODEL_
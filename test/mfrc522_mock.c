@@ -0,0 +1,482 @@
+/**
+ * \file        mfrc522_mock.c
+ * \brief
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mfrc522_mock.h"
+#include "functs.h"
+
+#define REG(r) ((r) >> 1) ///< Index of a register
+
+mfrc522_mock_t mfrc522_mock;
+spi_inst_t spi_host[2] = {{0}, {1}};
+
+static void mock_chip_reset(void)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    memset(m->reg, 0, sizeof(m->reg));
+    m->reg[REG(CommandReg)] = 0x20;
+    m->reg[REG(ComIEnReg)] = 0x80;
+    m->reg[REG(Status2Reg)] = 0x00;
+    m->reg[REG(WaterLevelReg)] = 0x08;
+    m->reg[REG(ControlReg)] = 0x10;
+    m->reg[REG(ModeReg)] = 0x3F;
+    m->reg[REG(TxControlReg)] = 0x80;
+    m->reg[REG(VersionReg)] = 0x92; ///< MFRC522 v2.0
+    m->fifo_n = 0;
+    m->command = PCD_Idle;
+}
+
+void mfrc522_mock_clear_stats(void)
+{
+    memset(&mfrc522_mock.stats, 0, sizeof(mfrc522_mock.stats));
+}
+
+void mfrc522_mock_reset(void)
+{
+    memset(&mfrc522_mock, 0, sizeof(mfrc522_mock));
+    mfrc522_mock.cs_pin = 0xFF;
+    mfrc522_mock.irq_pin = 0xFF;
+    mfrc522_mock.card.write = -1;
+    mock_chip_reset();
+}
+
+void mfrc522_mock_card(const uint8_t *uid)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    m->card.present = true;
+    m->card.state = MOCK_CARD_IDLE;
+    m->card.auth = false;
+    m->card.write = -1;
+    memcpy(m->card.uid, uid, 4);
+    m->card.sak = 0x08; ///< MIFARE Classic 1K
+}
+
+/**
+ * @brief Update the IRQ pin, its falling edge (active low) calls the GPIO callback.
+ *
+ */
+static void mock_irq_update(void)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    bool line = (m->reg[REG(ComIrqReg)] & m->reg[REG(ComIEnReg)] & 0x7F) ||
+                (m->reg[REG(DivIrqReg)] & m->reg[REG(DivIEnReg)] & 0x14);
+    bool edge = line && !m->irq_line;
+    m->irq_line = line;
+    if (edge && m->callback) {
+        m->callback(m->irq_pin, GPIO_IRQ_EDGE_FALL);
+    }
+}
+
+static void mock_fifo_push(uint8_t v)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    if (m->fifo_n >= FIFO_SIZE) {
+        m->reg[REG(ErrorReg)] |= 0x10; ///< BufferOvfl
+        m->stats.overflows++;
+        return;
+    }
+    m->fifo[m->fifo_n++] = v;
+}
+
+static uint8_t mock_fifo_pop(void)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    if (!m->fifo_n) {
+        return 0;
+    }
+    uint8_t v = m->fifo[0];
+    memmove(m->fifo, &m->fifo[1], --m->fifo_n);
+    return v;
+}
+
+/**
+ * @brief Answer of the card: into the FIFO, with the receive interrupt.
+ *
+ * @param data
+ * @param len
+ * @param bits Valid bits of the last byte, 0 for 8
+ */
+static void mock_answer(const uint8_t *data, uint8_t len, uint8_t bits)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    for (uint8_t i = 0; i < len; i++) {
+        mock_fifo_push(data[i]);
+    }
+    m->reg[REG(ControlReg)] = (m->reg[REG(ControlReg)] & ~0x07) | bits;
+    m->reg[REG(ComIrqReg)] |= 0x60; ///< TxIRq, RxIRq
+}
+
+/**
+ * @brief Answer with a frame and its CRC_A.
+ *
+ * @param data
+ * @param len
+ */
+static void mock_answer_crc(const uint8_t *data, uint8_t len)
+{
+    uint8_t frame[FIFO_SIZE];
+    memcpy(frame, data, len);
+    nfc_crc_a(frame, len, &frame[len]);
+    mock_answer(frame, len + 2, 0);
+}
+
+/**
+ * @brief Check the CRC_A at the end of a frame.
+ *
+ * @param frame
+ * @param len Bytes with the CRC_A
+ * @return true if it matches
+ */
+static bool mock_crc_ok(const uint8_t *frame, uint8_t len)
+{
+    uint8_t crc[2];
+    if (len < 3) {
+        return false;
+    }
+    nfc_crc_a(frame, len - 2, crc);
+    if (crc[0] != frame[len - 2] || crc[1] != frame[len - 1]) {
+        mfrc522_mock.stats.crc_errors++;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Send the FIFO to the card. No answer is a timeout of the chip timer.
+ *
+ * @param bits Valid bits of the last byte (TxLastBits)
+ */
+static void mock_transceive(uint8_t bits)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    uint8_t frame[FIFO_SIZE];
+    uint8_t len = m->fifo_n;
+    memcpy(frame, m->fifo, len);
+    m->fifo_n = 0;
+    m->stats.transceives++;
+    m->reg[REG(ErrorReg)] = 0;
+
+    static const uint8_t ack = MF_ACK, nak = 0x04;
+    uint8_t cmd = len ? frame[0] : 0;
+    if (!m->card.present || !len) {
+        m->reg[REG(ComIrqReg)] |= 0x41; ///< TxIRq, TimerIRq: nothing received
+        return;
+    }
+    if (len == 1 && bits == 7 && (cmd == PICC_CMD_REQA || cmd == PICC_CMD_WUPA)) {
+        if (m->card.state == MOCK_CARD_IDLE || (cmd == PICC_CMD_WUPA && m->card.state == MOCK_CARD_HALT)) {
+            static const uint8_t atqa[2] = {0x04, 0x00};
+            m->card.state = MOCK_CARD_READY;
+            m->card.auth = false;
+            mock_answer(atqa, 2, 0);
+            return;
+        }
+    }else if (m->card.state == MOCK_CARD_READY && len == 2 && cmd == PICC_CMD_SEL_CL1 && frame[1] == 0x20) {
+        uint8_t uid[5];
+        memcpy(uid, m->card.uid, 4);
+        uid[4] = uid[0] ^ uid[1] ^ uid[2] ^ uid[3];
+        mock_answer(uid, 5, 0);
+        return;
+    }else if (m->card.state == MOCK_CARD_READY && len == 9 && cmd == PICC_CMD_SEL_CL1 && frame[1] == 0x70) {
+        if (mock_crc_ok(frame, len) && !memcmp(&frame[2], m->card.uid, 4)) {
+            m->card.state = MOCK_CARD_ACTIVE;
+            mock_answer_crc(&m->card.sak, 1);
+            return;
+        }
+    }else if (m->card.state == MOCK_CARD_ACTIVE && m->card.write >= 0) { ///< Data of a WRITE
+        if (len == 18 && mock_crc_ok(frame, len)) {
+            memcpy(m->card.block[m->card.write], frame, 16);
+            m->card.write = -1;
+            mock_answer(&ack, 1, 4);
+            return;
+        }
+        m->card.write = -1;
+    }else if (m->card.state == MOCK_CARD_ACTIVE && len == 4 && mock_crc_ok(frame, len)) {
+        if (cmd == PICC_CMD_HLTA) {
+            m->card.state = MOCK_CARD_HALT;
+            m->card.auth = false;
+        }else if (!m->card.auth || frame[1] >= MOCK_BLOCKS) {
+            mock_answer(&nak, 1, 4);
+            return;
+        }else if (cmd == PICC_CMD_MF_READ) {
+            mock_answer_crc(m->card.block[frame[1]], 16);
+            return;
+        }else if (cmd == PICC_CMD_MF_WRITE) {
+            m->card.write = frame[1];
+            mock_answer(&ack, 1, 4);
+            return;
+        }
+    }
+    m->reg[REG(ComIrqReg)] |= 0x41; ///< TxIRq, TimerIRq: nothing received
+}
+
+static void mock_command(uint8_t command)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    m->command = command & 0x0F;
+    switch (m->command) {
+    case PCD_SoftReset:
+        mock_chip_reset();
+        break;
+    case PCD_CalcCRC: {
+        uint8_t crc[2];
+        nfc_crc_a(m->fifo, m->fifo_n, crc);
+        m->fifo_n = 0;
+        m->reg[REG(CRCResultRegL)] = crc[0];
+        m->reg[REG(CRCResultRegH)] = crc[1];
+        m->reg[REG(DivIrqReg)] |= 0x04; ///< CRCIRq
+        m->stats.calc_crc++;
+        break;
+    }
+    case PCD_MFAuthent: ///< Any key opens the sector of the selected card
+        if (m->card.present && m->card.state == MOCK_CARD_ACTIVE && m->fifo_n == 12 &&
+            !memcmp(&m->fifo[8], m->card.uid, 4)) {
+            m->card.auth = true;
+            m->reg[REG(Status2Reg)] |= 0x08; ///< MFCrypto1On
+            m->reg[REG(ComIrqReg)] |= 0x10; ///< IdleIRq
+        }else {
+            m->reg[REG(ComIrqReg)] |= 0x01; ///< TimerIRq
+        }
+        m->fifo_n = 0;
+        m->command = PCD_Idle;
+        break;
+    default: ///< Idle, or Transceive waiting for StartSend
+        break;
+    }
+}
+
+static uint8_t mock_reg_read(uint8_t i)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    switch (i) {
+    case REG(FIFODataReg):
+        return mock_fifo_pop();
+    case REG(FIFOLevelReg):
+        return m->fifo_n;
+    case REG(CommandReg):
+        return (m->reg[i] & 0xF0) | m->command;
+    default:
+        return m->reg[i];
+    }
+}
+
+static void mock_reg_write(uint8_t i, uint8_t v)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    switch (i) {
+    case REG(FIFODataReg):
+        mock_fifo_push(v);
+        break;
+    case REG(FIFOLevelReg):
+        if (v & 0x80) { ///< FlushBuffer
+            m->fifo_n = 0;
+            m->reg[REG(ErrorReg)] &= ~0x10;
+        }
+        break;
+    case REG(CommandReg):
+        m->reg[i] = v & 0xF0;
+        mock_command(v);
+        break;
+    case REG(ComIrqReg):
+    case REG(DivIrqReg):
+        if (v & 0x80) { ///< Set1/Set2: the marked bits are set, otherwise cleared
+            m->reg[i] |= v & 0x7F;
+        }else {
+            m->reg[i] &= ~v;
+        }
+        break;
+    case REG(BitFramingReg):
+        m->reg[i] = v & 0x7F;
+        if ((v & 0x80) && m->command == PCD_Transceive) { ///< StartSend
+            mock_transceive(v & 0x07);
+        }
+        break;
+    case REG(VersionReg):
+        break;
+    default:
+        m->reg[i] = v;
+        break;
+    }
+    mock_irq_update();
+}
+
+/**
+ * @brief Clock one byte in the CS window.
+ *
+ * @param mosi
+ * @return uint8_t miso
+ */
+static uint8_t mock_clock(uint8_t mosi)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    uint8_t miso = 0;
+    m->stats.bytes++;
+    if (!m->window) {
+        m->stats.violations++; ///< Clocked without CS
+        return 0;
+    }
+    if (m->first) { ///< Address byte
+        m->first = false;
+        m->reading = mosi & READ_BIT;
+        m->addr = (mosi >> 1) & (NFC_REGISTERS - 1);
+        return 0;
+    }
+    if (m->reading) {
+        if (m->stopped) {
+            m->stats.violations++;
+            return 0;
+        }
+        miso = mock_reg_read(m->addr);
+        if (!mosi) {
+            m->stopped = true;
+        }else if (!(mosi & READ_BIT)) {
+            m->stats.violations++; ///< A write address in a read window
+        }else {
+            m->addr = (mosi >> 1) & (NFC_REGISTERS - 1);
+        }
+        return miso;
+    }
+    mock_reg_write(m->addr, mosi);
+    return 0;
+}
+
+// ---------------- SDK functions of the bus ----------------
+
+void gpio_put(uint gpio, bool value)
+{
+    mfrc522_mock_t *m = &mfrc522_mock;
+    if (gpio != m->cs_pin) {
+        return;
+    }
+    if (!value && !m->window) { ///< CS asserted: a new transaction
+        m->window = true;
+        m->first = true;
+        m->reading = false;
+        m->stopped = false;
+        m->stats.transactions++;
+    }else if (value && m->window) {
+        m->window = false;
+        if (m->reading && !m->stopped) {
+            m->stats.violations++; ///< A burst read ends with 0x00
+        }
+    }
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback)
+{
+    (void)event_mask;
+    mfrc522_mock.irq_pin = gpio;
+    mfrc522_mock.callback = enabled ? callback : NULL;
+}
+
+uint spi_init(spi_inst_t *spi, uint baudrate)
+{
+    (void)spi;
+    return baudrate;
+}
+
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate)
+{
+    (void)spi;
+    return baudrate;
+}
+
+void spi_set_format(spi_inst_t *spi, uint data_bits, int cpol, int cpha, int order)
+{
+    (void)spi; (void)data_bits; (void)cpol; (void)cpha; (void)order;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len)
+{
+    (void)spi;
+    for (size_t i = 0; i < len; i++) {
+        mock_clock(src[i]);
+    }
+    return (int)len;
+}
+
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len)
+{
+    (void)spi;
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = mock_clock(repeated_tx_data);
+    }
+    if (len > 1) {
+        mfrc522_mock.stats.bursts++;
+    }
+    return (int)len;
+}
+
+// ---------------- DMA engine: the transfer runs at once ----------------
+
+void spi_dma_init(spi_dma_t *d, spi_inst_t *spi, uint8_t cs)
+{
+    memset(d, 0, sizeof(*d));
+    d->spi = spi;
+    d->cs = cs;
+    mfrc522_mock.cs_pin = cs;
+}
+
+bool spi_dma_write(spi_dma_t *d, uint8_t reg, const uint8_t *data, uint16_t len,
+                   void (*done)(spi_dma_t *d, void *ctx), void *ctx)
+{
+    gpio_put(d->cs, 0);
+    spi_write_blocking(d->spi, &reg, 1);
+    spi_write_blocking(d->spi, data, len);
+    gpio_put(d->cs, 1);
+    mfrc522_mock.stats.bursts += len > 1;
+    mfrc522_mock.stats.dma++;
+    d->stats.transfers++;
+    d->stats.bytes += len + 1;
+    if (done) {
+        done(d, ctx);
+    }
+    return true;
+}
+
+bool spi_dma_read(spi_dma_t *d, uint8_t reg, uint8_t *data, uint16_t len,
+                  void (*done)(spi_dma_t *d, void *ctx), void *ctx)
+{
+    gpio_put(d->cs, 0);
+    spi_write_blocking(d->spi, &reg, 1);
+    for (uint16_t i = 0; i < len; i++) { ///< The address repeated, then the stop
+        data[i] = mock_clock(i + 1 < len ? reg : 0);
+    }
+    gpio_put(d->cs, 1);
+    mfrc522_mock.stats.bursts += len > 1;
+    mfrc522_mock.stats.dma++;
+    d->stats.transfers++;
+    d->stats.bytes += len + 1;
+    if (done) {
+        done(d, ctx);
+    }
+    return true;
+}
+
+void spi_dma_wait(spi_dma_t *d)
+{
+    (void)d;
+}
+
+/**
+ * @brief Stand-in of the GPIO callback of functs.c: the IRQ pin of the mock reaches the reader.
+ *
+ * @param num
+ * @param mask
+ */
+void gpioCallback(uint num, uint32_t mask)
+{
+    (void)mask;
+    if (mfrc522_mock.reader && num == mfrc522_mock.reader->pinout.irq) {
+        nfc_irq(mfrc522_mock.reader);
+    }
+}
@@ -0,0 +1,112 @@
+/**
+ * \file        mfrc522_mock.h
+ * \brief       SPI-level mock of the MFRC522 and of one MIFARE Classic card, for the host tests.
+ * \details     The mock decodes the bytes clocked in each CS window as the chip does: the first
+ *              byte is the address, a write window feeds the register (the FIFO keeps growing)
+ *              and a read window returns the register addressed by the previous byte, so a
+ *              burst read repeats the address and ends with 0x00. The transactions and the bytes
+ *              are counted, and a read window that is not ended by 0x00, or that goes on after
+ *              it, is a protocol violation.
+ *
+ *              Behind the registers there is the FIFO, the CalcCRC coprocessor, MFAuthent and
+ *              a Transceive that answers REQA, ANTICOLLISION, SELECT, READ, WRITE and HLTA of
+ *              cascade level 1 with CRC_A, like a MIFARE Classic 1K. A frame with a wrong CRC_A
+ *              gets no answer. The IRQ pin follows ComIrqReg/DivIrqReg and their enable
+ *              registers, its falling edge calls the registered GPIO callback.
+ *
+ *              spi_dma.c needs the DMA channels of the RP2040, so the mock provides the
+ *              spi_dma functions too: each transfer runs at once, in one CS window on the bus.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __MFRC522_MOCK_
+#define __MFRC522_MOCK_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nfc_rfid.h"
+
+#define MOCK_BLOCKS 64 ///< Blocks of the card (MIFARE Classic 1K)
+
+/**
+ * \typedef mock_card_state_t
+ * \brief States of the card (ISO 14443-3).
+ */
+typedef enum {
+    MOCK_CARD_IDLE,
+    MOCK_CARD_READY,
+    MOCK_CARD_ACTIVE,
+    MOCK_CARD_HALT
+} mock_card_state_t;
+
+/**
+ * \typedef mfrc522_mock_t
+ * \brief State of the mock.
+ */
+typedef struct {
+    uint8_t reg[NFC_REGISTERS];     ///< Registers, by index (address >> 1)
+    uint8_t fifo[FIFO_SIZE];
+    uint8_t fifo_n;                 ///< Bytes in the FIFO
+    uint8_t command;                ///< Command in progress
+
+    bool window;                    ///< CS is low
+    bool first;                     ///< The next byte is the address of the window
+    bool reading;                   ///< Read window
+    bool stopped;                   ///< The read window was ended by 0x00
+    uint8_t addr;                   ///< Register index of the window
+
+    uint8_t cs_pin;                 ///< Chip select, from spi_dma_init()
+    uint8_t irq_pin;                ///< IRQ pin, from gpio_set_irq_enabled_with_callback()
+    bool irq_line;                  ///< The IRQ pin is asserted
+    gpio_irq_callback_t callback;   ///< Callback of the IRQ pin
+    nfc_rfid_t *reader;             ///< Reader notified by the default gpioCallback()
+
+    struct {
+        bool present;               ///< The card is in the field
+        mock_card_state_t state;
+        bool auth;                  ///< The sector is authenticated
+        int16_t write;              ///< Block of a WRITE waiting for its data, -1 if none
+        uint8_t uid[4];
+        uint8_t sak;
+        uint8_t block[MOCK_BLOCKS][16];
+    } card;
+
+    struct {
+        uint32_t transactions;      ///< CS windows
+        uint32_t bytes;             ///< Bytes clocked, address bytes included
+        uint32_t bursts;            ///< Windows with more than one data byte
+        uint32_t dma;               ///< Transfers of the spi_dma functions
+        uint32_t violations;        ///< Read windows not ended by 0x00, bytes after the stop
+        uint32_t overflows;         ///< Bytes written to a full FIFO
+        uint32_t transceives;       ///< Frames sent to the card
+        uint32_t crc_errors;        ///< Frames dropped by the card for their CRC_A
+        uint32_t calc_crc;          ///< CalcCRC commands
+    } stats;
+} mfrc522_mock_t;
+
+extern mfrc522_mock_t mfrc522_mock;
+
+/**
+ * @brief Reset the chip, remove the card and clear the statistics.
+ *
+ */
+void mfrc522_mock_reset(void);
+
+/**
+ * @brief Put a MIFARE Classic card with a 4-byte UID in the field.
+ *
+ * @param uid
+ */
+void mfrc522_mock_card(const uint8_t *uid);
+
+/**
+ * @brief Clear the statistics.
+ *
+ */
+void mfrc522_mock_clear_stats(void);
+
+#endif // __MFRC522_MOCK_
@@ -0,0 +1,26 @@
+/**
+ * \file        flash.h
+ * \brief       Host stand-in of hardware/flash.h, backed by the flash emulator.
+ * \details     The XIP window is the RAM array of the emulator, so the modules read the flash
+ *              through XIP_BASE as they do on the target.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __HOST_HARDWARE_FLASH_
+#define __HOST_HARDWARE_FLASH_
+
+#include "pico.h"
+
+#define FLASH_PAGE_SIZE     (1u << 8)
+#define FLASH_SECTOR_SIZE   (1u << 12)
+
+extern uint8_t flash_emu_xip[PICO_FLASH_SIZE_BYTES]; ///< Content of the emulated flash
+#define XIP_BASE ((uintptr_t)flash_emu_xip)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif // __HOST_HARDWARE_FLASH_
@@ -0,0 +1,19 @@
+/**
+ * \file        irq.h
+ * \brief       Host stand-in of hardware/irq.h: the IRQ numbers of the RP2040.
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __HOST_HARDWARE_IRQ_
+#define __HOST_HARDWARE_IRQ_
+
+#include "pico.h"
+
+enum { TIMER_IRQ_0 = 0, TIMER_IRQ_1 = 1, TIMER_IRQ_2 = 2, TIMER_IRQ_3 = 3, DMA_IRQ_0 = 11, IO_IRQ_BANK0 = 13,
+       SPI0_IRQ = 18, SPI1_IRQ = 19 };
+
+#endif // __HOST_HARDWARE_IRQ_
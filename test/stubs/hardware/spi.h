@@ -0,0 +1,40 @@
+/**
+ * \file        spi.h
+ * \brief       Host stand-in of hardware/spi.h, the bus is the MFRC522 mock.
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __HOST_HARDWARE_SPI_
+#define __HOST_HARDWARE_SPI_
+
+#include "pico.h"
+#include "hardware/gpio.h"
+
+typedef struct spi_inst {
+    uint index;
+} spi_inst_t;
+
+extern spi_inst_t spi_host[2];
+#define spi0 (&spi_host[0])
+#define spi1 (&spi_host[1])
+
+typedef enum { SPI_CPHA_0 = 0, SPI_CPHA_1 = 1 } spi_cpha_t;
+typedef enum { SPI_CPOL_0 = 0, SPI_CPOL_1 = 1 } spi_cpol_t;
+typedef enum { SPI_LSB_FIRST = 0, SPI_MSB_FIRST = 1 } spi_order_t;
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate);
+void spi_set_format(spi_inst_t *spi, uint data_bits, int cpol, int cpha, int order);
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len);
+
+static inline uint spi_get_index(const spi_inst_t *spi)
+{
+    return spi->index;
+}
+
+#endif // __HOST_HARDWARE_SPI_
@@ -0,0 +1,20 @@
+/**
+ * \file        sync.h
+ * \brief       Host stand-in of hardware/sync.h: there is a single thread, the events are no-ops.
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __HOST_HARDWARE_SYNC_
+#define __HOST_HARDWARE_SYNC_
+
+#include "pico.h"
+
+static inline void __sev(void) {}
+static inline void __wfe(void) {}
+static inline void __dmb(void) {}
+
+#endif // __HOST_HARDWARE_SYNC_
@@ -0,0 +1,36 @@
+/**
+ * \file        pico.h
+ * \brief       Host stand-in of the Pico SDK base header, for the host tests.
+ * \details     Only the types and macros used by the modules under test. The flash size is
+ *              reduced so that the flash emulator stays small; the journal and the history
+ *              keep their layout at the top of it.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __HOST_PICO_
+#define __HOST_PICO_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+typedef unsigned int uint;
+
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES   (128 * 1024) ///< Emulated flash: the journal and the history areas fit in it
+#endif
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+#define __not_in_flash_func(f) f
+#define __time_critical_func(f) f
+
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#define MAX(a, b) ((b) < (a) ? (a) : (b))
+
+static inline void tight_loop_contents(void) {}
+
+#endif // __HOST_PICO_
@@ -0,0 +1,17 @@
+/**
+ * \file        binary_info.h
+ * \brief       Host stand-in of pico/binary_info.h: there is no binary info on the host.
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __HOST_PICO_BINARY_INFO_
+#define __HOST_PICO_BINARY_INFO_
+
+#define bi_decl(x)
+#define bi_2pins_with_func(a, b, c) 0
+
+#endif // __HOST_PICO_BINARY_INFO_
@@ -0,0 +1,56 @@
+/**
+ * \file        time.h
+ * \brief       Host stand-in of pico/time.h: the microsecond clock is the monotonic clock of the host.
+ * \details
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef __HOST_PICO_TIME_
+#define __HOST_PICO_TIME_
+
+#include "pico.h"
+
+typedef uint64_t absolute_time_t;
+
+/**
+ * @brief Microseconds since an arbitrary point of the host clock.
+ *
+ * @return uint64_t
+ */
+uint64_t time_us_64(void);
+
+static inline uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us)
+{
+    return time_us_64() + us;
+}
+
+/**
+ * @brief There is no event to wait for on the host: return at once, like a spurious wake-up.
+ *
+ * @param t
+ * @return true if the timeout is reached
+ */
+static inline bool best_effort_wfe_or_timeout(absolute_time_t t)
+{
+    return time_us_64() >= t;
+}
+
+static inline void sleep_ms(uint32_t ms)
+{
+    (void)ms; ///< The mocks answer at once
+}
+
+static inline void sleep_us(uint64_t us)
+{
+    (void)us;
+}
+
+#endif // __HOST_PICO_TIME_
@@ -0,0 +1,191 @@
+/**
+ * \file        test_crc_a.c
+ * \brief       Host test of the CRC_A of the MCU.
+ * \details     nfc_crc_a() is checked against the examples of ISO/IEC 14443-3 Annex B and the
+ *              frames of the reader (HLTA, READ, RATS), then against a bitwise reference on
+ *              random frames. On the MFRC522 mock, nfc_calculate_crc() must give the result of
+ *              the CalcCRC coprocessor without any SPI transaction, and the SPI cost of
+ *              nfc_read_card() is compared between both ways.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/time.h"
+
+#include "host_test.h"
+#include "mfrc522_mock.h"
+
+#define CRC_FRAMES  20000 ///< Random frames checked against the reference
+#define CRC_BENCH   200000 ///< Frames of the throughput measure
+
+typedef struct {
+    const char *name;
+    uint8_t len;
+    uint8_t data[8];
+    uint8_t crc[2]; ///< Low byte first, as sent on air
+} crc_vector_t;
+
+static const crc_vector_t vectors[] = {
+    {"empty frame",         0, {0},             {0x63, 0x63}},
+    {"Annex B 00 00",       2, {0x00, 0x00},    {0xA0, 0x1E}},
+    {"Annex B 12 34",       2, {0x12, 0x34},    {0x26, 0xCF}},
+    {"HLTA",                2, {0x50, 0x00},    {0x57, 0xCD}},
+    {"READ block 0",        2, {0x30, 0x00},    {0x02, 0xA8}},
+    {"RATS",                2, {0xE0, 0x50},    {0xBC, 0xA5}},
+};
+
+static nfc_rfid_t nfc;
+static const uint8_t uid[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+
+/**
+ * @brief Bitwise CRC_A: preset 0x6363, polynomial x^16 + x^12 + x^5 + 1, LSB first.
+ *
+ * @param data
+ * @param len
+ * @param result Low byte first
+ */
+static void crc_a_bitwise(const uint8_t *data, uint8_t len, uint8_t *result)
+{
+    uint16_t crc = 0x6363;
+    for (uint8_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+    result[0] = crc & 0xFF;
+    result[1] = crc >> 8;
+}
+
+static void test_vectors(void)
+{
+    uint8_t crc[2];
+    for (size_t i = 0; i < count_of(vectors); i++) {
+        nfc_crc_a(vectors[i].data, vectors[i].len, crc);
+        if (memcmp(crc, vectors[i].crc, 2)) {
+            printf("%s: %02X %02X, expected %02X %02X\n", vectors[i].name, crc[0], crc[1],
+                   vectors[i].crc[0], vectors[i].crc[1]);
+        }
+        CHECK(!memcmp(crc, vectors[i].crc, 2));
+    }
+
+    // SELECT of cascade level 1: the CRC_A appended to the frame gives a residue of 0
+    uint8_t select[9] = {0x93, 0x70, uid[0], uid[1], uid[2], uid[3], uid[0] ^ uid[1] ^ uid[2] ^ uid[3]};
+    nfc_crc_a(select, 7, &select[7]);
+    crc_a_bitwise(select, 7, crc);
+    CHECK(!memcmp(crc, &select[7], 2));
+    nfc_crc_a(select, 9, crc);
+    CHECK(crc[0] == 0 && crc[1] == 0);
+}
+
+static void test_random(void)
+{
+    uint8_t frame[UINT8_MAX], crc[2], ref[2];
+    srand(15);
+    for (uint32_t i = 0; i < CRC_FRAMES; i++) {
+        uint8_t len = (uint8_t)((i % 8) ? rand() % 64 : rand() % (int)sizeof(frame)); ///< Mostly FIFO-sized frames
+        for (uint8_t k = 0; k < len; k++) {
+            frame[k] = rand();
+        }
+        nfc_crc_a(frame, len, crc);
+        crc_a_bitwise(frame, len, ref);
+        CHECK(!memcmp(crc, ref, 2));
+    }
+}
+
+static void setup(bool crc_hw)
+{
+    mfrc522_mock_reset();
+    memset(&nfc, 0, sizeof(nfc));
+    mfrc522_mock.reader = &nfc;
+    nfc_init_as_spi(&nfc, spi0, 18, 19, 16, 17, 20, 21);
+    nfc.crc_hw = crc_hw;
+    mfrc522_mock_card(uid);
+    for (uint8_t i = 0; i < 16; i++) {
+        mfrc522_mock.card.block[4][i] = 0x40 + i;
+    }
+    mfrc522_mock_clear_stats();
+}
+
+/**
+ * @brief SPI transactions of a select, an authentication and a block read.
+ *
+ * @param crc_hw
+ * @param read Transactions of nfc_read_card() alone
+ * @return uint32_t Transactions of the whole sequence
+ */
+static uint32_t read_cost(bool crc_hw, uint32_t *read)
+{
+    uint8_t atqa[2], size = sizeof(atqa), buffer[18];
+    setup(crc_hw);
+    CHECK(nfc_requestA(&nfc, atqa, &size) == STATUS_OK);
+    CHECK(nfc_select(&nfc, &nfc.uid, 0) == STATUS_OK);
+    CHECK(nfc_authenticate(&nfc, PICC_CMD_MF_AUTH_KEY_A, 4, nfc.keyByte, &nfc.uid) == STATUS_OK);
+    uint32_t before = mfrc522_mock.stats.transactions;
+    size = sizeof(buffer);
+    CHECK(nfc_read_card(&nfc, 4, buffer, &size) == STATUS_OK);
+    CHECK(!memcmp(buffer, mfrc522_mock.card.block[4], 16));
+    CHECK(!mfrc522_mock.stats.crc_errors && !mfrc522_mock.stats.violations);
+    CHECK(crc_hw ? mfrc522_mock.stats.calc_crc > 0 : mfrc522_mock.stats.calc_crc == 0);
+    *read = mfrc522_mock.stats.transactions - before;
+    return mfrc522_mock.stats.transactions;
+}
+
+static void test_reader(void)
+{
+    uint8_t frame[18], sw[2], hw[2];
+    for (uint8_t i = 0; i < sizeof(frame); i++) {
+        frame[i] = 0xA0 + i;
+    }
+
+    // Both ways agree, the MCU needs no transaction
+    setup(true);
+    CHECK(nfc_calculate_crc(&nfc, frame, sizeof(frame), hw) == STATUS_OK);
+    CHECK(mfrc522_mock.stats.calc_crc == 1);
+    nfc.crc_hw = false;
+    mfrc522_mock_clear_stats();
+    CHECK(nfc_calculate_crc(&nfc, frame, sizeof(frame), sw) == STATUS_OK);
+    CHECK(!memcmp(sw, hw, 2));
+    CHECK(mfrc522_mock.stats.transactions == 0 && mfrc522_mock.stats.calc_crc == 0);
+
+    uint32_t read_sw, read_hw;
+    uint32_t all_sw = read_cost(false, &read_sw);
+    uint32_t all_hw = read_cost(true, &read_hw);
+    printf("select + authenticate + read: %u SPI transactions with the CRC_A of the MCU, %u with CalcCRC\n",
+           all_sw, all_hw);
+    printf("nfc_read_card(): %u SPI transactions with the CRC_A of the MCU, %u with CalcCRC\n", read_sw, read_hw);
+    CHECK(read_sw < read_hw && all_sw < all_hw);
+}
+
+static void bench(void)
+{
+    uint8_t frame[18], crc[2];
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < sizeof(frame); i++) {
+        frame[i] = i * 29;
+    }
+    uint64_t start = time_us_64();
+    for (uint32_t i = 0; i < CRC_BENCH; i++) {
+        frame[0] = i;
+        nfc_crc_a(frame, sizeof(frame), crc);
+        sum += crc[0] ^ crc[1];
+    }
+    uint64_t us = time_us_64() - start;
+    printf("nfc_crc_a(): %.1f M frames/s of 18 bytes (checksum %u)\n", us ? (double)CRC_BENCH / us : 0.0, sum);
+}
+
+int main(void)
+{
+    test_vectors();
+    test_random();
+    test_reader();
+    bench();
+    return host_test_result("test_crc_a");
+}
@@ -0,0 +1,190 @@
+/**
+ * \file        test_journal.c
+ * \brief       Host test of the flash journal on the flash emulator: append, replay and compaction.
+ * \details     Each reboot mounts the flash image into a new model, which must match the one
+ *              kept in RAM. The test ends with the cost of 10k transactions: pages programmed,
+ *              sector erases, their wear over the ring and the modeled flash time per commit.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/time.h"
+
+#include "host_test.h"
+#include "flash_emu.h"
+#include "journal_model.h"
+
+#define TEST_TRANSACTIONS 10000 ///< Transactions of the wear run
+
+static journal_t journal;
+static model_t model;
+
+/**
+ * @brief Mount the flash image as a reboot would and compare it with the model in RAM.
+ *
+ * @return true if the replayed state matches
+ */
+static bool reboot_matches(void)
+{
+    static journal_t j;
+    static model_t m;
+    memset(&j, 0, sizeof(j));
+    host_test_quiet(true);
+    bool mounted = model_mount(&m, &j);
+    host_test_quiet(false);
+    CHECK(j.stats.mount_reads <= 4); ///< Binary search over the 8 sectors of the ring
+    return mounted && model_equal(&m, &model) && j.slot == journal.slot && j.seq == journal.seq &&
+           j.sector == journal.sector && j.epoch == journal.epoch;
+}
+
+static void test_blank(void)
+{
+    flash_emu_reset();
+    memset(&journal, 0, sizeof(journal));
+    CHECK(!model_mount(&model, &journal)); ///< Nothing to mount in an erased area
+    model_format(&model, &journal);
+    CHECK(journal.epoch == 1 && journal.sector == 0);
+    CHECK(reboot_matches());
+}
+
+static void test_append_replay(void)
+{
+    for (uint16_t i = 0; i < 40; i++) {
+        model_add(&model, i % MODEL_CODES, 5 + i);
+        journal_sync(&journal);
+    }
+    model_set(&model, 3, 1250);
+    model_sale(&model, 0x100000010ULL);
+    journal_sync(&journal);
+    CHECK(reboot_matches());
+
+    // Records staged in the page buffer are lost without a sync, the RAM copy keeps them
+    uint32_t programs = journal.stats.programs;
+    model_add(&model, 7, -3);
+    CHECK(journal.stats.programs == programs);
+    journal_sync(&journal);
+    CHECK(journal.stats.programs == programs + 1);
+    CHECK(reboot_matches());
+}
+
+static void test_batch(void)
+{
+    journal_put(&journal, JR_BATCH, 3, 0, 0);
+    model_add(&model, 1, 10);
+    model_add(&model, 2, 20);
+    model_add(&model, 3, -30);
+    journal_sync(&journal);
+    CHECK(reboot_matches());
+
+    // Torn batch: the last record never reached the flash. The mount drops the whole batch
+    // and the records appended after it are still replayed.
+    model_t before = model;
+    journal_put(&journal, JR_BATCH, 3, 0, 0);
+    model_add(&model, 4, 1);
+    model_add(&model, 5, 1);
+    journal_sync(&journal);
+    journal.seq++; ///< The third record is lost
+    model = before;
+    model.journal = &journal;
+
+    static journal_t j;
+    static model_t m;
+    memset(&j, 0, sizeof(j));
+    host_test_quiet(true);
+    CHECK(model_mount(&m, &j));
+    host_test_quiet(false);
+    CHECK(model_equal(&m, &model));
+    CHECK(j.seq == journal.seq);
+    journal = j; ///< Continue from the mounted journal, as after a reboot
+    model = m;
+    model.journal = &journal;
+    journal.ctx = &model;
+    model_add(&model, 6, 2);
+    journal_sync(&journal);
+    CHECK(reboot_matches());
+}
+
+static void test_compaction(void)
+{
+    uint32_t compactions = journal.stats.compactions;
+    uint32_t epoch = journal.epoch;
+    for (uint16_t i = 0; i < 3 * JOURNAL_RECS_PER_SECTOR; i++) {
+        model_add(&model, i % MODEL_CODES, 1);
+        journal_sync(&journal);
+        if (journal.stats.compactions != compactions) {
+            CHECK(reboot_matches()); ///< Right after the compaction: the snapshot alone
+            compactions = journal.stats.compactions;
+        }
+    }
+    CHECK(journal.epoch >= epoch + 2);
+    CHECK(reboot_matches());
+}
+
+static void test_wear(void)
+{
+    flash_emu_reset();
+    memset(&journal, 0, sizeof(journal));
+    memset(&model, 0, sizeof(model));
+    model_format(&model, &journal);
+    flash_emu_stats_t start = flash_emu_stats;
+    uint64_t host_us = 0, host_max_us = 0;
+
+    srand(1);
+    for (uint32_t t = 0; t < TEST_TRANSACTIONS; t++) {
+        uint16_t code = rand() % MODEL_CODES;
+        uint64_t t0 = time_us_64();
+        if (t % 10 == 9) { ///< A sale: the stock and the sales, all or nothing
+            journal_put(&journal, JR_BATCH, 2, 0, 0);
+            model_add(&model, code, -1);
+            model_sale(&model, 1000 + code);
+        }else {
+            model_add(&model, code, (rand() % 9) - 4);
+        }
+        journal_sync(&journal);
+        uint64_t us = time_us_64() - t0;
+        host_us += us;
+        if (us > host_max_us) {
+            host_max_us = us;
+        }
+        if (!(t % 997)) {
+            CHECK(reboot_matches());
+        }
+    }
+    CHECK(reboot_matches());
+    CHECK(!flash_emu_stats.conflicts); ///< A programmed bit is never set back to 1
+
+    // Wear leveling: the compactions go around the ring
+    uint32_t lo = UINT32_MAX, hi = 0;
+    for (uint8_t s = 0; s < JOURNAL_SECTORS; s++) {
+        uint32_t n = flash_emu_stats.sector_erases[JOURNAL_OFFSET / FLASH_SECTOR_SIZE + s];
+        lo = n < lo ? n : lo;
+        hi = n > hi ? n : hi;
+    }
+    CHECK(hi - lo <= 1);
+
+    uint32_t programs = flash_emu_stats.programs - start.programs;
+    uint32_t erases = flash_emu_stats.erases - start.erases;
+    uint64_t busy_us = flash_emu_stats.busy_us - start.busy_us;
+    printf("%u transactions: %u pages programmed, %u sector erases (%u..%u per sector), %u compactions\n",
+           TEST_TRANSACTIONS, programs, erases, lo, hi, journal.stats.compactions);
+    printf("Modeled flash time: %llu ms, %llu us per commit; host time %llu us per commit, max %llu us\n",
+           (unsigned long long)busy_us / 1000, (unsigned long long)busy_us / TEST_TRANSACTIONS,
+           (unsigned long long)host_us / TEST_TRANSACTIONS, (unsigned long long)host_max_us);
+    printf("Previous layout, one sector erase per transaction: %u erases\n", TEST_TRANSACTIONS);
+}
+
+int main(void)
+{
+    test_blank();
+    test_append_replay();
+    test_batch();
+    test_compaction();
+    test_wear();
+    return host_test_result("test_journal");
+}
@@ -0,0 +1,348 @@
+/**
+ * \file        test_power_cut.c
+ * \brief       Host test of the crash consistency of the journal and of the history: power cut at every step of a commit.
+ * \details     For each operation of a script (appends, batches, and the compactions they
+ *              trigger around the ring), the operation is first run to count its flash steps,
+ *              then replayed from the same flash image with the power cut after 0, 1, ... all
+ *              of them, i.e. at every byte offset of every flash_range_program() and around
+ *              every erase. Each cut is followed by a reboot, which must mount either the state
+ *              before the operation or the state after it, never a mix. The mounted journal
+ *              must then accept new records that survive the next reboot.
+ *
+ *              The history gets the same treatment, one record and history_sync() per
+ *              operation, through the pages of a sector and the rotation to the next one: the
+ *              records synced before must all be found, in order, and the clock of the mounted
+ *              history must go on after them. The cuts between the program of a page and the
+ *              one of its index entry are counted, and an image of the previous releases, whose
+ *              index entry was programmed before its page, is mounted too.
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "flash_emu.h"
+#include "journal_model.h"
+#include "history.h"
+
+#define TEST_COMPACTIONS (JOURNAL_SECTORS + 2) ///< The script goes around the ring once and wraps
+#define JOURNAL_BYTES    (JOURNAL_SECTORS * FLASH_SECTOR_SIZE)
+#define HISTORY_BYTES    (HISTORY_SECTORS * FLASH_SECTOR_SIZE)
+#define HISTORY_T0       2000000000u ///< Clock of the first record
+#define HISTORY_STEP     60 ///< Seconds between two records
+#define HISTORY_OPS      1024 ///< Records of the history script, at most
+#define HISTORY_MARK     999 ///< Product of the record appended after a reboot
+
+static journal_t journal;
+static model_t model;
+
+/**
+ * @brief Run operation n of the script and commit it.
+ *
+ * @param m
+ * @param n
+ */
+static void op_run(model_t *m, uint32_t n)
+{
+    uint16_t code = (n * 7) % MODEL_CODES;
+    switch (n % 5) {
+    case 0:
+    case 1:
+        model_add(m, code, (int32_t)(n % 9) - 4);
+        break;
+    case 2: ///< A sale of two products, all or nothing
+        journal_put(m->journal, JR_BATCH, 3, 0, 0);
+        model_add(m, code, -1);
+        model_add(m, (code + 1) % MODEL_CODES, -2);
+        model_sale(m, 1000 + n);
+        break;
+    case 3:
+        model_set(m, code, 100 + n);
+        break;
+    default:
+        model_sale(m, n);
+        break;
+    }
+    journal_sync(m->journal);
+}
+
+/**
+ * @brief Restore the journal, the model and the flash image taken before an operation.
+ *
+ * @param j
+ * @param m
+ * @param image
+ */
+static void restore(const journal_t *j, const model_t *m, const uint8_t *image)
+{
+    memcpy(&flash_emu_xip[JOURNAL_OFFSET], image, JOURNAL_BYTES);
+    journal = *j;
+    model = *m;
+    model.journal = &journal;
+    journal.ctx = &model;
+}
+
+/**
+ * @brief Power cut at every step of the commits of the journal script.
+ *
+ */
+static void test_journal(void)
+{
+    static uint8_t image[JOURNAL_BYTES];
+    static journal_t j_old, j2, j3;
+    static model_t m_old, m_new, m2, m3;
+    uint32_t ops = 0, cuts = 0, olds = 0, news = 0, compaction_cuts = 0;
+
+    flash_emu_reset();
+    memset(&journal, 0, sizeof(journal));
+    host_test_quiet(true);
+    model_mount(&model, &journal);
+    model_format(&model, &journal);
+
+    for (uint32_t n = 0; journal.stats.compactions < TEST_COMPACTIONS; n++) {
+        // The state before the operation, and the state after it with all its steps
+        memcpy(image, &flash_emu_xip[JOURNAL_OFFSET], JOURNAL_BYTES);
+        j_old = journal;
+        m_old = model;
+        uint64_t steps = flash_emu_stats.steps;
+        op_run(&model, n);
+        steps = flash_emu_stats.steps - steps;
+        bool compacted = journal.stats.compactions != j_old.stats.compactions;
+        m_new = model;
+
+        bool seen_new = false;
+        for (uint64_t cut = 0; cut <= steps; cut++) {
+            restore(&j_old, &m_old, image);
+            flash_emu_cut(cut);
+            op_run(&model, n);
+            flash_emu_cut(FLASH_EMU_NO_CUT);
+
+            memset(&j2, 0, sizeof(j2));
+            CHECK(model_mount(&m2, &j2));
+            bool is_old = model_equal(&m2, &m_old);
+            bool is_new = model_equal(&m2, &m_new);
+            CHECK(is_old || is_new);
+            CHECK(cut || is_old);           ///< Nothing reached the flash
+            CHECK(cut < steps || is_new);   ///< Every step reached the flash
+            CHECK(!(seen_new && !is_new));  ///< Once committed, the operation stays committed
+            seen_new |= is_new;
+            olds += is_old && !is_new;
+            news += is_new;
+            cuts++;
+            compaction_cuts += compacted;
+
+            // The mounted journal goes on: a new record survives the next reboot
+            model_add(&m2, 0, 1);
+            journal_sync(&j2);
+            memset(&j3, 0, sizeof(j3));
+            CHECK(model_mount(&m3, &j3));
+            CHECK(model_equal(&m3, &m2));
+            if (host_test_failures) {
+                host_test_quiet(false);
+                printf("Operation %u, cut after %llu of %llu steps\n", n, (unsigned long long)cut, (unsigned long long)steps);
+                return;
+            }
+        }
+        restore(&j_old, &m_old, image); ///< Leave the flash as the complete operation does
+        op_run(&model, n);
+        ops++;
+    }
+    host_test_quiet(false);
+    printf("Journal: %u operations, %u compactions, %u power cuts (%u in compactions): %u mounted the old state, %u the new one\n",
+           ops, journal.stats.compactions, cuts, compaction_cuts, olds, news);
+}
+
+static history_t history;
+static uint16_t history_code[HISTORY_OPS];
+static int32_t history_delta[HISTORY_OPS];
+
+/**
+ * \typedef history_check_t
+ * \brief Context of the queries: the records found against the ones appended.
+ */
+typedef struct {
+    uint32_t found;     ///< Records found
+    uint32_t synced;    ///< Records of the script that may be found
+    uint32_t last;      ///< Timestamp of the last record found
+    bool ordered;       ///< The timestamps never go back
+    bool match;         ///< Each record is the one appended at its place, or the mark after it
+} history_check_t;
+
+static void history_check(void *ctx, const history_rec_t *rec)
+{
+    history_check_t *c = ctx;
+    if (c->found && rec->time < c->last) {
+        c->ordered = false;
+    }
+    if (c->found < c->synced) {
+        c->match &= rec->code == history_code[c->found] && rec->delta == history_delta[c->found];
+    }else {
+        c->match &= rec->code == HISTORY_MARK && rec->delta == 1;
+    }
+    c->last = rec->time;
+    c->found++;
+}
+
+/**
+ * @brief Read back the whole history.
+ *
+ * @param h
+ * @param synced Records of the script that may be found
+ * @return history_check_t
+ */
+static history_check_t history_read(history_t *h, uint32_t synced)
+{
+    history_check_t c = {0, synced, 0, true, true};
+    history_query(h, HISTORY_ALL, 0, 0xFFFFFFFEU, history_check, &c);
+    return c;
+}
+
+/**
+ * @brief Append record n of the history script and sync it.
+ *
+ * @param h
+ * @param n
+ */
+static void history_op(history_t *h, uint32_t n)
+{
+    history_code[n] = 1 + (n * 7) % 40;
+    history_delta[n] = (int32_t)(n % 9) - 4;
+    CHECK(history_set_time(h, HISTORY_T0 + n * HISTORY_STEP));
+    history_append(h, history_code[n], history_delta[n], 100 + history_code[n], 150 + history_code[n] + n / 64);
+    history_sync(h);
+}
+
+/**
+ * @brief Reboot on the image left in the flash, check the records and append a mark after them.
+ *
+ * @param synced Records of the script that may be found
+ * @return uint32_t Records of the script found
+ */
+static uint32_t history_reboot(uint32_t synced)
+{
+    static history_t h;
+    memset(&h, 0, sizeof(h));
+    history_init(&h);
+    history_check_t c = history_read(&h, synced);
+    CHECK(c.ordered && c.match && c.found <= synced);
+    CHECK(!c.found || h.time_base > c.last); ///< The clock goes on after the records
+    CHECK(h.index.page[h.page].first_time == 0xFFFFFFFFU || h.time_base > h.index.page[h.page].first_time);
+
+    uint32_t conflicts = flash_emu_stats.conflicts;
+    history_append(&h, HISTORY_MARK, 1, 1, 2);
+    history_sync(&h);
+    CHECK(flash_emu_stats.conflicts == conflicts);
+    history_check_t m = history_read(&h, c.found);
+    CHECK(m.ordered && m.match && m.found == c.found + 1);
+    return c.found;
+}
+
+/**
+ * @brief Restore the history and the sectors an operation can touch.
+ *
+ * @param h
+ * @param image
+ */
+static void history_restore(const history_t *h, const uint8_t *image)
+{
+    for (uint8_t k = 0; k < 2; k++) { ///< The active sector, and the next one for a rotation
+        uint32_t offset = ((h->sector + k) % HISTORY_SECTORS) * FLASH_SECTOR_SIZE;
+        memcpy(&flash_emu_xip[HISTORY_OFFSET + offset], &image[offset], FLASH_SECTOR_SIZE);
+    }
+    history = *h;
+}
+
+/**
+ * @brief Power cut at every step of the syncs of the history script.
+ *
+ */
+static void test_history(void)
+{
+    static uint8_t image[HISTORY_BYTES];
+    static history_t h_old;
+    static const uint8_t uid[4] = {0x04, 0x11, 0x22, 0x33};
+    uint32_t ops = 0, cuts = 0, olds = 0, news = 0, between = 0, rebuilt = 0;
+
+    flash_emu_reset();
+    memset(&history, 0, sizeof(history));
+    host_test_quiet(true);
+    history_init(&history);
+    history_set_operator(&history, uid, sizeof(uid));
+
+    // Through the pages of the first sector, the rotation and the first pages of the next one
+    for (uint32_t n = 0; n < HISTORY_OPS && (history.seq < 2 || history.page < 2); n++) {
+        memcpy(image, &flash_emu_xip[HISTORY_OFFSET], HISTORY_BYTES);
+        h_old = history;
+        uint64_t steps = flash_emu_stats.steps;
+        history_op(&history, n);
+        steps = flash_emu_stats.steps - steps;
+
+        bool seen_new = false;
+        for (uint64_t cut = 0; cut <= steps; cut++) {
+            history_restore(&h_old, image);
+            flash_emu_cut(cut);
+            history_op(&history, n);
+            flash_emu_cut(FLASH_EMU_NO_CUT);
+
+            bool torn = !memcmp(&flash_emu_xip[HISTORY_OFFSET + history.sector*FLASH_SECTOR_SIZE + (1 + history.page)*FLASH_PAGE_SIZE],
+                                history.buffer, FLASH_PAGE_SIZE) &&
+                        memcmp(&flash_emu_xip[HISTORY_OFFSET + history.sector*FLASH_SECTOR_SIZE], &history.index, FLASH_PAGE_SIZE);
+            uint32_t found = history_reboot(n + 1);
+            CHECK(found == n || found == n + 1);
+            CHECK(cut || found == n);            ///< Nothing reached the flash
+            CHECK(cut < steps || found == n + 1); ///< Every step reached the flash
+            CHECK(!(seen_new && found == n));     ///< Once programmed, the record stays
+            seen_new |= found == n + 1;
+            olds += found == n;
+            news += found == n + 1;
+            between += cut == steps - FLASH_PAGE_SIZE;
+            rebuilt += torn && found == n + 1;
+            cuts++;
+            if (host_test_failures) {
+                host_test_quiet(false);
+                printf("History record %u, cut after %llu of %llu steps\n", n, (unsigned long long)cut, (unsigned long long)steps);
+                return;
+            }
+        }
+        history_restore(&h_old, image); ///< Leave the flash as the complete operation does
+        history_op(&history, n);
+        ops++;
+    }
+    CHECK(history.seq == 2 && between == ops && rebuilt > 0);
+
+    // Image of the previous releases: the index entry of a new page programmed, not the page
+    h_old = history;
+    memcpy(image, &flash_emu_xip[HISTORY_OFFSET], HISTORY_BYTES);
+    uint32_t n = ops;
+    while (history.page == h_old.page) {
+        history_op(&history, n++);
+    }
+    history_restore(&h_old, image);
+    for (uint32_t k = ops; k < n - 1; k++) {
+        history_op(&history, k);
+    }
+    CHECK(history.page == h_old.page);
+    CHECK(history_set_time(&history, HISTORY_T0 + (n - 1) * HISTORY_STEP));
+    history_append(&history, history_code[n - 1], history_delta[n - 1], 1, 2);
+    CHECK(history.page == h_old.page + 1 && history.offset > sizeof(uint32_t));
+    flash_range_program(HISTORY_OFFSET + history.sector*FLASH_SECTOR_SIZE, (const uint8_t *)&history.index, FLASH_PAGE_SIZE);
+    CHECK(history_reboot(n) == n - 1);
+    host_test_quiet(false);
+    printf("History: %u records, %u power cuts: %u mounted the old state, %u the new one, "
+           "%u between the page and its index entry (%u entries rebuilt)\n",
+           ops, cuts, olds, news, between, rebuilt);
+}
+
+int main(void)
+{
+    test_journal();
+    if (!host_test_failures) {
+        test_history();
+    }
+    return host_test_result("test_power_cut");
+}
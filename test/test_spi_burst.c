@@ -0,0 +1,150 @@
+/**
+ * \file        test_spi_burst.c
+ * \brief       Host test of the burst FIFO transfers of the reader on the SPI mock.
+ * \details     nfc_write_mult() and nfc_read_mult() must move the whole FIFO in one CS window,
+ *              on the blocking path (below SPI_DMA_MIN) and on the DMA path, with the address
+ *              repeated and the 0x00 stop of the burst read. The cost of nfc_read_card() is
+ *              measured in SPI transactions and bytes, and compared with the per-byte FIFO
+ *              reads of the previous driver (one nfc_read() per byte).
+ * \author      MST_CDA
+ * \version     0.0.1
+ * \date        17/10/2026
+ * \copyright   Unlicensed
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "mfrc522_mock.h"
+
+static nfc_rfid_t nfc;
+static const uint8_t uid[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+
+static void setup(void)
+{
+    mfrc522_mock_reset();
+    memset(&nfc, 0, sizeof(nfc));
+    mfrc522_mock.reader = &nfc;
+    nfc_init_as_spi(&nfc, spi0, 18, 19, 16, 17, 20, 21);
+    mfrc522_mock_clear_stats();
+}
+
+/**
+ * @brief Write a pattern with one burst and read it back with another one.
+ *
+ * @param len
+ * @param dma The transfers are expected on the DMA engine
+ */
+static void test_round_trip(uint8_t len, bool dma)
+{
+    uint8_t out[NFC_BURST_MAX], in[NFC_BURST_MAX];
+    for (uint8_t i = 0; i < len; i++) {
+        out[i] = (uint8_t)(0x5A ^ (i * 37));
+    }
+    mfrc522_mock_clear_stats();
+    nfc_write(&nfc, FIFOLevelReg, 0x80);
+    nfc_write_mult(&nfc, FIFODataReg, out, len);
+    CHECK(mfrc522_mock.fifo_n == len);
+    CHECK(mfrc522_mock.stats.transactions == 2 && mfrc522_mock.stats.bytes == 2u + len + 1);
+
+    memset(in, 0, sizeof(in));
+    nfc_read_mult(&nfc, FIFODataReg, in, len, 0);
+    CHECK(!memcmp(in, out, len));
+    CHECK(mfrc522_mock.fifo_n == 0);
+    CHECK(mfrc522_mock.stats.transactions == 3 && mfrc522_mock.stats.bytes == 2u + 2 * (len + 1));
+    CHECK(mfrc522_mock.stats.dma == (dma ? 2 : 0));
+    CHECK(!mfrc522_mock.stats.violations);
+}
+
+static void test_bursts(void)
+{
+    setup();
+    test_round_trip(1, false);
+    test_round_trip(SPI_DMA_MIN - 1, false);
+    test_round_trip(SPI_DMA_MIN, true);
+    test_round_trip(18, true);
+    test_round_trip(NFC_BURST_MAX, true);
+
+    // A longer write is bounded by the FIFO
+    uint8_t big[NFC_BURST_MAX + 8];
+    memset(big, 0x33, sizeof(big));
+    nfc_write(&nfc, FIFOLevelReg, 0x80);
+    nfc_write_mult(&nfc, FIFODataReg, big, sizeof(big));
+    CHECK(mfrc522_mock.fifo_n == NFC_BURST_MAX && !mfrc522_mock.stats.overflows);
+
+    // rxAlign: the bits below the first received bit keep their value
+    uint8_t b = 0xA5, back[2] = {0x0F, 0};
+    nfc_write(&nfc, FIFOLevelReg, 0x80);
+    nfc_write_mult(&nfc, FIFODataReg, &b, 1);
+    nfc_read_mult(&nfc, FIFODataReg, back, 1, 4);
+    CHECK(back[0] == 0xAF);
+}
+
+/**
+ * @brief Select the card and authenticate its first sector, as the inventory loop does.
+ *
+ */
+static void select_card(void)
+{
+    uint8_t atqa[2], size = sizeof(atqa);
+    CHECK(nfc_requestA(&nfc, atqa, &size) == STATUS_OK);
+    CHECK(nfc_select(&nfc, &nfc.uid, 0) == STATUS_OK);
+    CHECK(nfc.uid.size == 4 && !memcmp(nfc.uid.uidByte, uid, 4) && nfc.uid.sak == 0x08);
+    CHECK(nfc_authenticate(&nfc, PICC_CMD_MF_AUTH_KEY_A, 1, nfc.keyByte, &nfc.uid) == STATUS_OK);
+}
+
+static void test_read_card(void)
+{
+    setup();
+    mfrc522_mock_card(uid);
+    for (uint8_t i = 0; i < 16; i++) {
+        mfrc522_mock.card.block[1][i] = 0xC0 + i;
+    }
+    select_card();
+
+    uint8_t buffer[18], size = sizeof(buffer);
+    mfrc522_mock_clear_stats();
+    uint32_t transactions = nfc.spi_stats.transactions, bytes = nfc.spi_stats.bytes;
+    CHECK(nfc_read_card(&nfc, 1, buffer, &size) == STATUS_OK);
+    CHECK(size == 18 && !memcmp(buffer, mfrc522_mock.card.block[1], 16));
+    CHECK(!mfrc522_mock.stats.violations && !mfrc522_mock.stats.crc_errors);
+    uint32_t read_t = mfrc522_mock.stats.transactions, read_b = mfrc522_mock.stats.bytes;
+    CHECK(nfc.spi_stats.transactions - transactions == read_t && nfc.spi_stats.bytes - bytes == read_b);
+
+    // Per-byte reads of the same FIFO: one register transaction per byte
+    uint8_t answer[18];
+    nfc_write(&nfc, FIFOLevelReg, 0x80);
+    nfc_write_mult(&nfc, FIFODataReg, buffer, size);
+    mfrc522_mock_clear_stats();
+    for (uint8_t i = 0; i < size; i++) {
+        answer[i] = nfc_read(&nfc, FIFODataReg);
+    }
+    CHECK(!memcmp(answer, buffer, size));
+    uint32_t legacy_t = read_t - 1 + mfrc522_mock.stats.transactions;
+    uint32_t legacy_b = read_b - (size + 1) + mfrc522_mock.stats.bytes;
+    printf("nfc_read_card(): %u SPI transactions, %u bytes; with per-byte FIFO reads %u transactions, %u bytes\n",
+           read_t, read_b, legacy_t, legacy_b);
+    CHECK(read_t + size - 1 == legacy_t);
+
+    // Write a block and read it back
+    uint8_t data[16];
+    for (uint8_t i = 0; i < 16; i++) {
+        data[i] = 0x10 + i;
+    }
+    CHECK(nfc_write_card(&nfc, 2, data) == STATUS_OK);
+    CHECK(!memcmp(mfrc522_mock.card.block[2], data, 16));
+    size = sizeof(buffer);
+    CHECK(nfc_read_card(&nfc, 2, buffer, &size) == STATUS_OK && !memcmp(buffer, data, 16));
+    CHECK(nfc_halt(&nfc) == STATUS_OK);
+    CHECK(mfrc522_mock.card.state == MOCK_CARD_HALT);
+    CHECK(!mfrc522_mock.stats.violations && !mfrc522_mock.stats.overflows);
+}
+
+int main(void)
+{
+    test_bursts();
+    test_read_card();
+    return host_test_result("test_spi_burst");
+}